@@ -1558,6 +1558,20 @@ public:
     */
     XMLError Parse( const char* xml, size_t nBytes=(size_t)(-1) );
 
+    /**
+    	Parse an XML document in place, without copying it.
+    	Returns XML_NO_ERROR (0) on success, or
+    	an errorID.
+
+    	'xml' must hold 'nBytes' bytes followed by a null
+    	terminator, and stay valid until the document is
+    	cleared or destroyed. Parsing writes terminators and
+    	normalized text into it, but only where the text
+    	changes, so a private memory map of a file is copied
+    	only around the values that are read.
+    */
+    XMLError ParseInSitu( char* xml, size_t nBytes );
+
     /**
     	Load an XML file from disk.
     	Returns XML_NO_ERROR (0) on success, or
@@ -1730,6 +1744,7 @@ private:
     const char* _errorStr1;
     const char* _errorStr2;
     char*       _charBuffer;
+    bool        _ownsCharBuffer;
 
     MemPoolT< sizeof(XMLElement) >	 _elementPool;
     MemPoolT< sizeof(XMLAttribute) > _attributePool;
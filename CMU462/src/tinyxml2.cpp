@@ -262,6 +262,14 @@ const char* StrPair::GetStr()
             char* p = _start;	// the read pointer
             char* q = _start;	// the write pointer
 
+            // skip ahead to the first character that changes, so that
+            // text that needs no processing is not rewritten
+            while( p < _end && *p != CR && *p != '&'
+                   && !( *p == LF && *(p+1) == CR ) ) {
+                ++p;
+            }
+            q = p;
+
             while( p < _end ) {
                 if ( (_flags & NEEDS_NEWLINE_NORMALIZATION) && *p == CR ) {
                     // CR-LF pair becomes LF
@@ -335,7 +343,9 @@ const char* StrPair::GetStr()
                     ++q;
                 }
             }
-            *q = 0;
+            if ( q < _end ) {
+                *q = 0;
+            }
         }
         // The loop below has plenty going on, and this
         // is a less useful mode. Break it out.
@@ -1767,7 +1777,8 @@ XMLDocument::XMLDocument( bool processEntities, Whitespace whitespace ) :
     _whitespace( whitespace ),
     _errorStr1( 0 ),
     _errorStr2( 0 ),
-    _charBuffer( 0 )
+    _charBuffer( 0 ),
+    _ownsCharBuffer( true )
 {
     // avoid VC++ C4355 warning about 'this' in initializer list (C4355 is off by default in VS2012+)
     _document = this;
@@ -1791,8 +1802,11 @@ void XMLDocument::Clear()
     _errorStr1 = 0;
     _errorStr2 = 0;
 
-    delete [] _charBuffer;
+    if ( _ownsCharBuffer ) {
+        delete [] _charBuffer;
+    }
     _charBuffer = 0;
+    _ownsCharBuffer = true;
 
 #if 0
     _textPool.Trace( "text" );
@@ -2007,6 +2021,30 @@ XMLError XMLDocument::Parse( const char* p, size_t len )
 }
 
 
+XMLError XMLDocument::ParseInSitu( char* xml, size_t nBytes )
+{
+    Clear();
+
+    if ( nBytes == 0 || !xml || !*xml ) {
+        SetError( XML_ERROR_EMPTY_DOCUMENT, 0, 0 );
+        return _errorID;
+    }
+    TIXMLASSERT( xml[nBytes] == 0 );
+    _charBuffer = xml;
+    _ownsCharBuffer = false;
+
+    Parse();
+    if ( Error() ) {
+        DeleteChildren();
+        _elementPool.Clear();
+        _attributePool.Clear();
+        _textPool.Clear();
+        _commentPool.Clear();
+    }
+    return _errorID;
+}
+
+
 void XMLDocument::Print( XMLPrinter* streamer ) const
 {
     if ( streamer ) {
@@ -0,0 +1,44 @@
+#!/usr/bin/env python3
+"""Send render jobs to a Scotty3D render server and print its replies.
+
+Start the server with
+
+    scotty3d -u /tmp/scotty3d.sock -t 8
+
+and send it jobs, one per argument or one per line of standard input:
+
+    render_client.py /tmp/scotty3d.sock "scene=a.dae out=a.png spp=64"
+    render_client.py /tmp/scotty3d.sock < jobs.txt
+    render_client.py /tmp/scotty3d.sock quit
+
+The exit status is 1 if any job failed.
+"""
+
+import socket
+import sys
+
+
+def main():
+    if len(sys.argv) < 2:
+        print(__doc__.strip(), file=sys.stderr)
+        return 2
+
+    jobs = sys.argv[2:]
+    if not jobs:
+        jobs = [line.strip() for line in sys.stdin]
+    jobs = [job for job in jobs if job and not job.startswith("#")]
+
+    failed = False
+    with socket.socket(socket.AF_UNIX, socket.SOCK_STREAM) as sock:
+        sock.connect(sys.argv[1])
+        replies = sock.makefile("r")
+        for job in jobs:
+            sock.sendall((job + "\n").encode())
+            reply = replies.readline().strip()
+            print(reply)
+            failed = failed or reply.startswith("error")
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
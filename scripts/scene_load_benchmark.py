@@ -0,0 +1,63 @@
+#!/usr/bin/env python3
+"""Compare how long Scotty3D takes to load a COLLADA scene and its binary copy.
+
+    scene_load_benchmark.py path/to/scotty3d scene.dae [runs]
+
+The scene is saved next to itself as scene.s3d with -C, then both files are
+loaded runs times (default 5) with -L, and the best time of each step is
+printed for both, along with the total of the parsing, building and
+converting steps.
+"""
+
+import os
+import re
+import subprocess
+import sys
+
+STEP = re.compile(r"\[Scotty3D\] (.*?)\.\.\. Done! \(([0-9.]+) sec\)")
+
+# steps that make up the whole load, the others are parts of them
+TOTAL_STEPS = ("Parsing scene", "Building scene",
+               "Converting scene for rendering")
+
+
+def load_times(scotty3d, scene):
+    out = subprocess.run([scotty3d, "-L", scene], check=True,
+                         stdout=subprocess.PIPE, universal_newlines=True).stdout
+    return [(step, float(sec)) for step, sec in STEP.findall(out)]
+
+
+def best_times(scotty3d, scene, runs):
+    best = {}
+    steps = []
+    for _ in range(runs):
+        for step, sec in load_times(scotty3d, scene):
+            if step not in best:
+                steps.append(step)
+            best[step] = min(sec, best.get(step, sec))
+    return [(step, best[step]) for step in steps]
+
+
+def main():
+    if len(sys.argv) < 3:
+        print(__doc__.strip(), file=sys.stderr)
+        return 2
+
+    scotty3d, scene = sys.argv[1], sys.argv[2]
+    runs = int(sys.argv[3]) if len(sys.argv) > 3 else 5
+    binary = os.path.splitext(scene)[0] + ".s3d"
+    subprocess.run([scotty3d, "-C", binary, scene], check=True,
+                   stdout=subprocess.DEVNULL)
+
+    for path in (scene, binary):
+        times = best_times(scotty3d, path, runs)
+        print("%s (%d bytes)" % (path, os.path.getsize(path)))
+        for step, sec in times:
+            print("  %-32s %8.4f sec" % (step, sec))
+        total = sum(sec for step, sec in times if step in TOTAL_STEPS)
+        print("  %-32s %8.4f sec" % ("Total", total))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,169 @@
+#include "aov.h"
+
+#include <sstream>
+#include <algorithm>
+
+namespace CMU462 {
+
+bool parse_aov_list(const std::string& list, int* flags) {
+  *flags = AOV_NONE;
+
+  std::stringstream ss(list);
+  std::string name;
+  while (std::getline(ss, name, ',')) {
+    if (name == "albedo") {
+      *flags |= AOV_ALBEDO;
+    } else if (name == "normal") {
+      *flags |= AOV_NORMAL;
+    } else if (name == "depth") {
+      *flags |= AOV_DEPTH;
+    } else if (name == "primid") {
+      *flags |= AOV_PRIMITIVE_ID;
+    } else if (name == "objid") {
+      *flags |= AOV_OBJECT_ID;
+    } else if (name == "count") {
+      *flags |= AOV_SAMPLE_COUNT;
+    } else if (name == "variance") {
+      *flags |= AOV_VARIANCE;
+    } else if (name == "all") {
+      *flags |= AOV_ALL;
+    } else {
+      return false;
+    }
+  }
+  return true;
+}
+
+void AOVBuffer::resize(size_t w, size_t h) {
+  this->w = w;
+  this->h = h;
+
+  // disabled layers are released
+  size_t num_pixels = w * h;
+  albedo.resize(has(AOV_ALBEDO) ? w : 0, has(AOV_ALBEDO) ? h : 0);
+  normal.assign(has(AOV_NORMAL) ? num_pixels : 0, Vector3D());
+  depth.assign(has(AOV_DEPTH) ? num_pixels : 0, 0.f);
+  primitive_id.assign(has(AOV_PRIMITIVE_ID) ? num_pixels : 0, 0.f);
+  object_id.assign(has(AOV_OBJECT_ID) ? num_pixels : 0, 0.f);
+  sample_count.assign(has(AOV_SAMPLE_COUNT) ? num_pixels : 0, 0.f);
+  variance.resize(has(AOV_VARIANCE) ? w : 0, has(AOV_VARIANCE) ? h : 0);
+}
+
+void AOVBuffer::set_enabled(int flags) {
+  enabled = flags;
+  resize(w, h);
+}
+
+void AOVBuffer::clear_ids() {
+  ids.clear();
+  num_objects = 0;
+}
+
+void AOVBuffer::add_object_ids(
+    const std::vector<StaticScene::Primitive*>& primitives) {
+  float object = ++num_objects;
+  for (StaticScene::Primitive* prim : primitives) {
+    float primitive = ids.size() + 1;
+    ids[prim] = std::make_pair(object, primitive);
+  }
+}
+
+void AOVBuffer::clear() { resize(w, h); }
+
+void AOVBuffer::update_pixel(const AOVPixel& p, const Spectrum& L, size_t x,
+                             size_t y) {
+  size_t i = x + y * w;
+  float n = p.num_samples;
+  float scale = 1.f / n;
+
+  if (has(AOV_ALBEDO)) albedo.data[i] = p.albedo * scale;
+  if (has(AOV_NORMAL)) normal[i] = p.normal * scale;
+  if (has(AOV_DEPTH)) depth[i] = p.depth * scale;
+  if (enabled & AOV_IDS) {
+    std::pair<float, float> id(0.f, 0.f);
+    if (p.primitive) {
+      auto it = ids.find(p.primitive);
+      if (it != ids.end()) id = it->second;
+    }
+    if (has(AOV_OBJECT_ID)) object_id[i] = id.first;
+    if (has(AOV_PRIMITIVE_ID)) primitive_id[i] = id.second;
+  }
+  if (has(AOV_SAMPLE_COUNT)) sample_count[i] = n;
+  if (has(AOV_VARIANCE)) {
+    // unbiased sample variance, divided by n for the variance of the mean
+    Spectrum v;
+    if (n > 1) v = (p.L2 * scale + L * L * -1.f) * (1.f / (n - 1));
+    variance.data[i] = Spectrum(std::max(v.r, 0.f), std::max(v.g, 0.f),
+                                std::max(v.b, 0.f));
+  }
+}
+
+void AOVBuffer::save_region(size_t x0, size_t y0, size_t w, size_t h,
+                            std::vector<float>& out) const {
+  for (size_t y = y0; y < y0 + h; ++y) {
+    for (size_t x = x0; x < x0 + w; ++x) {
+      size_t i = x + y * this->w;
+      if (has(AOV_ALBEDO)) {
+        const Spectrum& a = albedo.data[i];
+        out.insert(out.end(), {a.r, a.g, a.b});
+      }
+      if (has(AOV_NORMAL)) {
+        const Vector3D& n = normal[i];
+        out.insert(out.end(), {(float)n.x, (float)n.y, (float)n.z});
+      }
+      if (has(AOV_DEPTH)) out.push_back(depth[i]);
+      if (has(AOV_PRIMITIVE_ID)) out.push_back(primitive_id[i]);
+      if (has(AOV_OBJECT_ID)) out.push_back(object_id[i]);
+      if (has(AOV_SAMPLE_COUNT)) out.push_back(sample_count[i]);
+      if (has(AOV_VARIANCE)) {
+        const Spectrum& v = variance.data[i];
+        out.insert(out.end(), {v.r, v.g, v.b});
+      }
+    }
+  }
+}
+
+bool AOVBuffer::load_region(size_t x0, size_t y0, size_t w, size_t h,
+                            const std::vector<float>& in) {
+  size_t per_pixel = (has(AOV_ALBEDO) ? 3 : 0) + (has(AOV_NORMAL) ? 3 : 0) +
+                     has(AOV_DEPTH) + has(AOV_PRIMITIVE_ID) +
+                     has(AOV_OBJECT_ID) + has(AOV_SAMPLE_COUNT) +
+                     (has(AOV_VARIANCE) ? 3 : 0);
+  if (in.size() != per_pixel * w * h) return false;
+
+  const float* p = in.data();
+  for (size_t y = y0; y < y0 + h; ++y) {
+    for (size_t x = x0; x < x0 + w; ++x) {
+      size_t i = x + y * this->w;
+      if (has(AOV_ALBEDO)) {
+        albedo.data[i] = Spectrum(p[0], p[1], p[2]);
+        p += 3;
+      }
+      if (has(AOV_NORMAL)) {
+        normal[i] = Vector3D(p[0], p[1], p[2]);
+        p += 3;
+      }
+      if (has(AOV_DEPTH)) depth[i] = *p++;
+      if (has(AOV_PRIMITIVE_ID)) primitive_id[i] = *p++;
+      if (has(AOV_OBJECT_ID)) object_id[i] = *p++;
+      if (has(AOV_SAMPLE_COUNT)) sample_count[i] = *p++;
+      if (has(AOV_VARIANCE)) {
+        variance.data[i] = Spectrum(p[0], p[1], p[2]);
+        p += 3;
+      }
+    }
+  }
+  return true;
+}
+
+void AOVBuffer::add_layers(EXRWriter& writer) const {
+  if (has(AOV_ALBEDO)) writer.add_rgb("albedo", albedo);
+  if (has(AOV_NORMAL)) writer.add_xyz("normal", normal);
+  if (has(AOV_DEPTH)) writer.add_scalar("depth.Z", depth);
+  if (has(AOV_PRIMITIVE_ID)) writer.add_scalar("primitiveID", primitive_id);
+  if (has(AOV_OBJECT_ID)) writer.add_scalar("objectID", object_id);
+  if (has(AOV_SAMPLE_COUNT)) writer.add_scalar("sampleCount", sample_count);
+  if (has(AOV_VARIANCE)) writer.add_rgb("variance", variance);
+}
+
+}  // namespace CMU462
@@ -0,0 +1,192 @@
+#ifndef CMU462_AOV_H
+#define CMU462_AOV_H
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include "CMU462/vector3D.h"
+#include "CMU462/spectrum.h"
+
+#include "image.h"
+#include "exr_writer.h"
+#include "static_scene/scene.h"
+
+namespace CMU462 {
+
+/**
+ * The arbitrary output variables (AOVs) the path tracer can write next to
+ * the color of a render. Each AOV is a bit, so a set of them is an int.
+ */
+enum AOVFlags {
+  AOV_ALBEDO = 1 << 0,        ///< albedo of the first hit
+  AOV_NORMAL = 1 << 1,        ///< world space normal of the first hit
+  AOV_DEPTH = 1 << 2,         ///< distance to the first hit
+  AOV_PRIMITIVE_ID = 1 << 3,  ///< primitive of the first hit, 0 for none
+  AOV_OBJECT_ID = 1 << 4,     ///< scene object of the first hit, 0 for none
+  AOV_SAMPLE_COUNT = 1 << 5,  ///< number of camera rays in the pixel
+  AOV_VARIANCE = 1 << 6,      ///< variance of the pixel estimate
+
+  AOV_NONE = 0,
+  AOV_ALL = (1 << 7) - 1,
+  AOV_DENOISER = AOV_ALBEDO | AOV_NORMAL | AOV_DEPTH,  ///< denoiser features
+  AOV_IDS = AOV_PRIMITIVE_ID | AOV_OBJECT_ID
+};
+
+/**
+ * Parse a comma separated list of AOV names, e.g. "albedo,normal,depth".
+ * The names are albedo, normal, depth, primid, objid, count, variance and
+ * all.
+ * \param list list of AOV names
+ * \param flags address to store the set of AOVs
+ * \return false if the list contains an unknown name
+ */
+bool parse_aov_list(const std::string& list, int* flags);
+
+/**
+ * What a camera ray saw at its first hit. A miss is recorded as all zeros.
+ */
+struct AOVHit {
+  AOVHit() : depth(0.f), primitive(NULL) {}
+
+  Spectrum albedo;  ///< albedo of the BSDF that was hit
+  Vector3D normal;  ///< world space normal
+  float depth;      ///< distance along the ray
+
+  const StaticScene::Primitive* primitive;  ///< primitive that was hit
+};
+
+/**
+ * Running sums of the camera rays of one pixel.
+ */
+struct AOVPixel {
+  AOVPixel() : depth(0.f), primitive(NULL), num_samples(0) {}
+
+  /**
+   * Add a camera ray.
+   * \param L radiance the ray brought back
+   * \param hit first hit of the ray
+   */
+  void add(const Spectrum& L, const AOVHit& hit) {
+    L2 += L * L;
+    albedo += hit.albedo;
+    normal += hit.normal;
+    depth += hit.depth;
+    if (!primitive) primitive = hit.primitive;
+    num_samples++;
+  }
+
+  Spectrum L2;      ///< sum of the squared radiance
+  Spectrum albedo;  ///< sum of the albedos
+  Vector3D normal;  ///< sum of the normals
+  float depth;      ///< sum of the depths
+
+  const StaticScene::Primitive* primitive;  ///< first primitive that was hit
+  size_t num_samples;                       ///< number of rays added
+};
+
+/**
+ * The AOV layers of a render. Only the enabled layers are allocated and
+ * filled, so a path tracer with no AOVs enabled pays nothing but a check
+ * per pixel.
+ */
+struct AOVBuffer {
+  /**
+   * Default constructor.
+   * Creates a zero-sized buffer with no AOVs enabled.
+   */
+  AOVBuffer() : w(0), h(0), enabled(AOV_NONE), num_objects(0) {}
+
+  /**
+   * Resize the enabled layers and clear them.
+   * \param w new width of the layers
+   * \param h new height of the layers
+   */
+  void resize(size_t w, size_t h);
+
+  /**
+   * Set the AOVs to fill. The layers are reallocated at the current size.
+   * \param flags set of AOVs
+   */
+  void set_enabled(int flags);
+
+  /**
+   * If all the given AOVs are enabled.
+   */
+  bool has(int flags) const { return (enabled & flags) == flags; }
+
+  /**
+   * Forget the IDs of all objects and primitives.
+   */
+  void clear_ids();
+
+  /**
+   * Give the next object ID to an object and the next primitive IDs to its
+   * primitives. IDs start at 1, 0 means nothing was hit.
+   * \param primitives primitives of the object
+   */
+  void add_object_ids(const std::vector<StaticScene::Primitive*>& primitives);
+
+  /**
+   * Clear all layers.
+   */
+  void clear();
+
+  /**
+   * Write the sums of the camera rays of a pixel to the layers.
+   * \param p sums of the camera rays of the pixel
+   * \param L mean radiance of the pixel
+   * \param x column of the pixel
+   * \param y row of the pixel
+   */
+  void update_pixel(const AOVPixel& p, const Spectrum& L, size_t x, size_t y);
+
+  /**
+   * Append the values of the enabled layers in a region to an array, pixel
+   * by pixel, for a checkpoint.
+   * \param x0 left column of the region
+   * \param y0 bottom row of the region
+   * \param w width of the region
+   * \param h height of the region
+   * \param out array to append to
+   */
+  void save_region(size_t x0, size_t y0, size_t w, size_t h,
+                   std::vector<float>& out) const;
+
+  /**
+   * Set the enabled layers in a region from values saved by save_region.
+   * \return false if the number of values does not fit the region
+   */
+  bool load_region(size_t x0, size_t y0, size_t w, size_t h,
+                   const std::vector<float>& in);
+
+  /**
+   * Add every enabled AOV to an OpenEXR file as a layer of its own.
+   * \param writer writer of the file
+   */
+  void add_layers(EXRWriter& writer) const;
+
+  size_t w;     ///< width
+  size_t h;     ///< height
+  int enabled;  ///< set of AOVs filled
+
+  HDRImageBuffer albedo;            ///< albedo layer
+  std::vector<Vector3D> normal;     ///< normal layer
+  std::vector<float> depth;         ///< depth layer
+  std::vector<float> primitive_id;  ///< primitive ID layer
+  std::vector<float> object_id;     ///< object ID layer
+  std::vector<float> sample_count;  ///< sample count layer
+  HDRImageBuffer variance;          ///< variance layer
+
+ private:
+  /**
+   * Object and primitive ID of each primitive.
+   */
+  std::unordered_map<const StaticScene::Primitive*, std::pair<float, float> >
+      ids;
+  size_t num_objects;  ///< number of objects given IDs
+};
+
+}  // namespace CMU462
+
+#endif  // CMU462_AOV_H
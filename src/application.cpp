@@ -7,6 +7,7 @@
 #include "dynamic_scene/spot_light.h"
 #include "dynamic_scene/sphere.h"
 #include "dynamic_scene/mesh.h"
+#include "dynamic_scene/baked_mesh.h"
 #include "dynamic_scene/widgets.h"
 #include "dynamic_scene/skeleton.h"
 #include "dynamic_scene/joint.h"
@@ -16,10 +17,14 @@
 #include "GLFW/glfw3.h"
 
 #include <functional>
+#include <memory>
 #include <sstream>
 #include <chrono>
 #include <algorithm>
 #include <thread>
+#include <mutex>
+#include <deque>
+#include <condition_variable>
 using namespace std;
 
 using Collada::CameraInfo;
@@ -31,14 +36,18 @@ using Collada::SphereInfo;
 
 namespace CMU462 {
 
-Application::Application(AppConfig config) {
+Application::Application(AppConfig config) : config(config) {
   scene = nullptr;
+  sceneFile = nullptr;
 
   pathtracer =
       new PathTracer(config.pathtracer_ns_aa, config.pathtracer_max_ray_depth,
                      config.pathtracer_ns_area_light, config.pathtracer_ns_diff,
                      config.pathtracer_ns_glsy, config.pathtracer_ns_refr,
-                     config.pathtracer_num_threads, config.pathtracer_envmap);
+                     config.pathtracer_num_threads, config.pathtracer_envmap,
+                     config.pathtracer_wavefront, config.pathtracer_denoise,
+                     config.pathtracer_aovs, config.pathtracer_exr_half,
+                     config.pathtracer_tone_operator);
 
   timestep = 0.1;
   damping_factor = 0.0;
@@ -52,8 +61,10 @@ Application::Application(AppConfig config) {
 }
 
 Application::~Application() {
+  wait_for_writes();
   if (pathtracer != nullptr) delete pathtracer;
   if (scene != nullptr) delete scene;
+  delete sceneFile;
 }
 
 void Application::init() {
@@ -117,7 +128,7 @@ void Application::init() {
   // load()).
   if (screenW == 0 || screenH == 0)
     screenW = screenH = 600;
-  CameraInfo cameraInfo;
+  cameraInfo = CameraInfo();
   cameraInfo.hFov = 20;
   cameraInfo.vFov = 28;
   cameraInfo.nClip = 0.1;
@@ -484,6 +495,7 @@ void Application::load(SceneInfo *sceneInfo) {
   vector<Collada::Node> &nodes = sceneInfo->nodes;
   vector<DynamicScene::SceneLight *> lights;
   vector<DynamicScene::SceneObject *> objects;
+  vector<pair<DynamicScene::Mesh *, Collada::Node *>> meshes;
 
   // save camera position to update camera control later
   CameraInfo *c;
@@ -513,8 +525,7 @@ void Application::load(SceneInfo *sceneInfo) {
             init_sphere(static_cast<SphereInfo &>(*instance), transform));
         break;
       case Collada::Instance::POLYMESH:
-        objects.push_back(
-            init_polymesh(static_cast<PolymeshInfo &>(*instance), transform));
+        objects.push_back(init_polymesh(node, &meshes));
         break;
       case Collada::Instance::MATERIAL:
         init_material(static_cast<MaterialInfo &>(*instance));
@@ -522,11 +533,130 @@ void Application::load(SceneInfo *sceneInfo) {
     }
   }
 
+  build_meshes(meshes);
+  init_scene(objects, lights, c_dir);
+
+  // cerr << "==================================" << endl;
+  // cerr << "CAMERA" << endl;
+  // cerr << "      hFov: " << camera.hFov << endl;
+  // cerr << "      vFov: " << camera.vFov << endl;
+  // cerr << "        ar: " << camera.ar << endl;
+  // cerr << "     nClip: " << camera.nClip << endl;
+  // cerr << "     fClip: " << camera.fClip << endl;
+  // cerr << "       pos: " << camera.pos << endl;
+  // cerr << " targetPos: " << camera.targetPos << endl;
+  // cerr << "       phi: " << camera.phi << endl;
+  // cerr << "     theta: " << camera.theta << endl;
+  // cerr << "         r: " << camera.r << endl;
+  // cerr << "      minR: " << camera.minR << endl;
+  // cerr << "      maxR: " << camera.maxR << endl;
+  // cerr << "       c2w: " << camera.c2w << endl;
+  // cerr << "   screenW: " << camera.screenW << endl;
+  // cerr << "   screenH: " << camera.screenH << endl;
+  // cerr << "screenDist: " << camera.screenDist<< endl;
+  // cerr << "==================================" << endl;
+}
+
+void Application::load(SceneFile *file, bool editable) {
+  delete sceneFile;
+  sceneFile = file;
+
+  vector<DynamicScene::SceneLight *> lights;
+  vector<DynamicScene::SceneObject *> objects;
+
+  // the camera and lights were saved as they were made, so they are made
+  // the same way again
+  init_camera(file->camera, Matrix4x4::identity());
+
+  for (SceneFile::Light &light : file->lights) {
+    DynamicScene::SceneLight *l = init_light(light.info, light.transform);
+    if (l) lights.push_back(l);
+  }
+
+  for (const SceneFile::Sphere &sphere : file->spheres) {
+    MaterialInfo material;
+    material.bsdf = file->materials[sphere.material];
+    SphereInfo info;
+    info.radius = sphere.radius;
+    info.material = &material;
+    objects.push_back(new DynamicScene::Sphere(info, sphere.center, 1));
+  }
+
+  vector<DynamicScene::Mesh *> meshes;
+  for (const SceneFile::Mesh &m : file->meshes) {
+    BSDF *bsdf = file->materials[m.material];
+    if (!editable) {
+      objects.push_back(new DynamicScene::BakedMesh(
+          m.positions, m.normals, m.texcoords, m.num_vertices, m.indices,
+          m.num_indices, bsdf));
+      continue;
+    }
+
+    vector<vector<size_t>> polygons(m.num_polygons);
+    vector<vector<Vector2D>> texcoords(m.polygon_texcoords ? m.num_polygons
+                                                           : 0);
+    const uint64_t *index = m.polygon_indices;
+    const Vector2D *texcoord = m.polygon_texcoords;
+    for (size_t i = 0; i < m.num_polygons; ++i) {
+      polygons[i].assign(index, index + m.degrees[i]);
+      index += m.degrees[i];
+      if (texcoord) {
+        texcoords[i].assign(texcoord, texcoord + m.degrees[i]);
+        texcoord += m.degrees[i];
+      }
+    }
+    vector<Vector3D> vertices(m.polygon_positions,
+                              m.polygon_positions + m.num_polygon_vertices);
+    DynamicScene::Mesh *mesh =
+        new DynamicScene::Mesh(polygons, vertices, bsdf, texcoords);
+    objects.push_back(mesh);
+    meshes.push_back(mesh);
+  }
+
+  init_scene(objects, lights, file->camera.view_dir);
+
+  // skeletons, as loadSkeleton makes them from their own files
+  for (size_t i = 0; i < meshes.size(); ++i) {
+    const vector<SceneFile::Joint> &joints = file->meshes[i].joints;
+    if (joints.empty()) continue;
+
+    DynamicScene::Skeleton *skeleton = meshes[i]->skeleton;
+    skeleton->joints.clear();
+    for (const SceneFile::Joint &j : joints) {
+      DynamicScene::Joint *joint = new DynamicScene::Joint(skeleton);
+      joint->axis = j.axis;
+      joint->capsuleRadius = j.capsule_radius;
+      joint->renderScale = j.render_scale;
+      for (const auto &knot : j.positions) {
+        joint->positions.setValue(knot.first, knot.second);
+        timeline.markTime(knot.first);
+      }
+      for (const auto &knot : j.rotations) {
+        joint->rotations.setValue(knot.first, knot.second);
+        timeline.markTime(knot.first);
+      }
+      for (const auto &knot : j.scales) {
+        joint->scales.setValue(knot.first, knot.second);
+        timeline.markTime(knot.first);
+      }
+      joint->parent = j.parent < 0 ? nullptr : skeleton->joints[j.parent];
+      if (joint->parent) joint->parent->kids.push_back(joint);
+      skeleton->joints.push_back(joint);
+      scene->addObject(joint);
+    }
+    skeleton->root = skeleton->joints[0];
+  }
+}
+
+void Application::init_scene(
+    const vector<DynamicScene::SceneObject *> &objects,
+    vector<DynamicScene::SceneLight *> &lights, const Vector3D &c_dir) {
   if (lights.size() == 0) {  // no lights, default use ambient_light
     LightInfo default_light = LightInfo();
     lights.push_back(new DynamicScene::AmbientLight(default_light));
   }
   scene = new DynamicScene::Scene(objects, lights);
+  cameraViewDir = c_dir;
 
   const BBox &bbox = scene->get_bbox();
   if (!bbox.empty()) {
@@ -548,30 +678,11 @@ void Application::load(SceneInfo *sceneInfo) {
 
   // set default draw styles for meshEdit -
   scene->set_draw_styles(&defaultStyle, &hoverStyle, &selectStyle);
-
-  // cerr << "==================================" << endl;
-  // cerr << "CAMERA" << endl;
-  // cerr << "      hFov: " << camera.hFov << endl;
-  // cerr << "      vFov: " << camera.vFov << endl;
-  // cerr << "        ar: " << camera.ar << endl;
-  // cerr << "     nClip: " << camera.nClip << endl;
-  // cerr << "     fClip: " << camera.fClip << endl;
-  // cerr << "       pos: " << camera.pos << endl;
-  // cerr << " targetPos: " << camera.targetPos << endl;
-  // cerr << "       phi: " << camera.phi << endl;
-  // cerr << "     theta: " << camera.theta << endl;
-  // cerr << "         r: " << camera.r << endl;
-  // cerr << "      minR: " << camera.minR << endl;
-  // cerr << "      maxR: " << camera.maxR << endl;
-  // cerr << "       c2w: " << camera.c2w << endl;
-  // cerr << "   screenW: " << camera.screenW << endl;
-  // cerr << "   screenH: " << camera.screenH << endl;
-  // cerr << "screenDist: " << camera.screenDist<< endl;
-  // cerr << "==================================" << endl;
 }
 
 void Application::init_camera(CameraInfo &cameraInfo,
                               const Matrix4x4 &transform) {
+  this->cameraInfo = cameraInfo;
   camera.configure(cameraInfo, screenW, screenH);
   canonicalCamera.configure(cameraInfo, screenW, screenH);
   set_projection_matrix();
@@ -581,23 +692,33 @@ void Application::reset_camera() { camera.copy_placement(canonicalCamera); }
 
 DynamicScene::SceneLight *Application::init_light(LightInfo &light,
                                                   const Matrix4x4 &transform) {
+  DynamicScene::SceneLight *l = nullptr;
   switch (light.light_type) {
     case Collada::LightType::NONE:
       break;
     case Collada::LightType::AMBIENT:
-      return new DynamicScene::AmbientLight(light);
+      l = new DynamicScene::AmbientLight(light);
+      break;
     case Collada::LightType::DIRECTIONAL:
-      return new DynamicScene::DirectionalLight(light, transform);
+      l = new DynamicScene::DirectionalLight(light, transform);
+      break;
     case Collada::LightType::AREA:
-      return new DynamicScene::AreaLight(light, transform);
+      l = new DynamicScene::AreaLight(light, transform);
+      break;
     case Collada::LightType::POINT:
-      return new DynamicScene::PointLight(light, transform);
+      l = new DynamicScene::PointLight(light, transform);
+      break;
     case Collada::LightType::SPOT:
-      return new DynamicScene::SpotLight(light, transform);
+      l = new DynamicScene::SpotLight(light, transform);
+      break;
     default:
       break;
   }
-  return nullptr;
+  if (l) {
+    l->info = light;
+    l->transform = transform;
+  }
+  return l;
 }
 
 /**
@@ -615,8 +736,52 @@ DynamicScene::SceneObject *Application::init_sphere(
 }
 
 DynamicScene::SceneObject *Application::init_polymesh(
-    PolymeshInfo &polymesh, const Matrix4x4 &transform) {
-  return new DynamicScene::Mesh(polymesh, transform);
+    Collada::Node &node,
+    vector<pair<DynamicScene::Mesh *, Collada::Node *>> *meshes) {
+  // the mesh is made now, in the order of the scene, which keeps its objects
+  // in the order they were made, and built later on one of several threads
+  DynamicScene::Mesh *mesh = new DynamicScene::Mesh();
+  meshes->push_back(make_pair(mesh, &node));
+  return mesh;
+}
+
+void Application::build_meshes(
+    const vector<pair<DynamicScene::Mesh *, Collada::Node *>> &meshes) {
+  size_t num_threads = min<size_t>(max(1u, thread::hardware_concurrency()),
+                                   meshes.size());
+  if (num_threads == 0) return;
+
+  fprintf(stdout, "[Scotty3D] Building %zu meshes on %zu threads... ",
+          meshes.size(), num_threads);
+  fflush(stdout);
+  Timer timer;
+  timer.start();
+
+  WorkQueue<size_t> work;
+  for (size_t i = 0; i < meshes.size(); ++i) work.put_work(i);
+  auto build = [&]() {
+    size_t i;
+    while (work.try_get_work(&i)) {
+      Collada::Node &node = *meshes[i].second;
+      meshes[i].first->build(static_cast<PolymeshInfo &>(*node.instance),
+                             node.transform);
+    }
+  };
+  vector<thread> threads;
+  for (size_t t = 1; t < num_threads; ++t) threads.push_back(thread(build));
+  build();
+  for (thread &t : threads) t.join();
+
+  // the skeletons and their joints were made on the build threads, in no
+  // particular order
+  for (const auto &m : meshes) {
+    DynamicScene::Skeleton *skeleton = m.first->skeleton;
+    skeleton->renumber();
+    for (DynamicScene::Joint *joint : skeleton->joints) joint->renumber();
+  }
+
+  timer.stop();
+  fprintf(stdout, "Done! (%.4f sec)\n", timer.duration());
 }
 
 void Application::set_scroll_rate() {
@@ -723,6 +888,14 @@ void Application::char_event(unsigned int codepoint) {
         case ']':
           pathtracer->key_press(codepoint);
           break;
+        case 'n':
+        case 'N':
+          pathtracer->toggle_denoiser();
+          break;
+        case 'g':
+        case 'G':
+          pathtracer->cycle_tone_operator();
+          break;
       }
       break;
     case VISUALIZE_MODE:
@@ -1211,10 +1384,40 @@ void Application::keyboard_event(int key, int event, unsigned char mods) {
 
 void Application::writeScene(const char *filename) {
   cerr << "Writing scene to file " << filename << endl;
-  Collada::ColladaWriter::writeScene(*scene, filename);
+  if (SceneFile::is_scene_file(filename)) {
+    // skeletons go in the file itself
+    CameraInfo camera = cameraInfo;
+    camera.view_dir = cameraViewDir;
+    if (!SceneFile::write(filename, *scene, camera)) {
+      cerr << "Warning: could not write " << filename << endl;
+    }
+    return;
+  }
+
+  // the meshes are copied here, which is quick, and written as text on a
+  // background thread, which is not. Each write waits for the one before,
+  // so that saves to the same file are made in order and never at once.
+  auto meshes = std::make_shared<Collada::ColladaWriter::SceneSnapshot>();
+  Collada::ColladaWriter::snapshot(*scene, meshes.get());
+  string name(filename);
+  std::thread previous = std::move(writerThread);
+  writerThread = std::thread([meshes, name](std::thread previous) {
+    if (previous.joinable()) previous.join();
+    Timer timer;
+    timer.start();
+    if (Collada::ColladaWriter::writeScene(*meshes, name.c_str())) {
+      timer.stop();
+      fprintf(stderr, "[Scotty3D] Saved %s (%.4f sec)\n", name.c_str(),
+              timer.duration());
+    }
+  }, std::move(previous));
   writeSkeleton(filename, scene);
 }
 
+void Application::wait_for_writes() {
+  if (writerThread.joinable()) writerThread.join();
+}
+
 void CMU462::Application::writeSkeleton(const char *filename,
                                         const DynamicScene::Scene *scene) {
   string filenameNoExt(filename);
@@ -1233,10 +1436,24 @@ void CMU462::Application::writeSkeleton(const char *filename,
 
 void Application::loadScene(const char *filename) {
   cerr << "Loading scene from file " << filename << endl;
+  wait_for_writes();
 
   Camera originalCamera = camera;
   Camera originalCanonicalCamera = canonicalCamera;
 
+  if (SceneFile::is_scene_file(filename)) {
+    SceneFile *file = new SceneFile();
+    if (!file->load(filename)) {
+      cerr << "Warning: scene file failed to load." << endl;
+      delete file;
+      return;
+    }
+    load(file);
+    camera = originalCamera;
+    canonicalCamera = originalCanonicalCamera;
+    return;
+  }
+
   Collada::SceneInfo *sceneInfo = new Collada::SceneInfo();
   if (Collada::ColladaParser::load(filename, sceneInfo) < 0) {
     cerr << "Warning: scene file failed to load." << endl;
@@ -2212,9 +2429,43 @@ void Application::draw_action() {
   textManager.render();
 }
 
-void Application::render_scene(std::string saveFileLocation) {
+void Application::place_camera(const Vector3D &pos, const Vector3D &target) {
+  Vector3D dir = pos - target;
+  double r = dir.norm();
+  camera.place(target, acos(dir.y / r), atan2(dir.x, dir.z), r, r, r);
+}
 
-  set_up_pathtracer();
+void Application::set_render_size(size_t w, size_t h) {
+  screenW = w;
+  screenH = h;
+  camera.configure(cameraInfo, w, h);
+  canonicalCamera.configure(cameraInfo, w, h);
+}
+
+void Application::set_render_sample_count(size_t ns_aa) {
+  pathtracer->set_ns_aa(ns_aa);
+}
+
+bool Application::render_scene(std::string saveFileLocation,
+                               std::string aovFileLocation) {
+
+  // a scene that was rendered before keeps its BVH
+  if (pathtracer->has_scene()) {
+    pathtracer->set_frame_size(screenW, screenH);
+  } else {
+    set_up_pathtracer();
+  }
+
+  // long renders save their progress, and can go on from it after being
+  // interrupted
+  if (config.pathtracer_checkpoint_path != "") {
+    pathtracer->set_checkpoint(config.pathtracer_checkpoint_path,
+                               config.pathtracer_checkpoint_interval);
+    if (config.pathtracer_resume &&
+        !pathtracer->resume(config.pathtracer_checkpoint_path)) {
+      fprintf(stdout, "[Scotty3D] Rendering from the start\n");
+    }
+  }
   pathtracer->start_raytracing();
 
   auto is_done = [this]() {
@@ -2229,6 +2480,142 @@ void Application::render_scene(std::string saveFileLocation) {
   }
 
   pathtracer->save_image(saveFileLocation);
+  if (aovFileLocation != "") pathtracer->save_aovs(aovFileLocation);
+  return pathtracer->wait_for_writes();
+}
+
+const HDRImageBuffer &Application::render_tiles(
+    const std::vector<WorkItem> &tiles) {
+  if (pathtracer->has_scene()) {
+    pathtracer->set_frame_size(screenW, screenH);
+  } else {
+    set_up_pathtracer();
+  }
+  pathtracer->start_raytracing(tiles);
+
+  while (!pathtracer->is_done_headless()) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  }
+  return pathtracer->get_sample_buffer();
+}
+
+/**
+ * Path of a frame of an animation: the frame number is added before the
+ * extension, e.g. out.png becomes out_0007.png.
+ */
+static string frame_path(const string &path, int frame) {
+  char num[32];
+  sprintf(num, "_%04d", frame);
+  size_t dot = path.find_last_of('.');
+  size_t slash = path.find_last_of("/\\");
+  if (dot == string::npos || (slash != string::npos && dot < slash)) {
+    return path + num;
+  }
+  return path.substr(0, dot) + num + path.substr(dot);
+}
+
+bool Application::render_animation(int start_frame, int end_frame,
+                                   std::string saveFileLocation,
+                                   std::string aovFileLocation,
+                                   size_t num_concurrent) {
+  num_concurrent = std::max<size_t>(num_concurrent, 1);
+  size_t num_threads =
+      std::max<size_t>(config.pathtracer_num_threads / num_concurrent, 1);
+
+  // one path tracer more than render at once, so that the next frame can be
+  // set up while the others render
+  vector<PathTracer *> pool;
+  for (size_t i = 0; i < num_concurrent + 1; ++i) {
+    pool.push_back(new PathTracer(
+        config.pathtracer_ns_aa, config.pathtracer_max_ray_depth,
+        config.pathtracer_ns_area_light, config.pathtracer_ns_diff,
+        config.pathtracer_ns_glsy, config.pathtracer_ns_refr, num_threads,
+        config.pathtracer_envmap, config.pathtracer_wavefront,
+        config.pathtracer_denoise, config.pathtracer_aovs,
+        config.pathtracer_exr_half, config.pathtracer_tone_operator));
+  }
+
+  std::mutex lock;
+  std::condition_variable changed;
+  std::deque<PathTracer *> idle(pool.begin(), pool.end());
+  std::deque<std::pair<int, PathTracer *> > ready;
+  bool written = true;  // only the setup thread sets it until joined
+
+  // Frames are set up in order on a single thread, since posing the scene
+  // moves the vertices of the dynamic meshes for a moment.
+  std::thread setup([&]() {
+    for (int frame = start_frame; frame <= end_frame; ++frame) {
+      PathTracer *pt;
+      {
+        std::unique_lock<std::mutex> guard(lock);
+        changed.wait(guard, [&]() { return !idle.empty(); });
+        pt = idle.front();
+        idle.pop_front();
+      }
+
+      if (!pt->wait_for_writes()) written = false;
+      pt->stop();
+      pt->clear();
+      pt->set_camera(&camera);
+      pt->set_scene(scene->get_transformed_static_scene(frame));
+      pt->set_frame_size(screenW, screenH);
+
+      std::lock_guard<std::mutex> guard(lock);
+      ready.push_back(std::make_pair(frame, pt));
+    }
+  });
+
+  Timer timer;
+  timer.start();
+  int num_frames = end_frame - start_frame + 1;
+  int num_done = 0;
+  vector<std::pair<int, PathTracer *> > rendering;
+  while (num_done < num_frames) {
+    while (rendering.size() < num_concurrent) {
+      std::unique_lock<std::mutex> guard(lock);
+      if (ready.empty()) break;
+      rendering.push_back(ready.front());
+      ready.pop_front();
+      guard.unlock();
+      rendering.back().second->start_raytracing();
+    }
+
+    for (size_t i = 0; i < rendering.size();) {
+      int frame = rendering[i].first;
+      PathTracer *pt = rendering[i].second;
+      if (!pt->is_done_headless()) {
+        ++i;
+        continue;
+      }
+
+      // the files are written in the background while the path tracer
+      // moves on to the next frame
+      pt->save_image(frame_path(saveFileLocation, frame));
+      if (aovFileLocation != "") {
+        pt->save_aovs(frame_path(aovFileLocation, frame));
+      }
+      fprintf(stdout, "[Scotty3D] Frame %d done (%d of %d)\n", frame,
+              ++num_done, num_frames);
+
+      rendering.erase(rendering.begin() + i);
+      {
+        std::lock_guard<std::mutex> guard(lock);
+        idle.push_back(pt);
+      }
+      changed.notify_one();
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  }
+
+  setup.join();
+  for (PathTracer *pt : pool) {
+    if (!pt->wait_for_writes()) written = false;
+    delete pt;
+  }
+  timer.stop();
+  fprintf(stdout, "[Scotty3D] Rendered %d frames (%.4f sec)\n", num_frames,
+          timer.duration());
+  return written;
 }
 
 }  // namespace CMU462
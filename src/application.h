@@ -7,6 +7,7 @@
 #include <sstream>
 #include <algorithm>
 #include <string>
+#include <thread>
 #include <vector>
 
 // libCMU462
@@ -30,6 +31,7 @@
 // PathTracer
 #include "static_scene/scene.h"
 #include "pathtracer.h"
+#include "scene_file.h"
 #include "image.h"
 
 // Animator
@@ -55,6 +57,15 @@ struct AppConfig {
     pathtracer_num_threads = 1;
     pathtracer_envmap = NULL;
     pathtracer_result_path = "";
+    pathtracer_wavefront = false;
+    pathtracer_denoise = false;
+    pathtracer_aov_path = "";
+    pathtracer_aovs = AOV_NONE;
+    pathtracer_exr_half = false;
+    pathtracer_tone_operator = TONEMAP_NONE;
+    pathtracer_checkpoint_path = "";
+    pathtracer_checkpoint_interval = 60;
+    pathtracer_resume = false;
   }
 
   size_t pathtracer_ns_aa;
@@ -64,10 +75,19 @@ struct AppConfig {
   size_t pathtracer_ns_glsy;
   size_t pathtracer_ns_refr;
   size_t pathtracer_num_threads;
-  HDRImageBuffer* pathtracer_envmap;
+  EnvironmentMap* pathtracer_envmap;
   std::string pathtracer_result_path;
   size_t pathtracer_result_width = 800;
   size_t pathtracer_result_height = 600;
+  bool pathtracer_wavefront;
+  bool pathtracer_denoise;
+  std::string pathtracer_aov_path;
+  int pathtracer_aovs;
+  bool pathtracer_exr_half;
+  ToneOperator pathtracer_tone_operator;
+  std::string pathtracer_checkpoint_path;
+  double pathtracer_checkpoint_interval;
+  bool pathtracer_resume;
 };
 
 class Application : public Renderer {
@@ -90,13 +110,57 @@ class Application : public Renderer {
   void char_event(unsigned int codepoint);
 
   void load(Collada::SceneInfo* sceneInfo);
+
+  // Load a binary scene file, which the application keeps and frees. Scenes
+  // that are not editable are only rendered; their meshes are used as the
+  // file stores them, without building halfedge meshes.
+  void load(SceneFile* sceneFile, bool editable = true);
+
+  // Write the scene to a file, in the binary format if the name ends in .s3d
+  // and as COLLADA otherwise. COLLADA files are written on a background
+  // thread from a copy of the meshes, so editing can go on right away.
   void writeScene(const char* filename);
+
+  // Wait for the scene files being written in the background.
+  void wait_for_writes();
   void loadScene(const char* filename);
 
   void writeSkeleton(const char* filename, const DynamicScene::Scene* scene);
   void loadSkeleton(const char* filename, DynamicScene::Scene* scene);
 
-  void render_scene(std::string saveFileLocation);
+  // Render the scene without GUI and save the result, returning false if a
+  // file could not be written.
+  bool render_scene(std::string saveFileLocation,
+                    std::string aovFileLocation = "");
+
+  // Settings of the next headless render. The view is fit to the size as
+  // the scene file's camera is when loading. Without a placement the camera
+  // is where the scene file puts it.
+  void set_render_size(size_t w, size_t h);
+  void place_camera(const Vector3D& pos, const Vector3D& target);
+  void restore_camera() { reset_camera(); }
+  void set_render_sample_count(size_t ns_aa);
+
+  // Convert the scene for rendering as a render would, without rendering.
+  void build_static_scene() { scene->get_static_scene(); }
+
+  // Load the skeletons and keyframes saved next to a scene file.
+  void load_animation(const char* filename) { loadSkeleton(filename, scene); }
+
+  // Render frames start to end of the animation without a window, saving
+  // each to the given paths with the frame number added before the
+  // extension. The scene and BVH of the next frame are built while the
+  // current frames render, and num_concurrent frames render at once, each
+  // on a share of the render threads. Returns false if the files of some
+  // frame could not be written.
+  bool render_animation(int start_frame, int end_frame,
+                        std::string saveFileLocation,
+                        std::string aovFileLocation = "",
+                        size_t num_concurrent = 1);
+
+  // Render some tiles of the image without a window, for a distributed
+  // render. Only the given tiles of the returned radiance are rendered.
+  const HDRImageBuffer& render_tiles(const std::vector<WorkItem>& tiles);
 
   // Avoids spinning up an OpenGL context during initialization.
   // This useful because it avoid issues with OpenGL when SSH'ed, so users
@@ -153,12 +217,18 @@ class Application : public Renderer {
 
   DynamicScene::Scene* scene;
   PathTracer* pathtracer;
+  AppConfig config;  // settings of path tracers made for animations
 
   // View Frustrum Variables.
   // On resize, the aspect ratio is changed. On reset_camera, the position and
   // orientation are reset but NOT the aspect ratio.
   Camera camera;
   Camera canonicalCamera;
+  Collada::CameraInfo cameraInfo;  // fits the view to a new render size
+  Vector3D cameraViewDir;          // world-space view of the scene camera
+  SceneFile* sceneFile;            // binary scene file the scene came from
+  std::thread writerThread;  // writes COLLADA files, each save waiting
+                             // for the one before
 
   size_t screenW;
   size_t screenH;
@@ -199,9 +269,15 @@ class Application : public Renderer {
                                        const Matrix4x4& transform);
   DynamicScene::SceneObject* init_sphere(Collada::SphereInfo& polymesh,
                                          const Matrix4x4& transform);
-  DynamicScene::SceneObject* init_polymesh(Collada::PolymeshInfo& polymesh,
-                                           const Matrix4x4& transform);
+  DynamicScene::SceneObject* init_polymesh(
+      Collada::Node& node,
+      vector<pair<DynamicScene::Mesh*, Collada::Node*>>* meshes);
+  void build_meshes(
+      const vector<pair<DynamicScene::Mesh*, Collada::Node*>>& meshes);
   void init_material(Collada::MaterialInfo& material);
+  void init_scene(const vector<DynamicScene::SceneObject*>& objects,
+                  vector<DynamicScene::SceneLight*>& lights,
+                  const Vector3D& view_dir);
 
   void set_scroll_rate();
 
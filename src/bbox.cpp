@@ -8,12 +8,22 @@
 namespace CMU462 {
 
 bool BBox::intersect(const Ray &r, double &t0, double &t1) const {
-  // TODO (PathTracer):
-  // Implement ray - bounding box intersection test
-  // If the ray intersected the bounding box within the range given by
-  // t0, t1, update t0 and t1 with the new intersection times.
+  // Slab test. If the ray intersected the bounding box within the range
+  // given by t0, t1, update t0 and t1 with the new intersection times.
+  double tx0 = ((r.sign[0] ? max.x : min.x) - r.o.x) * r.inv_d.x;
+  double tx1 = ((r.sign[0] ? min.x : max.x) - r.o.x) * r.inv_d.x;
+  double ty0 = ((r.sign[1] ? max.y : min.y) - r.o.y) * r.inv_d.y;
+  double ty1 = ((r.sign[1] ? min.y : max.y) - r.o.y) * r.inv_d.y;
+  double tz0 = ((r.sign[2] ? max.z : min.z) - r.o.z) * r.inv_d.z;
+  double tz1 = ((r.sign[2] ? min.z : max.z) - r.o.z) * r.inv_d.z;
 
-  return false;
+  double tmin = std::max(std::max(tx0, ty0), std::max(tz0, t0));
+  double tmax = std::min(std::min(tx1, ty1), std::min(tz1, t1));
+  if (tmin > tmax) return false;
+
+  t0 = tmin;
+  t1 = tmax;
+  return true;
 }
 
 void BBox::draw(Color c) const {
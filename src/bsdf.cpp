@@ -1,7 +1,9 @@
 #include "bsdf.h"
+#include "rng.h"
 
 #include <algorithm>
 #include <iostream>
+#include <new>
 #include <utility>
 
 
@@ -39,9 +41,13 @@ Spectrum DiffuseBSDF::f(const Vector3D& wo, const Vector3D& wi) {
 }
 
 Spectrum DiffuseBSDF::sample_f(const Vector3D& wo, Vector3D* wi, float* pdf) {
-  // TODO (PathTracer):
-  // Implement DiffuseBSDF
-  return Spectrum();
+  *wi = sampler.get_sample(pdf);
+  return f(wo, *wi);
+}
+
+float DiffuseBSDF::pdf(const Vector3D& wo, const Vector3D& wi) {
+  // matches the cosine-weighted hemisphere sampler used by sample_f
+  return wi.z > 0 ? wi.z / PI : 0.f;
 }
 
 // Mirror BSDF //
@@ -51,23 +57,94 @@ Spectrum MirrorBSDF::f(const Vector3D& wo, const Vector3D& wi) {
 }
 
 Spectrum MirrorBSDF::sample_f(const Vector3D& wo, Vector3D* wi, float* pdf) {
-  // TODO (PathTracer):
-  // Implement MirrorBSDF
-  return Spectrum();
+  // the only direction scattered into wo is its reflection; the delta
+  // distribution is expressed by dividing out the cosine the caller applies
+  reflect(wo, wi);
+  *pdf = 1.f;
+  return reflectance * (1.0 / abs_cos_theta(*wi));
 }
 
+float MirrorBSDF::pdf(const Vector3D& wo, const Vector3D& wi) { return 0.f; }
+
 // Glossy BSDF //
 
-/*
+double GlossyBSDF::D(const Vector3D& h) const {
+  if (h.z <= 0) return 0;
+  double a2 = alpha * alpha;
+  double d = h.z * h.z * (a2 - 1) + 1;
+  return a2 / (PI * d * d);
+}
+
+double GlossyBSDF::Lambda(const Vector3D& w) const {
+  double cos2 = w.z * w.z;
+  if (cos2 == 0) return INF_D;
+  double tan2 = std::max(0.0, 1.0 - cos2) / cos2;
+  return 0.5 * (sqrt(1.0 + alpha * alpha * tan2) - 1.0);
+}
+
 Spectrum GlossyBSDF::f(const Vector3D& wo, const Vector3D& wi) {
-  return Spectrum();
+  if (wo.z <= 0 || wi.z <= 0) return Spectrum();
+
+  Vector3D h = wo + wi;
+  h.normalize();
+
+  // Schlick's approximation, with the reflectance as the normal incidence
+  // value of the Fresnel term
+  double c = 1.0 - clamp(dot(wi, h), 0.0, 1.0);
+  double c5 = (c * c) * (c * c) * c;
+  Spectrum F = reflectance * (1.0 - c5) + Spectrum(c5, c5, c5);
+
+  double G = 1.0 / (1.0 + Lambda(wo) + Lambda(wi));
+  return F * (D(h) * G / (4.0 * wo.z * wi.z));
 }
 
 Spectrum GlossyBSDF::sample_f(const Vector3D& wo, Vector3D* wi, float* pdf) {
-  *pdf = 1.0f;
-  return reflect(wo, wi, reflectance);
+  *pdf = 0.f;
+  if (wo.z <= 0) return Spectrum();
+
+  // Sample the visible normals (Heitz 2018): stretch wo into the
+  // configuration where the microsurface is a hemisphere of unit roughness,
+  // sample the projected area of the hemisphere seen from there, and
+  // unstretch the sampled normal.
+  Vector3D v = Vector3D(alpha * wo.x, alpha * wo.y, wo.z);
+  v.normalize();
+
+  double len2 = v.x * v.x + v.y * v.y;
+  Vector3D t1 = len2 > 0 ? Vector3D(-v.y, v.x, 0) / sqrt(len2)
+                         : Vector3D(1, 0, 0);
+  Vector3D t2 = cross(v, t1);
+
+  Vector2D u = sampler.get_sample();
+  double r = sqrt(u.x);
+  double phi = 2.0 * PI * u.y;
+  double p1 = r * cos(phi);
+  double p2 = r * sin(phi);
+  double s = 0.5 * (1.0 + v.z);
+  p2 = (1.0 - s) * sqrt(std::max(0.0, 1.0 - p1 * p1)) + s * p2;
+
+  Vector3D n = p1 * t1 + p2 * t2 +
+               sqrt(std::max(0.0, 1.0 - p1 * p1 - p2 * p2)) * v;
+  Vector3D h = Vector3D(alpha * n.x, alpha * n.y, std::max(0.0, n.z));
+  h.normalize();
+
+  *wi = 2.0 * dot(wo, h) * h - wo;
+  if (wi->z <= 0) return Spectrum();
+
+  *pdf = this->pdf(wo, *wi);
+  return f(wo, *wi);
+}
+
+float GlossyBSDF::pdf(const Vector3D& wo, const Vector3D& wi) {
+  if (wo.z <= 0 || wi.z <= 0) return 0.f;
+
+  Vector3D h = wo + wi;
+  h.normalize();
+
+  // density of the visible normals, D_wo(h) = G1(wo) D(h) dot(wo,h) / wo.z,
+  // times the Jacobian 1 / (4 dot(wo,h)) of the reflection about h
+  double G1 = 1.0 / (1.0 + Lambda(wo));
+  return G1 * D(h) / (4.0 * wo.z);
 }
-*/
 
 // Refraction BSDF //
 
@@ -77,9 +154,21 @@ Spectrum RefractionBSDF::f(const Vector3D& wo, const Vector3D& wi) {
 
 Spectrum RefractionBSDF::sample_f(const Vector3D& wo, Vector3D* wi,
                                   float* pdf) {
-  // TODO (PathTracer):
-  // Implement RefractionBSDF
-  return Spectrum();
+  *pdf = 1.f;
+
+  // light that cannot leave the surface is totally internally reflected
+  if (!refract(wo, wi, ior)) {
+    reflect(wo, wi);
+    return transmittance * (1.0 / abs_cos_theta(*wi));
+  }
+
+  // radiance is compressed into a smaller solid angle on the dense side
+  double eta = wo.z > 0 ? 1.0 / ior : ior;
+  return transmittance * (eta * eta / abs_cos_theta(*wi));
+}
+
+float RefractionBSDF::pdf(const Vector3D& wo, const Vector3D& wi) {
+  return 0.f;
 }
 
 // Glass BSDF //
@@ -89,25 +178,111 @@ Spectrum GlassBSDF::f(const Vector3D& wo, const Vector3D& wi) {
 }
 
 Spectrum GlassBSDF::sample_f(const Vector3D& wo, Vector3D* wi, float* pdf) {
-  // TODO (PathTracer):
-  // Compute Fresnel coefficient and either reflect or refract based on it.
+  // total internal reflection
+  if (!refract(wo, wi, ior)) {
+    reflect(wo, wi);
+    *pdf = 1.f;
+    return reflectance * (1.0 / abs_cos_theta(*wi));
+  }
 
-  return Spectrum();
+  // Fresnel reflectance of an unpolarized dielectric interface
+  double eta_i = wo.z > 0 ? 1.0 : ior;
+  double eta_t = wo.z > 0 ? ior : 1.0;
+  double cos_i = abs_cos_theta(wo);
+  double cos_t = abs_cos_theta(*wi);
+  double r_par =
+      (eta_t * cos_i - eta_i * cos_t) / (eta_t * cos_i + eta_i * cos_t);
+  double r_perp =
+      (eta_i * cos_i - eta_t * cos_t) / (eta_i * cos_i + eta_t * cos_t);
+  double F = 0.5 * (r_par * r_par + r_perp * r_perp);
+
+  // Pick reflection or refraction with probability given by the Fresnel
+  // term, so the Fresnel weight cancels with the pdf and every path carries
+  // the full reflectance or transmittance.
+  if (random_uniform() < F) {
+    reflect(wo, wi);
+    *pdf = F;
+    return reflectance * (F / abs_cos_theta(*wi));
+  }
+
+  double eta = eta_i / eta_t;
+  *pdf = 1.0 - F;
+  return transmittance * ((1.0 - F) * eta * eta / cos_t);
+}
+
+float GlassBSDF::pdf(const Vector3D& wo, const Vector3D& wi) { return 0.f; }
+
+/**
+ * Make a BSDF with new, or in place if storage is not NULL.
+ */
+template <typename T, typename... Args>
+static BSDF* construct(void* storage, Args&&... args) {
+  if (storage) return new (storage) T(std::forward<Args>(args)...);
+  return new T(std::forward<Args>(args)...);
+}
+
+BSDF* BSDF::make(const BSDFParameters& p) { return make(p, NULL); }
+
+BSDF* BSDF::make(const BSDFParameters& p, void* storage) {
+  BSDF* bsdf;
+  switch (p.type) {
+    case DIFFUSE_BSDF:
+      bsdf = construct<DiffuseBSDF>(storage, p.color);
+      break;
+    case MIRROR_BSDF:
+      bsdf = construct<MirrorBSDF>(storage, p.color);
+      break;
+    case GLOSSY_BSDF:
+      bsdf = construct<GlossyBSDF>(storage, p.color, p.roughness);
+      break;
+    case REFRACTION_BSDF:
+      bsdf = construct<RefractionBSDF>(storage, p.color, p.roughness, p.ior);
+      break;
+    case GLASS_BSDF:
+      bsdf = construct<GlassBSDF>(storage, p.color, p.reflectance,
+                                  p.roughness, p.ior);
+      break;
+    case EMISSION_BSDF:
+      bsdf = construct<EmissionBSDF>(storage, p.color);
+      break;
+    default:
+      return NULL;
+  }
+  bsdf->color_texture = p.color_texture;
+  bsdf->roughness_texture = p.roughness_texture;
+  return bsdf;
+}
+
+BSDF* BSDF::make_at(const Vector2D& uv, void* storage) const {
+  BSDFParameters p = get_parameters();
+  if (color_texture) p.color *= color_texture->lookup(uv);
+  if (roughness_texture) {
+    // the texture is read as grey, whatever its channels
+    Spectrum r = roughness_texture->lookup(uv);
+    p.roughness *= (r.r + r.g + r.b) / 3;
+  }
+  p.color_texture = NULL;
+  p.roughness_texture = NULL;
+  return make(p, storage);
 }
 
 void BSDF::reflect(const Vector3D& wo, Vector3D* wi) {
-  // TODO (PathTracer):
-  // Implement reflection of wo about normal (0,0,1) and store result in wi.
+  *wi = Vector3D(-wo.x, -wo.y, wo.z);
 }
 
 bool BSDF::refract(const Vector3D& wo, Vector3D* wi, float ior) {
-  // TODO (PathTracer):
   // Use Snell's Law to refract wo surface and store result ray in wi.
   // Return false if refraction does not occur due to total internal reflection
   // and true otherwise. When dot(wo,n) is positive, then wo corresponds to a
   // ray entering the surface through vacuum.
+  bool entering = wo.z > 0;
+  double eta = entering ? 1.0 / ior : ior;
 
+  double sin2_t = eta * eta * sin_theta2(wo);
+  if (sin2_t >= 1.0) return false;
 
+  double cos_t = sqrt(1.0 - sin2_t);
+  *wi = Vector3D(-eta * wo.x, -eta * wo.y, entering ? -cos_t : cos_t);
   return true;
 }
 
@@ -122,4 +297,8 @@ Spectrum EmissionBSDF::sample_f(const Vector3D& wo, Vector3D* wi, float* pdf) {
   return Spectrum();
 }
 
+float EmissionBSDF::pdf(const Vector3D& wo, const Vector3D& wi) {
+  return wi.z > 0 ? wi.z / PI : 0.f;
+}
+
 }  // namespace CMU462
@@ -7,8 +7,10 @@
 #include "CMU462/matrix3x3.h"
 
 #include "sampler.h"
+#include "texture.h"
 
 #include <algorithm>
+#include <type_traits>
 
 namespace CMU462 {
 
@@ -42,11 +44,55 @@ inline double sin_phi(const Vector3D& w) {
 
 void make_coord_space(Matrix3x3& o2w, const Vector3D& n);
 
+/**
+ * The concrete BSDF classes. The wavefront integrator sorts hits into one
+ * queue per type and shades each queue with code specialized for that
+ * class, so it never has to dispatch on the BSDF per hit.
+ */
+enum BSDFType {
+  DIFFUSE_BSDF,
+  MIRROR_BSDF,
+  GLOSSY_BSDF,
+  REFRACTION_BSDF,
+  GLASS_BSDF,
+  EMISSION_BSDF,
+  NUM_BSDF_TYPES
+};
+
+/**
+ * The parameters a BSDF is made from, enough to make it again. Spectra and
+ * numbers a class does not use are left at zero.
+ */
+struct BSDFParameters {
+  BSDFParameters()
+      : type(DIFFUSE_BSDF),
+        roughness(0),
+        ior(0),
+        color_texture(NULL),
+        roughness_texture(NULL) {}
+
+  BSDFType type;         ///< concrete class of the BSDF
+  Spectrum color;        ///< albedo, reflectance, transmittance or radiance
+  Spectrum reflectance;  ///< reflectance of glass
+  float roughness;       ///< roughness of glossy, refractive and glass BSDFs
+  float ior;             ///< index of refraction
+
+  const Texture* color_texture;      ///< scales the color, NULL for none
+  const Texture* roughness_texture;  ///< scales the roughness, NULL for none
+};
+
 /**
  * Interface for BSDFs.
+ * The concrete BSDFs are final, so that a call made through a pointer to a
+ * concrete class is resolved statically and can be inlined.
  */
 class BSDF {
  public:
+  BSDF(BSDFType type)
+      : color_texture(NULL), roughness_texture(NULL), type(type) {}
+
+  virtual ~BSDF() {}
+
   /**
    * Evaluate BSDF.
    * Given incident light direction wi and outgoing light direction wo. Note
@@ -71,6 +117,20 @@ class BSDF {
    */
   virtual Spectrum sample_f(const Vector3D& wo, Vector3D* wi, float* pdf) = 0;
 
+  /**
+   * Evaluate the pdf of sample_f.
+   * Given the outgoing light direction wo, return the probability density
+   * (with respect to solid angle) with which sample_f would have produced
+   * the incident direction wi. This is what lets BSDF samples be combined
+   * with light samples by multiple importance sampling. Delta distributions
+   * always return zero, since another strategy can never produce their
+   * single scattering direction.
+   * \param wo outgoing light direction in local space of point of intersection
+   * \param wi incident light direction in local space of point of intersection
+   * \return pdf of sampling wi given wo
+   */
+  virtual float pdf(const Vector3D& wo, const Vector3D& wi) = 0;
+
   /**
    * Get the emission value of the surface material. For non-emitting surfaces
    * this would be a zero energy spectrum.
@@ -87,6 +147,39 @@ class BSDF {
    */
   virtual bool is_delta() const = 0;
 
+  /**
+   * Get the parameters the BSDF was made from, for saving it.
+   */
+  virtual BSDFParameters get_parameters() const = 0;
+
+  /**
+   * Make a BSDF from its parameters.
+   * \param parameters parameters from get_parameters
+   * \return new BSDF, NULL if the type is not a BSDF type
+   */
+  static BSDF* make(const BSDFParameters& parameters);
+
+  /**
+   * Make a BSDF from its parameters in the given storage.
+   * \param parameters parameters from get_parameters
+   * \param storage room for a BSDF of any class, see BSDFStorage
+   * \return the BSDF, NULL if the type is not a BSDF type
+   */
+  static BSDF* make(const BSDFParameters& parameters, void* storage);
+
+  /**
+   * The BSDF at a point of the surface, with its textures looked up at the
+   * texture coordinates of the point. A BSDF without textures is the same
+   * at every point and is returned itself; otherwise a BSDF of the same class
+   * is made in the given storage, and is not to be deleted.
+   * \param uv texture coordinates of the point
+   * \param storage room for a BSDF of any class, see BSDFStorage
+   */
+  BSDF* at(const Vector2D& uv, void* storage) {
+    if (!color_texture && !roughness_texture) return this;
+    return make_at(uv, storage);
+  }
+
   /**
    * Reflection helper
    */
@@ -98,19 +191,50 @@ class BSDF {
   virtual bool refract(const Vector3D& wo, Vector3D* wi, float ior);
 
   Spectrum rasterize_color;
+
+  const Texture* color_texture;      ///< scales the color, NULL for none
+  const Texture* roughness_texture;  ///< scales the roughness, NULL for none
+
+  const BSDFType type;  ///< concrete class of the BSDF
+
+ protected:
+  /**
+   * The parameters all classes share, for get_parameters to add to.
+   */
+  BSDFParameters base_parameters() const {
+    BSDFParameters p;
+    p.type = type;
+    p.color_texture = color_texture;
+    p.roughness_texture = roughness_texture;
+    return p;
+  }
+
+ private:
+  /**
+   * The textured BSDF at a point, see at.
+   */
+  BSDF* make_at(const Vector2D& uv, void* storage) const;
 };  // class BSDF
 
 /**
  * Diffuse BSDF.
  */
-class DiffuseBSDF : public BSDF {
+class DiffuseBSDF final : public BSDF {
  public:
-  DiffuseBSDF(const Spectrum& a) : albedo(a) { rasterize_color = a; }
+  DiffuseBSDF(const Spectrum& a) : BSDF(DIFFUSE_BSDF), albedo(a) {
+    rasterize_color = a;
+  }
 
   Spectrum f(const Vector3D& wo, const Vector3D& wi);
   Spectrum sample_f(const Vector3D& wo, Vector3D* wi, float* pdf);
+  float pdf(const Vector3D& wo, const Vector3D& wi);
   Spectrum get_emission() const { return Spectrum(); }
   bool is_delta() const { return false; }
+  BSDFParameters get_parameters() const {
+    BSDFParameters p = base_parameters();
+    p.color = albedo;
+    return p;
+  }
 
  private:
   Spectrum albedo;
@@ -121,16 +245,23 @@ class DiffuseBSDF : public BSDF {
 /**
  * Mirror BSDF
  */
-class MirrorBSDF : public BSDF {
+class MirrorBSDF final : public BSDF {
  public:
-  MirrorBSDF(const Spectrum& reflectance) : reflectance(reflectance) {
+  MirrorBSDF(const Spectrum& reflectance)
+      : BSDF(MIRROR_BSDF), reflectance(reflectance) {
     rasterize_color = reflectance;
   }
 
   Spectrum f(const Vector3D& wo, const Vector3D& wi);
   Spectrum sample_f(const Vector3D& wo, Vector3D* wi, float* pdf);
+  float pdf(const Vector3D& wo, const Vector3D& wi);
   Spectrum get_emission() const { return Spectrum(); }
   bool is_delta() const { return true; }
+  BSDFParameters get_parameters() const {
+    BSDFParameters p = base_parameters();
+    p.color = reflectance;
+    return p;
+  }
 
  private:
   float roughness;
@@ -140,40 +271,77 @@ class MirrorBSDF : public BSDF {
 
 /**
  * Glossy BSDF.
+ * A microfacet reflection model with the GGX (Trowbridge-Reitz) normal
+ * distribution, the Smith height-correlated shadowing-masking term and a
+ * Schlick Fresnel term whose normal incidence value is the reflectance.
+ * The roughness is used directly as the GGX alpha. Directions are sampled
+ * from the distribution of normals visible from wo, which never produces
+ * directions below the surface for a shading normal facing wo and keeps
+ * the sample weight close to the Fresnel term.
  */
-/*
-class GlossyBSDF : public BSDF {
-public:
+class GlossyBSDF final : public BSDF {
+ public:
+  GlossyBSDF(const Spectrum& reflectance, float roughness)
+      : BSDF(GLOSSY_BSDF),
+        reflectance(reflectance),
+        alpha(clamp(roughness, 1e-3, 1.0)) {
+    rasterize_color = reflectance;
+  }
 
-GlossyBSDF(const Spectrum& reflectance, float roughness)
-: reflectance(reflectance), roughness(roughness) { }
+  Spectrum f(const Vector3D& wo, const Vector3D& wi);
+  Spectrum sample_f(const Vector3D& wo, Vector3D* wi, float* pdf);
+  float pdf(const Vector3D& wo, const Vector3D& wi);
+  Spectrum get_emission() const { return Spectrum(); }
+  bool is_delta() const { return false; }
+  BSDFParameters get_parameters() const {
+    BSDFParameters p = base_parameters();
+    p.color = reflectance;
+    p.roughness = alpha;
+    return p;
+  }
 
-Spectrum f(const Vector3D& wo, const Vector3D& wi);
-Spectrum sample_f(const Vector3D& wo, Vector3D* wi, float* pdf);
-Spectrum get_emission() const { return Spectrum(); }
-bool is_delta() const { return false; }
+ private:
+  /**
+   * GGX distribution of microfacet normals h.
+   */
+  double D(const Vector3D& h) const;
 
-private:
+  /**
+   * Smith auxiliary function for the masking of direction w.
+   */
+  double Lambda(const Vector3D& w) const;
 
-float roughness;
-Spectrum reflectance;
+  Spectrum reflectance;
+  double alpha;
+  UniformGridSampler2D sampler;
 
-}; // class GlossyBSDF*/
+};  // class GlossyBSDF
 
 /**
  * Refraction BSDF.
  */
-class RefractionBSDF : public BSDF {
+class RefractionBSDF final : public BSDF {
  public:
   RefractionBSDF(const Spectrum& transmittance, float roughness, float ior)
-      : transmittance(transmittance), roughness(roughness), ior(ior) {
+      : BSDF(REFRACTION_BSDF),
+        ior(ior),
+        roughness(roughness),
+        transmittance(transmittance) {
     rasterize_color = transmittance;
   }
 
   Spectrum f(const Vector3D& wo, const Vector3D& wi);
   Spectrum sample_f(const Vector3D& wo, Vector3D* wi, float* pdf);
+  float pdf(const Vector3D& wo, const Vector3D& wi);
   Spectrum get_emission() const { return Spectrum(); }
   bool is_delta() const { return true; }
+  BSDFParameters get_parameters() const {
+    BSDFParameters p = base_parameters();
+    p.color = transmittance;
+    p.roughness = roughness;
+    p.ior = ior;
+    return p;
+  }
 
  private:
   float ior;
@@ -185,21 +353,31 @@ class RefractionBSDF : public BSDF {
 /**
  * Glass BSDF.
  */
-class GlassBSDF : public BSDF {
+class GlassBSDF final : public BSDF {
  public:
   GlassBSDF(const Spectrum& transmittance, const Spectrum& reflectance,
             float roughness, float ior)
-      : transmittance(transmittance),
-        reflectance(reflectance),
+      : BSDF(GLASS_BSDF),
+        ior(ior),
         roughness(roughness),
-        ior(ior) {
+        reflectance(reflectance),
+        transmittance(transmittance) {
     rasterize_color = transmittance;
   }
 
   Spectrum f(const Vector3D& wo, const Vector3D& wi);
   Spectrum sample_f(const Vector3D& wo, Vector3D* wi, float* pdf);
+  float pdf(const Vector3D& wo, const Vector3D& wi);
   Spectrum get_emission() const { return Spectrum(); }
   bool is_delta() const { return true; }
+  BSDFParameters get_parameters() const {
+    BSDFParameters p = base_parameters();
+    p.color = transmittance;
+    p.reflectance = reflectance;
+    p.roughness = roughness;
+    p.ior = ior;
+    return p;
+  }
 
  private:
   float ior;
@@ -212,14 +390,21 @@ class GlassBSDF : public BSDF {
 /**
  * Emission BSDF.
  */
-class EmissionBSDF : public BSDF {
+class EmissionBSDF final : public BSDF {
  public:
-  EmissionBSDF(const Spectrum& radiance) : radiance(radiance) {}
+  EmissionBSDF(const Spectrum& radiance)
+      : BSDF(EMISSION_BSDF), radiance(radiance) {}
 
   Spectrum f(const Vector3D& wo, const Vector3D& wi);
   Spectrum sample_f(const Vector3D& wo, Vector3D* wi, float* pdf);
+  float pdf(const Vector3D& wo, const Vector3D& wi);
   Spectrum get_emission() const { return radiance; }
   bool is_delta() const { return false; }
+  BSDFParameters get_parameters() const {
+    BSDFParameters p = base_parameters();
+    p.color = radiance;
+    return p;
+  }
 
  private:
   Spectrum radiance;
@@ -227,6 +412,14 @@ class EmissionBSDF : public BSDF {
 
 };  // class EmissionBSDF
 
+/**
+ * Room for a BSDF of any class, for making the BSDF at a point of a textured
+ * surface without allocating.
+ */
+typedef std::aligned_union<0, DiffuseBSDF, MirrorBSDF, GlossyBSDF,
+                           RefractionBSDF, GlassBSDF, EmissionBSDF>::type
+    BSDFStorage;
+
 }  // namespace CMU462
 
 #endif  // CMU462_STATICSCENE_BSDF_H
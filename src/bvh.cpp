@@ -33,7 +33,9 @@ BVHAccel::BVHAccel(const std::vector<Primitive *> &_primitives,
 
 BVHAccel::~BVHAccel() {
   // TODO (PathTracer):
-  // Implement a proper destructor for your BVH accelerator aggregate
+  // Implement a proper destructor for your BVH accelerator aggregate.
+  // The triangles of a mesh are kept in the mesh, which deletes them, so
+  // they must not be deleted here.
 
 }
 
@@ -69,5 +71,77 @@ bool BVHAccel::intersect(const Ray &ray, Intersection *isect) const {
   return hit;
 }
 
+/**
+ * Walks a stream of rays through the tree rooted at root, calling
+ * leaf(primitive, i) for every primitive that ray i reaches. Each stack
+ * entry refers to the range of the scratch buffer holding the rays that
+ * reached the entry's parent. They are filtered against the node's box only
+ * when the node is popped, so the box test sees the closest hit found so
+ * far. Rays for which done(i) holds are dropped from the stream.
+ */
+template <typename LeafFn, typename DoneFn>
+static void traverse_stream(const BVHNode *root,
+                            const vector<Primitive *> &primitives,
+                            const vector<Ray> &rays,
+                            const vector<size_t> &stream, LeafFn leaf,
+                            DoneFn done) {
+  struct StackEntry {
+    const BVHNode *node;
+    size_t begin, end;
+  };
+
+  vector<size_t> scratch(stream);
+  vector<StackEntry> stack;
+  stack.push_back({root, 0, scratch.size()});
+
+  while (!stack.empty()) {
+    StackEntry e = stack.back();
+    stack.pop_back();
+
+    // Every entry left on the stack refers to a range ending at or before
+    // e.end, so anything past it is no longer needed.
+    scratch.resize(e.end);
+
+    size_t begin = scratch.size();
+    for (size_t k = e.begin; k < e.end; ++k) {
+      size_t i = scratch[k];
+      if (done(i)) continue;
+      double t0 = rays[i].min_t, t1 = rays[i].max_t;
+      if (e.node->bb.intersect(rays[i], t0, t1)) scratch.push_back(i);
+    }
+    size_t end = scratch.size();
+    if (begin == end) continue;
+
+    if (e.node->isLeaf()) {
+      for (size_t p = e.node->start; p < e.node->start + e.node->range; ++p) {
+        for (size_t k = begin; k < end; ++k) {
+          if (!done(scratch[k])) leaf(primitives[p], scratch[k]);
+        }
+      }
+    } else {
+      if (e.node->r) stack.push_back({e.node->r, begin, end});
+      if (e.node->l) stack.push_back({e.node->l, begin, end});
+    }
+  }
+}
+
+void BVHAccel::intersect(const vector<Ray> &rays, const vector<size_t> &stream,
+                         vector<Intersection> &isects) const {
+  traverse_stream(root, primitives, rays, stream,
+                  [&](const Primitive *p, size_t i) {
+                    p->intersect(rays[i], &isects[i]);
+                  },
+                  [](size_t i) { return false; });
+}
+
+void BVHAccel::occluded(const vector<Ray> &rays, const vector<size_t> &stream,
+                        vector<unsigned char> &hit) const {
+  traverse_stream(root, primitives, rays, stream,
+                  [&](const Primitive *p, size_t i) {
+                    if (p->intersect(rays[i])) hit[i] = 1;
+                  },
+                  [&](size_t i) { return hit[i] != 0; });
+}
+
 }  // namespace StaticScene
 }  // namespace CMU462
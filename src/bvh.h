@@ -91,6 +91,34 @@ class BVHAccel : public Aggregate {
    */
   bool intersect(const Ray& r, Intersection* i) const;
 
+  /**
+   * Ray stream - Aggregate intersection.
+   * Finds the closest intersection of every ray in a stream. Rather than
+   * walking the tree once per ray, the whole stream walks the tree together:
+   * each node filters the rays that reached its parent against its bounding
+   * box, and each leaf intersects its primitives with all the rays that
+   * reached it, so a node or primitive is fetched once per stream instead
+   * of once per ray.
+   * \param rays ray storage, indexed by the stream
+   * \param stream indices of the rays to trace
+   * \param isects intersection records parallel to rays; the record of each
+   *        ray in the stream is updated when a closer hit is found
+   */
+  void intersect(const std::vector<Ray>& rays,
+                 const std::vector<size_t>& stream,
+                 std::vector<Intersection>& isects) const;
+
+  /**
+   * Ray stream - Aggregate occlusion test.
+   * Same as above but only checks whether each ray hits anything at all,
+   * and stops traversing a ray as soon as it is known to be occluded.
+   * \param rays ray storage, indexed by the stream
+   * \param stream indices of the rays to trace
+   * \param hit flags parallel to rays, set to 1 for every occluded ray
+   */
+  void occluded(const std::vector<Ray>& rays, const std::vector<size_t>& stream,
+                std::vector<unsigned char>& hit) const;
+
   /**
    * Get BSDF of the surface material
    * Note that this does not make sense for the BVHAccel aggregate
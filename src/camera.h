@@ -63,6 +63,7 @@ class Camera {
   Vector3D position() const { return pos; }
   Vector3D view_point() const { return targetPos; }
   Vector3D up_dir() const { return c2w[1]; }
+  double h_fov() const { return hFov; }
   double v_fov() const { return vFov; }
   double aspect_ratio() const { return ar; }
   double near_clip() const { return nClip; }
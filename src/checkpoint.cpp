@@ -0,0 +1,94 @@
+#include "checkpoint.h"
+
+#include <stdio.h>
+#include <string.h>
+
+namespace CMU462 {
+
+static const char checkpoint_magic[8] = {'S', '3', 'D', 'C', 'K', 'P', 'T', 0};
+static const uint32_t checkpoint_version = 1;
+
+// No tile of a sane render is larger than this, so a count above it means
+// the file is damaged.
+static const uint32_t max_tile_floats = 1u << 26;
+
+template <typename T>
+static bool write_value(FILE* file, const T& value) {
+  return fwrite(&value, sizeof(T), 1, file) == 1;
+}
+
+template <typename T>
+static bool read_value(FILE* file, T* value) {
+  return fread(value, sizeof(T), 1, file) == 1;
+}
+
+template <typename T>
+static bool write_array(FILE* file, const std::vector<T>& values) {
+  uint32_t n = values.size();
+  return write_value(file, n) &&
+         (n == 0 || fwrite(&values[0], sizeof(T), n, file) == n);
+}
+
+template <typename T>
+static bool read_array(FILE* file, std::vector<T>* values) {
+  uint32_t n;
+  if (!read_value(file, &n) || n > max_tile_floats) return false;
+  values->resize(n);
+  return n == 0 || fread(&(*values)[0], sizeof(T), n, file) == n;
+}
+
+bool RenderCheckpoint::write(const std::string& path) const {
+  std::string temp_path = path + ".tmp";
+  FILE* file = fopen(temp_path.c_str(), "wb");
+  if (!file) return false;
+
+  bool ok = fwrite(checkpoint_magic, sizeof(checkpoint_magic), 1, file) == 1 &&
+            write_value(file, checkpoint_version) &&
+            write_value(file, width) && write_value(file, height) &&
+            write_value(file, tile_size) && write_value(file, seed) &&
+            write_value(file, ns_aa) && write_value(file, max_ray_depth) &&
+            write_value(file, ns_area_light) && write_value(file, aovs) &&
+            write_value(file, (uint32_t)tiles.size());
+  for (size_t i = 0; ok && i < tiles.size(); ++i) {
+    const Tile& tile = tiles[i];
+    ok = write_value(file, tile.index) && write_value(file, tile.num_passes) &&
+         write_array(file, tile.sum) && write_array(file, tile.layers);
+  }
+  ok = fclose(file) == 0 && ok;
+
+  if (!ok || rename(temp_path.c_str(), path.c_str()) != 0) {
+    remove(temp_path.c_str());
+    return false;
+  }
+  return true;
+}
+
+bool RenderCheckpoint::read(const std::string& path) {
+  FILE* file = fopen(path.c_str(), "rb");
+  if (!file) return false;
+
+  char magic[sizeof(checkpoint_magic)];
+  uint32_t version, num_tiles;
+  bool ok = fread(magic, sizeof(magic), 1, file) == 1 &&
+            memcmp(magic, checkpoint_magic, sizeof(magic)) == 0 &&
+            read_value(file, &version) && version == checkpoint_version &&
+            read_value(file, &width) && read_value(file, &height) &&
+            read_value(file, &tile_size) && read_value(file, &seed) &&
+            read_value(file, &ns_aa) && read_value(file, &max_ray_depth) &&
+            read_value(file, &ns_area_light) && read_value(file, &aovs) &&
+            read_value(file, &num_tiles);
+
+  tiles.clear();
+  for (uint32_t i = 0; ok && i < num_tiles; ++i) {
+    tiles.push_back(Tile());
+    Tile& tile = tiles.back();
+    ok = read_value(file, &tile.index) && read_value(file, &tile.num_passes) &&
+         read_array(file, &tile.sum) && read_array(file, &tile.layers);
+  }
+  fclose(file);
+
+  if (!ok) tiles.clear();
+  return ok;
+}
+
+}  // namespace CMU462
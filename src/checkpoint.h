@@ -0,0 +1,78 @@
+#ifndef CMU462_CHECKPOINT_H
+#define CMU462_CHECKPOINT_H
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "tile_buffer.h"
+
+namespace CMU462 {
+
+/**
+ * The state of a render that is needed to finish it later: the settings
+ * that decide its samples, and the sums, sample counts and AOVs of every
+ * tile rendered so far. Tiles are seeded from the seed of the render and
+ * their index, so the random state of a tile that is not in the checkpoint
+ * is known without saving it.
+ *
+ * The file is a header followed by one record per tile, in the byte order
+ * of the machine that wrote it.
+ */
+struct RenderCheckpoint {
+  RenderCheckpoint()
+      : width(0), height(0), tile_size(0), seed(0), ns_aa(0),
+        max_ray_depth(0), ns_area_light(0), aovs(0) {}
+
+  /**
+   * A rendered tile.
+   */
+  struct Tile {
+    uint32_t index;             ///< index of the tile in the image
+    uint32_t num_passes;        ///< number of passes merged
+    std::vector<Float4> sum;    ///< sums of all passes, row by row
+    std::vector<float> layers;  ///< AOVs, see AOVBuffer::save_region
+  };
+
+  /**
+   * If a checkpoint belongs to a render with the same settings, so that
+   * its tiles can be used for this one.
+   */
+  bool same_render(const RenderCheckpoint& other) const {
+    return width == other.width && height == other.height &&
+           tile_size == other.tile_size && seed == other.seed &&
+           ns_aa == other.ns_aa && max_ray_depth == other.max_ray_depth &&
+           ns_area_light == other.ns_area_light && aovs == other.aovs;
+  }
+
+  /**
+   * Write the checkpoint. It is written to a temporary file first and then
+   * renamed, so an interrupted write leaves the previous checkpoint intact.
+   * \param path path of the file
+   * \return false if the file could not be written
+   */
+  bool write(const std::string& path) const;
+
+  /**
+   * Read a checkpoint.
+   * \param path path of the file
+   * \return false if the file could not be read or is not a checkpoint
+   */
+  bool read(const std::string& path);
+
+  uint32_t width;          ///< width of the image
+  uint32_t height;         ///< height of the image
+  uint32_t tile_size;      ///< size of the square tiles
+  uint64_t seed;           ///< seed of the render
+  uint32_t ns_aa;          ///< camera rays per pixel
+  uint32_t max_ray_depth;  ///< maximum ray depth
+  uint32_t ns_area_light;  ///< samples per area light
+  int32_t aovs;            ///< set of AOVs rendered
+
+  std::vector<Tile> tiles;  ///< rendered tiles
+};
+
+}  // namespace CMU462
+
+#endif  // CMU462_CHECKPOINT_H
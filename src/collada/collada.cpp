@@ -1,5 +1,10 @@
 #include "collada.h"
+#include "number_parser.h"
 #include "math.h"
+#include "../mapped_file.h"
+#include "../work_queue.h"
+
+#include "CMU462/timer.h"
 
 #include <assert.h>
 #include <map>
@@ -8,6 +13,7 @@
 #include <iomanip>
 #include <sstream>
 #include <iostream>
+#include <thread>
 #include <algorithm>
 
 // For more verbose output, uncomment the line below.
@@ -19,10 +25,12 @@ namespace CMU462 {
 namespace Collada {
 
 SceneInfo* ColladaParser::scene;  // pointer to output scene description
+string ColladaParser::directory;  // directory of the file being loaded
 
 Vector3D ColladaParser::up;                       // scene up direction
 Matrix4x4 ColladaParser::transform;               // current transformation
-map<string, XMLElement*> ColladaParser::sources;  // URI lookup table
+unordered_map<string, XMLElement*> ColladaParser::sources;  // URI lookup
+vector<pair<XMLElement*, PolymeshInfo*> > ColladaParser::polymeshes;
 
 // Parser Helpers //
 
@@ -50,8 +58,7 @@ inline Color color_from_string(string color_string) {
 }
 
 void ColladaParser::uri_load(XMLElement* xml) {
-  if (xml->Attribute("id")) {
-    string id = xml->Attribute("id");
+  if (const char* id = xml->Attribute("id")) {
     sources[id] = xml;
   }
 
@@ -62,8 +69,9 @@ void ColladaParser::uri_load(XMLElement* xml) {
   }
 }
 
-XMLElement* ColladaParser::uri_find(string id) {
-  return (sources.find(id) != sources.end()) ? sources[id] : NULL;
+XMLElement* ColladaParser::uri_find(const string& id) {
+  unordered_map<string, XMLElement*>::const_iterator it = sources.find(id);
+  return (it != sources.end()) ? it->second : NULL;
 }
 
 XMLElement* ColladaParser::get_element(XMLElement* xml, string query) {
@@ -114,15 +122,22 @@ XMLElement* ColladaParser::get_technique_cmu462(XMLElement* xml) {
 }
 
 int ColladaParser::load(const char* filename, SceneInfo* sceneInfo) {
-  ifstream in(filename);
-  if (!in.is_open()) {
+  // Map the file and parse it in place. Text is only copied where tinyxml2
+  // terminates or normalizes it, so the bulk of the file, the number arrays,
+  // stays in the page cache instead of being read into a second buffer.
+  MappedFile file;
+  if (!file.open(filename)) {
     cerr << "Warning: could not open file " << filename << endl;
     return -1;
   }
-  in.close();
 
+  Timer timer;
+  timer.start();
   XMLDocument doc;
-  doc.LoadFile(filename);
+  doc.ParseInSitu(file.data(), file.size());
+  timer.stop();
+  fprintf(stdout, "[Scotty3D] Parsing XML... Done! (%.4f sec)\n",
+          timer.duration());
   if (doc.Error()) {
     stat("XML error: ");
     doc.PrintError();
@@ -140,7 +155,13 @@ int ColladaParser::load(const char* filename, SceneInfo* sceneInfo) {
   // Set output scene pointer
   scene = sceneInfo;
 
+  // Image paths are relative to the file
+  string path = filename;
+  size_t slash = path.find_last_of("/\\");
+  directory = slash == string::npos ? "" : path.substr(0, slash + 1);
+
   // Build uri table
+  sources.clear();
   uri_load(root);
 
   // Load assets - correct up direction
@@ -195,17 +216,22 @@ int ColladaParser::load(const char* filename, SceneInfo* sceneInfo) {
     stat("Loading scene...");
 
     // parse all nodes in scene
+    polymeshes.clear();
     XMLElement* e_node = get_element(e_scene, "node");
     while (e_node) {
       parse_node(e_node);
       e_node = e_node->NextSiblingElement("node");
     }
+    parse_polymeshes();
 
   } else {
     stat("Error: No scene description found in file:" << filename);
+    sources.clear();
     return -1;
   }
 
+  // the elements go away with the document
+  sources.clear();
   return 0;
 }
 
@@ -361,9 +387,9 @@ void ColladaParser::parse_node(XMLElement* xml) {
     node.instance = light;
   } else if (e_geometry) {
     if (get_element(e_geometry, "mesh")) {
-      // mesh geometry
+      // mesh geometry, parsed once all nodes are
       PolymeshInfo* polymesh = new PolymeshInfo();
-      parse_polymesh(e_geometry, *polymesh);
+      polymeshes.push_back(make_pair(e_geometry, polymesh));
 
       // mesh material
       XMLElement* e_instance_material = get_element(
@@ -598,6 +624,51 @@ void ColladaParser::parse_sphere(XMLElement* xml, SphereInfo& sphere) {
   stat("  |- " << sphere);
 }
 
+void ColladaParser::parse_polymeshes() {
+  // instances of the same geometry are parsed one after the other on one
+  // thread, since reading the text of an element can rewrite it in place
+  vector<vector<PolymeshInfo*> > instances;
+  unordered_map<XMLElement*, size_t> geometry_index;
+  vector<XMLElement*> geometries;
+  for (const auto& p : polymeshes) {
+    auto it = geometry_index.insert(make_pair(p.first, geometries.size()));
+    if (it.second) {
+      geometries.push_back(p.first);
+      instances.push_back(vector<PolymeshInfo*>());
+    }
+    instances[it.first->second].push_back(p.second);
+  }
+
+  size_t num_threads = min<size_t>(
+      max(1u, std::thread::hardware_concurrency()), geometries.size());
+  if (num_threads == 0) return;
+
+  fprintf(stdout, "[Scotty3D] Parsing %zu meshes on %zu threads... ",
+          polymeshes.size(), num_threads);
+  fflush(stdout);
+  Timer timer;
+  timer.start();
+
+  WorkQueue<size_t> work;
+  for (size_t i = 0; i < geometries.size(); ++i) work.put_work(i);
+  auto parse = [&]() {
+    size_t i;
+    while (work.try_get_work(&i)) {
+      for (PolymeshInfo* polymesh : instances[i]) {
+        parse_polymesh(geometries[i], *polymesh);
+      }
+    }
+  };
+  vector<std::thread> threads;
+  for (size_t t = 1; t < num_threads; ++t) threads.push_back(std::thread(parse));
+  parse();
+  for (std::thread& t : threads) t.join();
+  polymeshes.clear();
+
+  timer.stop();
+  fprintf(stdout, "Done! (%.4f sec)\n", timer.duration());
+}
+
 void ColladaParser::parse_polymesh(XMLElement* xml, PolymeshInfo& polymesh) {
   // name & id
   polymesh.id = xml->Attribute("id");
@@ -621,22 +692,15 @@ void ColladaParser::parse_polymesh(XMLElement* xml, PolymeshInfo& polymesh) {
     // source float array - other formats not handled
     XMLElement* e_float_array = e_source->FirstChildElement("float_array");
     if (e_float_array) {
-      float f;
-      vector<float> floats;
-
-      // load float array string
-      string s = e_float_array->GetText();
-      stringstream ss(s);
-
-      // load float array
-      size_t num_floats = e_float_array->IntAttribute("count");
-      for (size_t i = 0; i < num_floats; ++i) {
-        ss >> f;
-        floats.push_back(f);
+      // load float array straight from the text of the document
+      vector<float>& floats = arr_sources[source_id];
+      floats.resize(e_float_array->UnsignedAttribute("count"));
+      size_t num_floats =
+          parse_floats(e_float_array->GetText(), floats.data(), floats.size());
+      if (num_floats < floats.size()) {
+        stat("Error: float array " << source_id << " is short");
+        floats.resize(num_floats);
       }
-
-      // add to array sources
-      arr_sources[source_id] = floats;
     }
 
     // parse next source
@@ -664,7 +728,8 @@ void ColladaParser::parse_polymesh(XMLElement* xml, PolymeshInfo& polymesh) {
       string source = e_input->Attribute("source") + 1;
       if (arr_sources.find(source) != arr_sources.end()) {
         vector<float>& floats = arr_sources[source];
-        size_t num_floats = floats.size();
+        size_t num_floats = floats.size() / 3 * 3;
+        vertices.reserve(num_floats / 3);
         for (size_t i = 0; i < num_floats; i += 3) {
           Vector3D v = Vector3D(floats[i], floats[i + 1], floats[i + 2]);
           vertices.push_back(v);
@@ -721,8 +786,7 @@ void ColladaParser::parse_polymesh(XMLElement* xml, PolymeshInfo& polymesh) {
         vertex_offset = offset;
 
         if (source == vertices_id) {
-          polymesh.vertices.resize(vertices.size());
-          copy(vertices.begin(), vertices.end(), polymesh.vertices.begin());
+          polymesh.vertices.swap(vertices);
         } else {
           stat("Error: undefined source for VERTEX semantic: " << source);
           exit(EXIT_FAILURE);
@@ -736,7 +800,8 @@ void ColladaParser::parse_polymesh(XMLElement* xml, PolymeshInfo& polymesh) {
 
         if (arr_sources.find(source) != arr_sources.end()) {
           vector<float>& floats = arr_sources[source];
-          size_t num_floats = floats.size();
+          size_t num_floats = floats.size() / 3 * 3;
+          polymesh.normals.reserve(num_floats / 3);
           for (size_t i = 0; i < num_floats; i += 3) {
             Vector3D n = Vector3D(floats[i], floats[i + 1], floats[i + 2]);
             polymesh.normals.push_back(n);
@@ -754,7 +819,8 @@ void ColladaParser::parse_polymesh(XMLElement* xml, PolymeshInfo& polymesh) {
 
         if (arr_sources.find(source) != arr_sources.end()) {
           vector<float>& floats = arr_sources[source];
-          size_t num_floats = floats.size();
+          size_t num_floats = floats.size() / 2 * 2;
+          polymesh.texcoords.reserve(num_floats / 2);
           for (size_t i = 0; i < num_floats; i += 2) {
             Vector2D n = Vector2D(floats[i], floats[i + 1]);
             polymesh.texcoords.push_back(n);
@@ -780,42 +846,35 @@ void ColladaParser::parse_polymesh(XMLElement* xml, PolymeshInfo& polymesh) {
     if (is_polylist) {
       XMLElement* e_vcount = e_polylist->FirstChildElement("vcount");
       if (e_vcount) {
-        size_t size;
-        string s = e_vcount->GetText();
-        stringstream ss(s);
-  
+        // missing sizes are left zero
+        sizes.resize(num_polygons);
+        if (parse_indices(e_vcount->GetText(), sizes.data(), num_polygons) <
+            num_polygons) {
+          stat("Error: polygon sizes are short in geometry: " << polymesh.id);
+        }
         for (size_t i = 0; i < num_polygons; ++i) {
-          ss >> size;
-          sizes.push_back(size);
-          num_indices += size * stride;
+          num_indices += sizes[i] * stride;
         }
-  
       } else {
         stat("Error: polygon sizes undefined in geometry: " << polymesh.id);
         exit(EXIT_FAILURE);
       }
     } else {
     // Not polylist, so must be triangles
-      size_t size = 3;
-      for (size_t i = 0; i < num_polygons; ++i) {
-        sizes.push_back(size);
-        num_indices += size * stride;
-      }
+      sizes.assign(num_polygons, 3);
+      num_indices = num_polygons * 3 * stride;
     }
    
     // index array
     vector<size_t> indices;
     XMLElement* e_p = e_polylist->FirstChildElement("p");
     if (e_p) {
-      size_t index;
-      string s = e_p->GetText();
-      stringstream ss(s);
-
-      for (size_t i = 0; i < num_indices; ++i) {
-        ss >> index;
-        indices.push_back(index);
+      // missing indices are left zero
+      indices.resize(num_indices);
+      if (parse_indices(e_p->GetText(), indices.data(), num_indices) <
+          num_indices) {
+        stat("Error: index array is short in geometry: " << polymesh.id);
       }
-
     } else {
       stat("Error: no index array defined in geometry: " << polymesh.id);
       exit(EXIT_FAILURE);
@@ -890,23 +949,25 @@ void ColladaParser::parse_material(XMLElement* xml, MaterialInfo& material) {
           Spectrum radiance =
               spectrum_from_string(string(e_radiance->GetText()));
           BSDF* bsdf = new EmissionBSDF(radiance);
+          bsdf->color_texture = parse_texture(e_radiance);
           material.bsdf = bsdf;
         } else if (type == "mirror") {
           XMLElement* e_reflectance = get_element(e_bsdf, "reflectance");
           Spectrum reflectance =
               spectrum_from_string(string(e_reflectance->GetText()));
           BSDF* bsdf = new MirrorBSDF(reflectance);
+          bsdf->color_texture = parse_texture(e_reflectance);
+          material.bsdf = bsdf;
+        } else if (type == "glossy") {
+          XMLElement* e_reflectance = get_element(e_bsdf, "reflectance");
+          XMLElement* e_roughness = get_element(e_bsdf, "roughness");
+          Spectrum reflectance =
+              spectrum_from_string(string(e_reflectance->GetText()));
+          float roughness = atof(e_roughness->GetText());
+          BSDF* bsdf = new GlossyBSDF(reflectance, roughness);
+          bsdf->color_texture = parse_texture(e_reflectance);
+          bsdf->roughness_texture = parse_texture(e_roughness);
           material.bsdf = bsdf;
-          /*
-          if (type == "glossy") {
-            XMLElement *e_reflectance  = get_element(e_bsdf, "reflectance");
-            XMLElement *e_roughness = get_element(e_bsdf, "roughness");
-            Spectrum reflectance =
-          spectrum_from_string(string(e_reflectance->GetText()));
-            float roughness = atof(e_roughness->GetText());
-            BSDF* bsdf = new GlossyBSDF(reflectance, roughness);
-            material.bsdf = bsdf;
-          */
         } else if (type == "refraction") {
           XMLElement* e_transmittance = get_element(e_bsdf, "transmittance");
           XMLElement* e_roughness = get_element(e_bsdf, "roughness");
@@ -916,6 +977,7 @@ void ColladaParser::parse_material(XMLElement* xml, MaterialInfo& material) {
           float roughness = atof(e_roughness->GetText());
           float ior = atof(e_ior->GetText());
           BSDF* bsdf = new RefractionBSDF(transmittance, roughness, ior);
+          bsdf->color_texture = parse_texture(e_transmittance);
           material.bsdf = bsdf;
         } else if (type == "glass") {
           XMLElement* e_transmittance = get_element(e_bsdf, "transmittance");
@@ -930,6 +992,7 @@ void ColladaParser::parse_material(XMLElement* xml, MaterialInfo& material) {
           float ior = atof(e_ior->GetText());
           BSDF* bsdf =
               new GlassBSDF(transmittance, reflectance, roughness, ior);
+          bsdf->color_texture = parse_texture(e_transmittance);
           material.bsdf = bsdf;
         }
 
@@ -937,9 +1000,14 @@ void ColladaParser::parse_material(XMLElement* xml, MaterialInfo& material) {
       }
     } else if (tech_common) {
       XMLElement* e_diffuse = get_element(tech_common, "phong/diffuse/color");
+      XMLElement* e_texture = get_element(tech_common, "phong/diffuse/texture");
       if (e_diffuse) {
         Spectrum albedo = spectrum_from_string(string(e_diffuse->GetText()));
         material.bsdf = new DiffuseBSDF(albedo);
+      } else if (e_texture) {
+        // the texture is the albedo itself
+        material.bsdf = new DiffuseBSDF(Spectrum(1, 1, 1));
+        material.bsdf->color_texture = parse_texture(e_texture);
       } else {
         material.bsdf = new DiffuseBSDF(Spectrum(.5f, .5f, .5f));
       }
@@ -956,14 +1024,109 @@ void ColladaParser::parse_material(XMLElement* xml, MaterialInfo& material) {
   stat("  |- " << material);
 }
 
+const Texture* ColladaParser::parse_texture(XMLElement* xml) {
+  const char* texture = xml->Attribute("texture");
+  if (!texture) return NULL;
+
+  // A sampler of the common profile is a parameter of the effect, which
+  // names a surface parameter (COLLADA 1.4) or the image (1.5). Parameters
+  // are found by their sid in the profile or the effect around the element.
+  XMLElement* image = uri_find(texture);
+  string ref = texture;
+  for (int hops = 0; hops < 2 && !(image && image->Name() == string("image"));
+       hops++) {
+    XMLElement* param = NULL;
+    for (XMLNode* n = xml->Parent(); n && !param; n = n->Parent()) {
+      XMLElement* scope = n->ToElement();
+      if (!scope) break;
+      for (XMLElement* e = scope->FirstChildElement("newparam"); e;
+           e = e->NextSiblingElement("newparam")) {
+        const char* sid = e->Attribute("sid");
+        if (sid && ref == sid) {
+          param = e;
+          break;
+        }
+      }
+    }
+    if (!param) return NULL;
+
+    XMLElement* e;
+    if ((e = get_element(param, "sampler2D/instance_image"))) {
+      image = e;
+    } else if ((e = get_element(param, "sampler2D/source")) && e->GetText()) {
+      ref = e->GetText();
+    } else if ((e = get_element(param, "surface/init_from")) && e->GetText()) {
+      image = uri_find(e->GetText());
+    } else {
+      return NULL;
+    }
+  }
+  if (!image || image->Name() != string("image")) return NULL;
+
+  XMLElement* e_init = get_element(image, "init_from");
+  if (e_init && e_init->FirstChildElement("ref")) {
+    e_init = e_init->FirstChildElement("ref");
+  }
+  if (!e_init || !e_init->GetText()) return NULL;
+
+  string path = e_init->GetText();
+  if (path.compare(0, 7, "file://") == 0) path = path.substr(7);
+  if (path.empty()) return NULL;
+  if (path[0] != '/' && path.find(':') == string::npos) {
+    path = directory + path;
+  }
+  return Texture::load(path);
+}
+
 // ====================================================================
 // ============ ColladaWriter =========================================
 // ====================================================================
 
 bool ColladaWriter::writeScene(DynamicScene::Scene& scene,
                                const char* filename) {
-  ofstream out(filename);
-  if (!out.is_open()) {
+  SceneSnapshot meshes;
+  snapshot(scene, &meshes);
+  return writeScene(meshes, filename);
+}
+
+void ColladaWriter::snapshot(DynamicScene::Scene& scene,
+                             SceneSnapshot* snapshot) {
+  snapshot->clear();
+  for (auto o : scene.objects) {
+    DynamicScene::Mesh* mesh = dynamic_cast<DynamicScene::Mesh*>(o);
+    if (!mesh) continue;
+
+    HalfedgeMesh& m(mesh->mesh);
+    snapshot->push_back(MeshSnapshot());
+    MeshSnapshot& s = snapshot->back();
+
+    // TODO transformations are currently ignored
+
+    // assign a unique ID to each vertex (we will need these so that
+    // each polygon can reference its vertices)
+    s.positions.reserve(m.nVertices());
+    for (VertexIter v = m.verticesBegin(); v != m.verticesEnd(); v++) {
+      v->index = s.positions.size();
+      s.positions.push_back(v->position);
+    }
+
+    s.degrees.reserve(m.nFaces());
+    s.indices.reserve(2 * m.nHalfedges());
+    for (FaceIter f = m.facesBegin(); f != m.facesEnd(); f++) {
+      s.degrees.push_back(f->degree());
+      HalfedgeIter h = f->halfedge();
+      do {
+        s.indices.push_back(h->vertex()->index);
+        h = h->next();
+      } while (h != f->halfedge());
+    }
+  }
+}
+
+bool ColladaWriter::writeScene(const SceneSnapshot& scene,
+                               const char* filename) {
+  TextWriter out;
+  if (!out.open(filename)) {
     cerr << "WARNING: Could not open file " << filename
          << " for COLLADA export!" << endl;
     return false;
@@ -975,10 +1138,14 @@ bool ColladaWriter::writeScene(DynamicScene::Scene& scene,
   writeVisualScenes(out, scene);
   writeFooter(out);
 
+  if (!out.close()) {
+    cerr << "WARNING: Could not write COLLADA file " << filename << endl;
+    return false;
+  }
   return true;
 }
 
-void writeCurrentTime(ofstream& out) {
+void writeCurrentTime(TextWriter& out) {
   auto t = time(nullptr);
   auto tm = *localtime(&t);
 
@@ -995,143 +1162,117 @@ void writeCurrentTime(ofstream& out) {
   out << tm.tm_sec;
 }
 
-void ColladaWriter::writeHeader(ofstream& out) {
-  out << "<?xml version=\"1.0\" encoding=\"utf-8\"?>" << endl;
+void ColladaWriter::writeHeader(TextWriter& out) {
+  out << "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n";
   out << "<COLLADA xmlns=\"http://www.collada.org/2005/11/COLLADASchema\" "
-         "version=\"1.4.1\">"
-      << endl;
-  out << "<asset>" << endl;
-  out << "   <contributor>" << endl;
-  out << "      <author>Scotty</author>" << endl;
+         "version=\"1.4.1\">\n";
+  out << "<asset>\n";
+  out << "   <contributor>\n";
+  out << "      <author>Scotty</author>\n";
   out << "      <authoring_tool>CMU Scotty3D (version "
-         "15-462/662)</authoring_tool>"
-      << endl;
-  out << "   </contributor>" << endl;
+         "15-462/662)</authoring_tool>\n";
+  out << "   </contributor>\n";
   out << "   <created>";
   writeCurrentTime(out);
-  out << "</created>" << endl;
+  out << "</created>\n";
   out << "   <modified>";
   writeCurrentTime(out);
-  out << "</modified>" << endl;
-  out << "   <unit name=\"meter\" meter=\"1\"/>" << endl;
-  out << "   <up_axis>Y_UP</up_axis>" << endl;
-  out << "</asset>" << endl;
+  out << "</modified>\n";
+  out << "   <unit name=\"meter\" meter=\"1\"/>\n";
+  out << "   <up_axis>Y_UP</up_axis>\n";
+  out << "</asset>\n";
 }
 
-void ColladaWriter::writeFooter(ofstream& out) { out << "</COLLADA>" << endl; }
-
-void ColladaWriter::writeGeometry(ofstream& out, DynamicScene::Scene& scene) {
-  int nMeshes = 0;
+void ColladaWriter::writeFooter(TextWriter& out) { out << "</COLLADA>\n"; }
 
-  out << "   <library_geometries>" << endl;
-  for (auto o : scene.objects) {
-    DynamicScene::Mesh* mesh = dynamic_cast<DynamicScene::Mesh*>(o);
-    if (mesh) {
-      nMeshes++;
-      writeMesh(out, mesh, nMeshes);
-    }
+void ColladaWriter::writeGeometry(TextWriter& out,
+                                  const SceneSnapshot& scene) {
+  out << "   <library_geometries>\n";
+  for (size_t i = 0; i < scene.size(); ++i) {
+    writeMesh(out, scene[i], i + 1);
   }
-  out << "   </library_geometries>" << endl;
+  out << "   </library_geometries>\n";
 }
 
-void ColladaWriter::writeMesh(ofstream& out, DynamicScene::Mesh* mesh, int id) {
-  HalfedgeMesh& m(mesh->mesh);
-  int nV = m.nVertices();
-  int nF = m.nFaces();
-
-  // TODO transformations are currently ignored
-
-  // assign a unique ID to each vertex (we will need these so that
-  // each polygon can reference its vertices)
-  int index = 0;
-  for (VertexIter v = m.verticesBegin(); v != m.verticesEnd(); v++) {
-    v->index = index;
-    index++;
-  }
+void ColladaWriter::writeMesh(TextWriter& out, const MeshSnapshot& mesh,
+                              int id) {
+  size_t nV = mesh.positions.size();
+  size_t nF = mesh.degrees.size();
 
-  out << "      <geometry id=\"M" << id << "\" name=\"Mesh" << id << "\">"
-      << endl;
-  out << "         <mesh>" << endl;
+  out << "      <geometry id=\"M" << id << "\" name=\"Mesh" << id << "\">\n";
+  out << "         <mesh>\n";
 
   // positions -------------
-  out << "            <source id=\"M" << id << "-positions\">" << endl;
+  out << "            <source id=\"M" << id << "-positions\">\n";
   out << "               <float_array id=\"M" << id
-      << "-positions-array\" count=\"" << 3 * nV << "\">" << endl;
-  for (VertexIter v = m.verticesBegin(); v != m.verticesEnd(); v++) {
-    Vector3D p = v->position;
+      << "-positions-array\" count=\"" << 3 * nV << "\">\n";
+  for (const Vector3D& p : mesh.positions) {
     out << "                  ";
-    out << p.x << " " << p.y << " " << p.z << endl;
+    out << p.x << " " << p.y << " " << p.z << '\n';
   }
-  out << "               </float_array>" << endl;
-  out << "               <technique_common>" << endl;
+  out << "               </float_array>\n";
+  out << "               <technique_common>\n";
   out << "                  <accessor source=\"#M" << id
-      << "-positions-array\" count=\"" << nV << "\" stride=\"3\">" << endl;
-  out << "                     <param name=\"X\" type=\"float\"/>" << endl;
-  out << "                     <param name=\"Y\" type=\"float\"/>" << endl;
-  out << "                     <param name=\"Z\" type=\"float\"/>" << endl;
-  out << "                  </accessor>" << endl;
-  out << "               </technique_common>" << endl;
-  out << "            </source>" << endl;
+      << "-positions-array\" count=\"" << nV << "\" stride=\"3\">\n";
+  out << "                     <param name=\"X\" type=\"float\"/>\n";
+  out << "                     <param name=\"Y\" type=\"float\"/>\n";
+  out << "                     <param name=\"Z\" type=\"float\"/>\n";
+  out << "                  </accessor>\n";
+  out << "               </technique_common>\n";
+  out << "            </source>\n";
 
   // vertices -------------
-  out << "            <vertices id=\"M" << id << "-vertices\">" << endl;
+  out << "            <vertices id=\"M" << id << "-vertices\">\n";
   out << "               <input semantic=\"POSITION\" source=\"#M" << id
-      << "-positions\"/>" << endl;
-  out << "            </vertices>" << endl;
+      << "-positions\"/>\n";
+  out << "            </vertices>\n";
 
   // polygons -------------
-  out << "         <polylist count=\"" << nF << "\">" << endl;
+  out << "         <polylist count=\"" << nF << "\">\n";
   out << "            <input semantic=\"VERTEX\" source=\"#M" << id
-      << "-vertices\" offset=\"0\"/>" << endl;
+      << "-vertices\" offset=\"0\"/>\n";
   out << "            <vcount>";
-  for (FaceIter f = m.facesBegin(); f != m.facesEnd(); f++) {
-    out << f->degree() << " ";
+  for (size_t degree : mesh.degrees) {
+    out << degree << " ";
   }
-  out << "            </vcount>" << endl;
-  out << "            <p>" << endl;
-  for (FaceIter f = m.facesBegin(); f != m.facesEnd(); f++) {
+  out << "            </vcount>\n";
+  out << "            <p>\n";
+  const size_t* index = mesh.indices.data();
+  for (size_t degree : mesh.degrees) {
     out << "               ";
-    HalfedgeIter h = f->halfedge();
-    do {
-      out << h->vertex()->index << " ";
-      h = h->next();
-    } while (h != f->halfedge());
-    out << endl;
+    for (size_t i = 0; i < degree; ++i) out << *index++ << " ";
+    out << '\n';
   }
-  out << "            </p>" << endl;
-  out << "         </polylist>" << endl;
+  out << "            </p>\n";
+  out << "         </polylist>\n";
 
-  out << "         </mesh>" << endl;
-  out << "      </geometry>" << endl;
+  out << "         </mesh>\n";
+  out << "      </geometry>\n";
 }
 
-void ColladaWriter::writeVisualScenes(ofstream& out,
-                                      DynamicScene::Scene& scene) {
-  out << "   <library_visual_scenes>" << endl;
-  out << "      <visual_scene id=\"ScottyScene\">" << endl;
+void ColladaWriter::writeVisualScenes(TextWriter& out,
+                                      const SceneSnapshot& scene) {
+  out << "   <library_visual_scenes>\n";
+  out << "      <visual_scene id=\"ScottyScene\">\n";
 
   int nMeshes = 0;
   int nNodes = 0;
-  for (auto o : scene.objects) {
-    DynamicScene::Mesh* mesh = dynamic_cast<DynamicScene::Mesh*>(o);
-    if (mesh) {
-      nMeshes++;
-      nNodes++;
-      out << "         <node id=\"N" << nNodes << "\" name=\"Node" << nNodes
-          << "\">" << endl;
-      out << "            <instance_geometry url=\"#M" << nMeshes << "\">"
-          << endl;
-      out << "            </instance_geometry>" << endl;
-      out << "         </node>" << endl;
-    }
+  for (size_t i = 0; i < scene.size(); ++i) {
+    nMeshes++;
+    nNodes++;
+    out << "         <node id=\"N" << nNodes << "\" name=\"Node" << nNodes
+        << "\">\n";
+    out << "            <instance_geometry url=\"#M" << nMeshes << "\">\n";
+    out << "            </instance_geometry>\n";
+    out << "         </node>\n";
   }
 
-  out << "      </visual_scene>" << endl;
-  out << "   </library_visual_scenes>" << endl;
+  out << "      </visual_scene>\n";
+  out << "   </library_visual_scenes>\n";
 
-  out << "   <scene>" << endl;
-  out << "      <instance_visual_scene url=\"#ScottyScene\"/>" << endl;
-  out << "   </scene>" << endl;
+  out << "   <scene>\n";
+  out << "      <instance_visual_scene url=\"#ScottyScene\"/>\n";
+  out << "   </scene>\n";
 }
 
 }  // namespace Collada
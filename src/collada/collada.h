@@ -4,6 +4,7 @@
 #include <map>
 #include <string>
 #include <fstream>
+#include <unordered_map>
 
 #include "CMU462/CMU462.h"
 #include "CMU462/tinyexr.h"
@@ -15,6 +16,7 @@
 #include "sphere_info.h"
 #include "polymesh_info.h"
 #include "material_info.h"
+#include "text_writer.h"
 #include "../dynamic_scene/scene.h"
 #include "../dynamic_scene/mesh.h"
 
@@ -37,6 +39,9 @@ class ColladaParser {
   // Pointer to the output scene description
   static SceneInfo* scene;
 
+  // Directory of the file being loaded, which image paths are relative to
+  static std::string directory;
+
   // Up direction used in scene discription (set on laod) //
   static Vector3D up;
 
@@ -44,14 +49,15 @@ class ColladaParser {
   static Matrix4x4 transform;
 
   // Lookup table used to handle URI indirections in COLLADA file
-  // The lookup table is constructed when the file is loaded
-  static std::map<std::string, XMLElement*> sources;
+  // The lookup table is constructed when the file is loaded and cleared when
+  // the document is freed
+  static std::unordered_map<std::string, XMLElement*> sources;
 
   // Load Collada elements with UUID into lookup table
   static void uri_load(XMLElement* xml);
 
   // Find xml entry point of given Collada UUID
-  static XMLElement* uri_find(std::string id);
+  static XMLElement* uri_find(const std::string& id);
 
   // Get entry point to a Collada object under the xml hierarchy given by the
   // query string from the input xml node, handle indirection if needed
@@ -65,6 +71,14 @@ class ColladaParser {
   // the given xml entry point
   static XMLElement* get_technique_cmu462(XMLElement* xml);
 
+  // Polygon meshes found while parsing nodes, with the geometry each is an
+  // instance of. They hold most of the data of a scene, and are parsed
+  // after the nodes, on several threads.
+  static vector<std::pair<XMLElement*, PolymeshInfo*> > polymeshes;
+
+  // Parse the polygon meshes found while parsing nodes
+  static void parse_polymeshes();
+
   static void parse_node(XMLElement* xml);
   static void parse_camera(XMLElement* xml, CameraInfo& camera);
   static void parse_light(XMLElement* xml, LightInfo& light);
@@ -72,19 +86,37 @@ class ColladaParser {
   static void parse_polymesh(XMLElement* xml, PolymeshInfo& polymesh);
   static void parse_material(XMLElement* xml, MaterialInfo& material);
 
+  // Load the texture an element of a material refers to by its texture
+  // attribute, either the id of an image or, in the common profile, the sid
+  // of a sampler parameter of the effect. Returns NULL if the element has no
+  // texture or its image could not be loaded.
+  static const Texture* parse_texture(XMLElement* xml);
+
 };  // class ColladaParser
 
 /*
-  Stores a dynamic scene in a COLLADA file.
+  Stores a dynamic scene in a COLLADA file. The meshes of the scene are
+  copied first, so that the copy can be written on another thread while the
+  scene is edited.
 */
 class ColladaWriter {
  public:
+  // The polygons of a mesh, as they are written
+  struct MeshSnapshot {
+    vector<Vector3D> positions;  // vertex positions
+    vector<size_t> degrees;      // number of vertices of each polygon
+    vector<size_t> indices;      // vertex indices of all polygons
+  };
+  typedef vector<MeshSnapshot> SceneSnapshot;
+
   static bool writeScene(DynamicScene::Scene& scene, const char* filename);
-  static void writeHeader(ofstream& out);
-  static void writeFooter(ofstream& out);
-  static void writeGeometry(ofstream& out, DynamicScene::Scene& scene);
-  static void writeMesh(ofstream& out, DynamicScene::Mesh* mesh, int id);
-  static void writeVisualScenes(ofstream& out, DynamicScene::Scene& scene);
+  static void snapshot(DynamicScene::Scene& scene, SceneSnapshot* snapshot);
+  static bool writeScene(const SceneSnapshot& scene, const char* filename);
+  static void writeHeader(TextWriter& out);
+  static void writeFooter(TextWriter& out);
+  static void writeGeometry(TextWriter& out, const SceneSnapshot& scene);
+  static void writeMesh(TextWriter& out, const MeshSnapshot& mesh, int id);
+  static void writeVisualScenes(TextWriter& out, const SceneSnapshot& scene);
 };
 
 }  // namespace Collada
@@ -9,9 +9,7 @@ namespace CMU462 {
 namespace Collada {
 
 struct MaterialInfo : public Instance {
-  BSDF* bsdf;
-
-  // Texture* tex; ///< texture
+  BSDF* bsdf;  ///< BSDF, with the textures of the material
 
 };  // struct Material
 
@@ -0,0 +1,202 @@
+#include "number_parser.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+namespace CMU462 {
+namespace Collada {
+
+// Texts shorter than this are parsed on the calling thread.
+static const size_t min_parallel_bytes = 8 << 20;
+
+// Each thread parses at least this much text.
+static const size_t min_chunk_bytes = 2 << 20;
+
+static inline bool is_space(char c) {
+  return c == ' ' || c == '\n' || c == '\t' || c == '\r';
+}
+
+static inline bool is_digit(char c) { return c >= '0' && c <= '9'; }
+
+// Powers of ten that are exact in a double.
+static const double powers_of_ten[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+/**
+ * Parse a float at p, which is not whitespace.
+ * The digits are gathered in an integer and scaled by an exact power of
+ * ten, which rounds to the same float as strtof for the numbers exporters
+ * write. Others, like ones with huge exponents, inf or nan, go to strtof.
+ * \return end of the float, NULL if there is none
+ */
+static const char* parse_float(const char* p, float* out) {
+  const char* start = p;
+  bool negative = *p == '-';
+  if (*p == '-' || *p == '+') p++;
+
+  uint64_t mantissa = 0;
+  int digits = 0, exponent = 0;
+  bool any = false;
+  for (; is_digit(*p); p++, any = true) {
+    if (digits < 19) {
+      mantissa = mantissa * 10 + (*p - '0');
+      if (mantissa) digits++;
+    } else {
+      exponent++;
+    }
+  }
+  if (*p == '.') {
+    for (p++; is_digit(*p); p++, any = true) {
+      if (digits < 19) {
+        mantissa = mantissa * 10 + (*p - '0');
+        if (mantissa) digits++;
+        exponent--;
+      }
+    }
+  }
+
+  bool fast = any;
+  if (fast && (*p == 'e' || *p == 'E')) {
+    p++;
+    bool negative_exponent = *p == '-';
+    if (*p == '-' || *p == '+') p++;
+    fast = is_digit(*p);
+    int e = 0;
+    for (; is_digit(*p); p++) e = std::min(e * 10 + (*p - '0'), 10000);
+    exponent += negative_exponent ? -e : e;
+  }
+
+  if (fast && (*p == '\0' || is_space(*p)) && exponent >= -22 &&
+      exponent <= 22) {
+    double value = (double)mantissa;
+    value = exponent < 0 ? value / powers_of_ten[-exponent]
+                         : value * powers_of_ten[exponent];
+    *out = (float)(negative ? -value : value);
+    return p;
+  }
+
+  char* end;
+  *out = strtof(start, &end);
+  if (end == start || (*end != '\0' && !is_space(*end))) return NULL;
+  return end;
+}
+
+/**
+ * Parse a non-negative integer at p, which is not whitespace.
+ * \return end of the integer, NULL if there is none
+ */
+static const char* parse_index(const char* p, size_t* out) {
+  if (*p == '+') p++;
+  if (!is_digit(*p)) return NULL;
+
+  size_t value = 0;
+  for (; is_digit(*p); p++) value = value * 10 + (*p - '0');
+  if (*p != '\0' && !is_space(*p)) return NULL;
+  *out = value;
+  return p;
+}
+
+/**
+ * Parse up to count values of the text from begin to end.
+ */
+template <typename T>
+static size_t parse_range(const char* begin, const char* end, T* out,
+                          size_t count,
+                          const char* (*parse)(const char*, T*)) {
+  size_t n = 0;
+  const char* p = begin;
+  while (n < count) {
+    while (p < end && is_space(*p)) p++;
+    if (p >= end) break;
+    p = parse(p, &out[n]);
+    if (!p) break;
+    n++;
+  }
+  return n;
+}
+
+/**
+ * Number of whitespace separated tokens in the text from begin to end.
+ */
+static size_t count_tokens(const char* begin, const char* end) {
+  size_t n = 0;
+  bool in_token = false;
+  for (const char* p = begin; p < end; p++) {
+    bool space = is_space(*p);
+    if (!space && !in_token) n++;
+    in_token = !space;
+  }
+  return n;
+}
+
+template <typename T>
+static size_t parse_array(const char* text, T* out, size_t count,
+                          const char* (*parse)(const char*, T*)) {
+  if (!text || count == 0) return 0;
+
+  size_t length = strlen(text);
+  size_t num_chunks = std::min<size_t>(std::thread::hardware_concurrency(),
+                                       length / min_chunk_bytes);
+  if (length < min_parallel_bytes || num_chunks < 2) {
+    return parse_range(text, text + length, out, count, parse);
+  }
+
+  // split the text at whitespace, so that no number is cut in two
+  std::vector<const char*> bounds(num_chunks + 1);
+  bounds[0] = text;
+  bounds[num_chunks] = text + length;
+  for (size_t i = 1; i < num_chunks; ++i) {
+    const char* p = std::max(text + length * i / num_chunks, bounds[i - 1]);
+    while (*p && !is_space(*p)) p++;
+    bounds[i] = p;
+  }
+
+  // count the numbers of each chunk to know where its values go, then
+  // parse the chunks into their places
+  std::vector<size_t> offsets(num_chunks + 1, 0);
+  std::vector<size_t> parsed(num_chunks, 0);
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < num_chunks; ++i) {
+    threads.push_back(std::thread([&, i]() {
+      offsets[i + 1] = count_tokens(bounds[i], bounds[i + 1]);
+    }));
+  }
+  for (std::thread& t : threads) t.join();
+  threads.clear();
+  for (size_t i = 0; i < num_chunks; ++i) offsets[i + 1] += offsets[i];
+
+  for (size_t i = 0; i < num_chunks; ++i) {
+    if (offsets[i] >= count) break;
+    threads.push_back(std::thread([&, i]() {
+      size_t n = std::min(offsets[i + 1], count) - offsets[i];
+      parsed[i] = parse_range(bounds[i], bounds[i + 1], out + offsets[i], n,
+                              parse);
+    }));
+  }
+  for (std::thread& t : threads) t.join();
+
+  // the values end at the first chunk that stopped early
+  size_t n = 0;
+  for (size_t i = 0; i < threads.size(); ++i) {
+    n += parsed[i];
+    if (offsets[i] + parsed[i] < std::min(offsets[i + 1], count)) break;
+  }
+  return n;
+}
+
+size_t parse_floats(const char* text, float* out, size_t count) {
+  return parse_array(text, out, count, parse_float);
+}
+
+size_t parse_indices(const char* text, size_t* out, size_t count) {
+  return parse_array(text, out, count, parse_index);
+}
+
+}  // namespace Collada
+}  // namespace CMU462
@@ -0,0 +1,36 @@
+#ifndef CMU462_COLLADA_NUMBER_PARSER_H
+#define CMU462_COLLADA_NUMBER_PARSER_H
+
+#include <stddef.h>
+
+namespace CMU462 {
+namespace Collada {
+
+/**
+ * Parse whitespace separated floats, like the text of a <float_array>,
+ * straight from the text into an array. Texts of several megabytes are
+ * split at whitespace and parsed on several threads.
+ * \param text text to parse
+ * \param out array to store the floats
+ * \param count number of floats to parse
+ * \return number of floats parsed, less than count if the text ends early
+ *         or holds something that is not a float
+ */
+size_t parse_floats(const char* text, float* out, size_t count);
+
+/**
+ * Parse whitespace separated non-negative integers, like the text of a <p>
+ * or <vcount>, straight from the text into an array. Texts of several
+ * megabytes are split at whitespace and parsed on several threads.
+ * \param text text to parse
+ * \param out array to store the integers
+ * \param count number of integers to parse
+ * \return number of integers parsed, less than count if the text ends early
+ *         or holds something that is not an integer
+ */
+size_t parse_indices(const char* text, size_t* out, size_t count);
+
+}  // namespace Collada
+}  // namespace CMU462
+
+#endif  // CMU462_COLLADA_NUMBER_PARSER_H
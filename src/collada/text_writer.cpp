@@ -0,0 +1,185 @@
+#include "text_writer.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+namespace CMU462 {
+namespace Collada {
+
+// Size of the buffer, which is written out when full.
+static const size_t buffer_size = 1 << 20;
+
+// Longest text of a number, "-1.23457e-308" or an integer.
+static const size_t max_number_length = 32;
+
+// Powers of ten that are exact in a double.
+static const double powers_of_ten[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+// Distance from halfway below which the rounding of a scaled double is not
+// trusted, many ulps of the at most 1e6 it is rounded at.
+static const double halfway_margin = 1e-6;
+
+/**
+ * Write a finite, positive double with six significant digits, as printf's
+ * %g writes it. The digits are the double scaled by an exact power of ten
+ * and rounded to an integer. The scaling rounds once, so it can only change
+ * the rounding of the digits when the scaled double is within an ulp of
+ * halfway between two integers, and those doubles are left to printf.
+ * \return number of characters written, 0 if the double is too large or
+ *         too small to be scaled exactly, or too close to halfway
+ */
+static size_t format_positive(double value, char* out) {
+  int exponent = (int)floor(log10(value));
+  uint64_t digits = 0;
+  for (int tries = 0; tries < 3; ++tries) {
+    int shift = 5 - exponent;
+    if (shift > 22 || shift < -22) return 0;
+    double scaled = shift >= 0 ? value * powers_of_ten[shift]
+                               : value / powers_of_ten[-shift];
+    double fraction = scaled - floor(scaled);
+    if (fabs(fraction - 0.5) < halfway_margin) return 0;
+    digits = (uint64_t)nearbyint(scaled);
+    if (digits >= 1000000) {
+      exponent++;
+    } else if (digits < 100000) {
+      exponent--;
+    } else {
+      break;
+    }
+  }
+  if (digits < 100000 || digits >= 1000000) return 0;
+
+  // the digits without trailing zeros
+  char d[6];
+  for (int i = 5; i >= 0; --i) {
+    d[i] = '0' + digits % 10;
+    digits /= 10;
+  }
+  int num_digits = 6;
+  while (num_digits > 1 && d[num_digits - 1] == '0') num_digits--;
+
+  char* p = out;
+  if (exponent < -4 || exponent >= 6) {
+    *p++ = d[0];
+    if (num_digits > 1) {
+      *p++ = '.';
+      for (int i = 1; i < num_digits; ++i) *p++ = d[i];
+    }
+    *p++ = 'e';
+    *p++ = exponent < 0 ? '-' : '+';
+    int e = exponent < 0 ? -exponent : exponent;
+    if (e >= 100) *p++ = '0' + e / 100;
+    *p++ = '0' + e / 10 % 10;
+    *p++ = '0' + e % 10;
+  } else if (exponent >= 0) {
+    for (int i = 0; i <= exponent; ++i) *p++ = d[i];
+    if (num_digits > exponent + 1) {
+      *p++ = '.';
+      for (int i = exponent + 1; i < num_digits; ++i) *p++ = d[i];
+    }
+  } else {
+    *p++ = '0';
+    *p++ = '.';
+    for (int i = -1; i > exponent; --i) *p++ = '0';
+    for (int i = 0; i < num_digits; ++i) *p++ = d[i];
+  }
+  return p - out;
+}
+
+TextWriter::TextWriter() : file(NULL), used(0), failed(false) {}
+
+bool TextWriter::open(const char* path) {
+  close();
+  file = fopen(path, "w");
+  if (!file) return false;
+  buffer.resize(buffer_size);
+  used = 0;
+  failed = false;
+  return true;
+}
+
+bool TextWriter::close() {
+  if (!file) return !failed;
+  flush();
+  if (fclose(file) != 0) failed = true;
+  file = NULL;
+  std::vector<char>().swap(buffer);
+  return !failed;
+}
+
+void TextWriter::flush() {
+  if (used && fwrite(buffer.data(), 1, used, file) != used) failed = true;
+  used = 0;
+}
+
+char* TextWriter::reserve(size_t n) {
+  if (used + n > buffer.size()) flush();
+  return buffer.data() + used;
+}
+
+void TextWriter::put(const char* s, size_t n) {
+  if (!file) return;
+  if (n > buffer.size()) {
+    flush();
+    if (fwrite(s, 1, n, file) != n) failed = true;
+    return;
+  }
+  memcpy(reserve(n), s, n);
+  used += n;
+}
+
+TextWriter& TextWriter::operator<<(const char* s) {
+  put(s, strlen(s));
+  return *this;
+}
+
+TextWriter& TextWriter::operator<<(const std::string& s) {
+  put(s.data(), s.size());
+  return *this;
+}
+
+TextWriter& TextWriter::operator<<(char c) {
+  put(&c, 1);
+  return *this;
+}
+
+TextWriter& TextWriter::operator<<(double value) {
+  if (!file) return *this;
+  char* out = reserve(max_number_length);
+  size_t n = 0;
+  if (value == 0) {
+    if (signbit(value)) out[n++] = '-';
+    out[n++] = '0';
+  } else if (isfinite(value)) {
+    if (value < 0) out[n++] = '-';
+    size_t length = format_positive(fabs(value), out + n);
+    n = length ? n + length : snprintf(out, max_number_length, "%g", value);
+  } else {
+    n = snprintf(out, max_number_length, "%g", value);
+  }
+  used += n;
+  return *this;
+}
+
+TextWriter& TextWriter::put_signed(long long value) {
+  if (value >= 0) return put_unsigned(value);
+  put("-", 1);
+  return put_unsigned(0ULL - (unsigned long long)value);
+}
+
+TextWriter& TextWriter::put_unsigned(unsigned long long value) {
+  char digits[max_number_length];
+  char* p = digits + max_number_length;
+  do {
+    *--p = '0' + value % 10;
+    value /= 10;
+  } while (value);
+  put(p, digits + max_number_length - p);
+  return *this;
+}
+
+}  // namespace Collada
+}  // namespace CMU462
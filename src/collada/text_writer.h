@@ -0,0 +1,73 @@
+#ifndef CMU462_COLLADA_TEXT_WRITER_H
+#define CMU462_COLLADA_TEXT_WRITER_H
+
+#include <stdio.h>
+
+#include <string>
+#include <vector>
+
+namespace CMU462 {
+namespace Collada {
+
+/**
+ * Writes text to a file through a large buffer, for files of millions of
+ * numbers. Unlike an ofstream, nothing is flushed until the buffer is full,
+ * and numbers are formatted without locales or stream state. Doubles are
+ * written as an ofstream writes them by default, like printf's %g.
+ */
+class TextWriter {
+ public:
+  TextWriter();
+  ~TextWriter() { close(); }
+
+  /**
+   * Open a file for writing, truncating it.
+   * \return false if the file could not be opened
+   */
+  bool open(const char* path);
+
+  /**
+   * Write what is left in the buffer and close the file.
+   * \return false if any write failed
+   */
+  bool close();
+
+  TextWriter& operator<<(const char* s);
+  TextWriter& operator<<(const std::string& s);
+  TextWriter& operator<<(char c);
+  TextWriter& operator<<(double value);
+  TextWriter& operator<<(int value) { return put_signed(value); }
+  TextWriter& operator<<(long value) { return put_signed(value); }
+  TextWriter& operator<<(long long value) { return put_signed(value); }
+  TextWriter& operator<<(unsigned value) { return put_unsigned(value); }
+  TextWriter& operator<<(unsigned long value) { return put_unsigned(value); }
+  TextWriter& operator<<(unsigned long long value) {
+    return put_unsigned(value);
+  }
+
+ private:
+  TextWriter(const TextWriter&);             // not supported
+  TextWriter& operator=(const TextWriter&);  // not supported
+
+  TextWriter& put_signed(long long value);
+  TextWriter& put_unsigned(unsigned long long value);
+
+  /**
+   * Room for n more characters at the end of the buffer, writing the
+   * buffer out first if it is too full.
+   */
+  char* reserve(size_t n);
+
+  void put(const char* s, size_t n);
+  void flush();
+
+  FILE* file;
+  std::vector<char> buffer;
+  size_t used;  ///< characters in the buffer
+  bool failed;  ///< if a write failed
+};
+
+}  // namespace Collada
+}  // namespace CMU462
+
+#endif  // CMU462_COLLADA_TEXT_WRITER_H
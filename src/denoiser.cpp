@@ -0,0 +1,135 @@
+#include "denoiser.h"
+
+#include <cmath>
+#include <thread>
+#include <algorithm>
+
+#include "CMU462/timer.h"
+
+namespace CMU462 {
+
+// B3 spline kernel, indexed by the absolute tap offset
+static const float kernel[3] = {3.f / 8.f, 1.f / 4.f, 1.f / 16.f};
+
+Denoiser::Denoiser()
+    : num_passes(5),
+      sigma_color(1.f),
+      sigma_albedo(0.1f),
+      sigma_normal(0.3f),
+      sigma_depth(0.05f),
+      w(0),
+      h(0) {}
+
+void Denoiser::denoise(const HDRImageBuffer& input,
+                       const HDRImageBuffer& albedo,
+                       const std::vector<Vector3D>& normal,
+                       const std::vector<float>& depth, HDRImageBuffer& output,
+                       size_t num_threads) {
+  w = input.w;
+  h = input.h;
+  size_t num_pixels = w * h;
+
+  // split the buffers into planes
+  for (int c = 0; c < 3; ++c) {
+    src[c].resize(num_pixels);
+    dst[c].resize(num_pixels);
+    this->albedo[c].resize(num_pixels);
+    this->normal[c].resize(num_pixels);
+  }
+  this->depth.assign(depth.begin(), depth.end());
+  for (size_t i = 0; i < num_pixels; ++i) {
+    src[0][i] = input.data[i].r;
+    src[1][i] = input.data[i].g;
+    src[2][i] = input.data[i].b;
+    this->albedo[0][i] = albedo.data[i].r;
+    this->albedo[1][i] = albedo.data[i].g;
+    this->albedo[2][i] = albedo.data[i].b;
+    this->normal[0][i] = normal[i].x;
+    this->normal[1][i] = normal[i].y;
+    this->normal[2][i] = normal[i].z;
+  }
+
+  num_threads = std::max<size_t>(1, std::min(num_threads, h));
+  size_t rows = (h + num_threads - 1) / num_threads;
+  std::vector<std::thread> threads(num_threads);
+
+  Timer timer;
+  float sigma_c = sigma_color;
+  for (size_t pass = 0; pass < num_passes; ++pass) {
+    int step = 1 << pass;
+    fprintf(stdout, "[PathTracer] Denoising, pass %zu (step %d)... ",
+            pass + 1, step);
+    fflush(stdout);
+    timer.start();
+
+    for (size_t t = 0; t < num_threads; ++t) {
+      size_t y0 = std::min(h, t * rows);
+      size_t y1 = std::min(h, y0 + rows);
+      threads[t] = std::thread(&Denoiser::filter_rows, this, step, sigma_c,
+                               y0, y1);
+    }
+    for (std::thread& t : threads) t.join();
+    for (int c = 0; c < 3; ++c) src[c].swap(dst[c]);
+    sigma_c *= 0.5f;
+
+    timer.stop();
+    fprintf(stdout, "Done! (%.4f sec)\n", timer.duration());
+  }
+
+  output.resize(w, h);
+  for (size_t i = 0; i < num_pixels; ++i) {
+    output.data[i] = Spectrum(src[0][i], src[1][i], src[2][i]);
+  }
+}
+
+void Denoiser::filter_rows(int step, float sigma_c, size_t y0, size_t y1) {
+  float inv_c = 1.f / (sigma_c * sigma_c);
+  float inv_a = 1.f / (sigma_albedo * sigma_albedo);
+  float inv_n = 1.f / (sigma_normal * sigma_normal);
+  float inv_z = 1.f / sigma_depth;
+
+  for (size_t y = y0; y < y1; ++y) {
+    for (size_t x = 0; x < w; ++x) {
+      size_t p = x + y * w;
+      float sum_w = 0.f;
+      float sum[3] = {0.f, 0.f, 0.f};
+      float z_scale = inv_z / std::max(depth[p], 1e-4f);
+
+      for (int j = -2; j <= 2; ++j) {
+        long qy = (long)y + j * step;
+        if (qy < 0 || qy >= (long)h) continue;
+        for (int i = -2; i <= 2; ++i) {
+          long qx = (long)x + i * step;
+          if (qx < 0 || qx >= (long)w) continue;
+          size_t q = qx + qy * w;
+
+          // colors are compared after mapping them to [0,1) with x/(1+x),
+          // so that a few very bright samples cannot keep a pixel from
+          // being averaged with its neighbors
+          float dc = 0.f, da = 0.f, dn = 0.f;
+          for (int c = 0; c < 3; ++c) {
+            float d = src[c][q] / (1.f + src[c][q]) -
+                      src[c][p] / (1.f + src[c][p]);
+            dc += d * d;
+            d = albedo[c][q] - albedo[c][p];
+            da += d * d;
+            d = normal[c][q] - normal[c][p];
+            dn += d * d;
+          }
+          float dz = std::fabs(depth[q] - depth[p]) * z_scale;
+
+          float wq = kernel[std::abs(i)] * kernel[std::abs(j)] *
+                     std::exp(-dc * inv_c - da * inv_a - dn * inv_n - dz);
+          sum_w += wq;
+          for (int c = 0; c < 3; ++c) sum[c] += wq * src[c][q];
+        }
+      }
+
+      // the center tap differs from itself in nothing, so its weight is
+      // kernel[0] squared, 9/64, and sum_w is never zero
+      for (int c = 0; c < 3; ++c) dst[c][p] = sum[c] / sum_w;
+    }
+  }
+}
+
+}  // namespace CMU462
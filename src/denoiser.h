@@ -0,0 +1,73 @@
+#ifndef CMU462_DENOISER_H
+#define CMU462_DENOISER_H
+
+#include <vector>
+
+#include "CMU462/vector3D.h"
+
+#include "image.h"
+
+namespace CMU462 {
+
+/**
+ * Edge-avoiding a-trous wavelet denoiser (Dammertz et al. 2010).
+ * The noisy radiance is smoothed by repeated passes of a 5x5 B3 spline
+ * kernel whose taps are spread 2^i pixels apart on pass i, so the footprint
+ * grows exponentially while every pass stays 25 taps. Each tap is weighted
+ * down by how much its color, albedo, normal and depth differ from the
+ * center pixel, which keeps the filter from blurring across geometric and
+ * texture edges. The features are the first hit of the camera rays averaged
+ * over the pixel, so they are almost free of noise.
+ *
+ * Internally the images are kept as separate float planes, one per channel,
+ * so the inner loops stream through contiguous memory.
+ */
+class Denoiser {
+ public:
+  /**
+   * Default constructor.
+   * Creates a denoiser with parameters that suit the path tracer's previews.
+   */
+  Denoiser();
+
+  /**
+   * Denoise an image. All the buffers are the size of the input.
+   * \param input noisy radiance
+   * \param albedo first hit albedo
+   * \param normal first hit world space normal
+   * \param depth first hit distance along the camera ray
+   * \param output buffer to store the filtered radiance in
+   * \param num_threads number of threads each pass is split over
+   */
+  void denoise(const HDRImageBuffer& input, const HDRImageBuffer& albedo,
+               const std::vector<Vector3D>& normal,
+               const std::vector<float>& depth, HDRImageBuffer& output,
+               size_t num_threads);
+
+  size_t num_passes;   ///< number of passes, the footprint doubles each pass
+  float sigma_color;   ///< color tolerance, halved after every pass
+  float sigma_albedo;  ///< albedo tolerance
+  float sigma_normal;  ///< normal tolerance
+  float sigma_depth;   ///< depth tolerance, relative to the center depth
+
+ private:
+  /**
+   * Run one pass over the rows [y0, y1) of the image.
+   * \param step distance between the taps of the kernel
+   * \param sigma_c color tolerance of this pass
+   */
+  void filter_rows(int step, float sigma_c, size_t y0, size_t y1);
+
+  size_t w;  ///< width of the image being filtered
+  size_t h;  ///< height of the image being filtered
+
+  std::vector<float> src[3];     ///< color planes read by the current pass
+  std::vector<float> dst[3];     ///< color planes written by the current pass
+  std::vector<float> albedo[3];  ///< albedo planes
+  std::vector<float> normal[3];  ///< normal planes
+  std::vector<float> depth;      ///< depth plane
+};
+
+}  // namespace CMU462
+
+#endif  // CMU462_DENOISER_H
@@ -0,0 +1,80 @@
+#ifndef CMU462_DYNAMICSCENE_BAKED_MESH_H
+#define CMU462_DYNAMICSCENE_BAKED_MESH_H
+
+#include <stdint.h>
+
+#include "scene.h"
+#include "../static_scene/object.h"
+
+namespace CMU462 {
+namespace DynamicScene {
+
+/**
+ * A mesh that can only be rendered. It holds the triangles of a binary scene
+ * file as they were saved, ready for the path tracer, and has no halfedge
+ * mesh, so it cannot be drawn or edited. Scenes that are loaded only to be
+ * rendered use it to skip building halfedge meshes.
+ */
+class BakedMesh : public SceneObject {
+ public:
+  /**
+   * Constructor. The arrays are not copied and must outlive the mesh and
+   * the static meshes made from it.
+   * \param positions world-space vertex positions
+   * \param normals vertex normals
+   * \param texcoords vertex texture coordinates, NULL if the mesh has none
+   * \param num_vertices size of the vertex arrays
+   * \param indices vertex indices, three per triangle
+   * \param num_indices size of the index array
+   * \param bsdf BSDF of the surface material
+   */
+  BakedMesh(Vector3D* positions, Vector3D* normals, Vector2D* texcoords,
+            size_t num_vertices, const uint64_t* indices, size_t num_indices,
+            BSDF* bsdf)
+      : positions(positions),
+        normals(normals),
+        texcoords(texcoords),
+        num_vertices(num_vertices),
+        indices(indices),
+        num_indices(num_indices),
+        bsdf(bsdf) {
+    for (size_t i = 0; i < num_vertices; ++i) bbox.expand(positions[i]);
+  }
+
+  void set_draw_styles(DrawStyle* defaultStyle, DrawStyle* hoveredStyle,
+                       DrawStyle* selectedStyle) {}
+  void draw() {}
+  BBox get_bbox() { return bbox; }
+
+  Info getInfo() {
+    Info info;
+    info.push_back("BAKED MESH");
+    return info;
+  }
+
+  void drag(double x, double y, double dx, double dy,
+            const Matrix4x4& modelViewProj) {}
+
+  StaticScene::SceneObject* get_static_object() {
+    return new StaticScene::Mesh(positions, normals, texcoords, num_vertices,
+                                 indices, num_indices, bsdf);
+  }
+
+  void draw_pick(int& pickID, bool transformed = false) {}
+  void setSelection(int pickID, Selection& selection) {}
+
+ private:
+  Vector3D* positions;
+  Vector3D* normals;
+  Vector2D* texcoords;
+  size_t num_vertices;
+  const uint64_t* indices;
+  size_t num_indices;
+  BSDF* bsdf;
+  BBox bbox;
+};
+
+}  // namespace DynamicScene
+}  // namespace CMU462
+
+#endif  // CMU462_DYNAMICSCENE_BAKED_MESH_H
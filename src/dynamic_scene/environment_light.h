@@ -2,7 +2,7 @@
 #define CMU462_DYNAMICSCENE_ENVIRONMENTLIGHT_H
 
 #include "scene.h"
-#include "../image.h"
+#include "../environment_map.h"
 #include "../static_scene/light.h"
 
 namespace CMU462 {
@@ -10,7 +10,7 @@ namespace DynamicScene {
 
 class EnvironmentLight : public SceneLight {
  public:
-  EnvironmentLight(HDRImageBuffer* envmap) : envmap(envmap) {}
+  EnvironmentLight(EnvironmentMap* envmap) : envmap(envmap) {}
 
   StaticScene::SceneLight* get_static_light() const {
     StaticScene::EnvironmentLight* l =
@@ -19,7 +19,7 @@ class EnvironmentLight : public SceneLight {
   }
 
  private:
-  HDRImageBuffer* envmap;
+  EnvironmentMap* envmap;
 };
 
 }  // namespace DynamicScene
@@ -22,8 +22,13 @@ bool Mesh::flip_normals = false;
 RenderMask Mesh::global_render_mask = ALL; 
 
 Mesh::Mesh(Collada::PolymeshInfo &polyMesh, const Matrix4x4 &transform) {
+  build(polyMesh, transform);
+}
+
+void Mesh::build(Collada::PolymeshInfo &polyMesh, const Matrix4x4 &transform) {
   // Build halfedge mesh from polygon soup
   vector<vector<size_t>> polygons;
+  polygons.reserve(polyMesh.polygons.size());
   for (const Collada::Polygon &p : polyMesh.polygons) {
     polygons.push_back(p.vertex_indices);
   }
@@ -32,13 +37,42 @@ Mesh::Mesh(Collada::PolymeshInfo &polyMesh, const Matrix4x4 &transform) {
     vertices[i] = (transform * Vector4D(vertices[i], 1)).projectTo3D();
   }
 
-  mesh.build(polygons, vertices);
+  // Texture coordinates are only kept when every polygon has one per vertex
+  vector<vector<Vector2D>> texcoords;
+  if (!polyMesh.texcoords.empty()) {
+    texcoords.reserve(polyMesh.polygons.size());
+    for (const Collada::Polygon &p : polyMesh.polygons) {
+      if (p.texcoord_indices.size() != p.vertex_indices.size()) {
+        texcoords.clear();
+        break;
+      }
+      texcoords.push_back(vector<Vector2D>());
+      for (size_t i : p.texcoord_indices) {
+        texcoords.back().push_back(i < polyMesh.texcoords.size()
+                                       ? polyMesh.texcoords[i]
+                                       : Vector2D());
+      }
+    }
+  }
+
+  mesh.build(polygons, vertices, texcoords);
   if (polyMesh.material) {
-    bsdf = polyMesh.material->bsdf;
+    init(polyMesh.material->bsdf);
   } else {
     //      bsdf = new DiffuseBSDF(Spectrum(0.5f,0.5f,0.5f));
-    bsdf = new DiffuseBSDF(Spectrum(1., 1., 1.));
+    init(new DiffuseBSDF(Spectrum(1., 1., 1.)));
   }
+}
+
+Mesh::Mesh(const vector<vector<size_t>> &polygons,
+           const vector<Vector3D> &vertices, BSDF *bsdf,
+           const vector<vector<Vector2D>> &texcoords) {
+  mesh.build(polygons, vertices, texcoords);
+  init(bsdf);
+}
+
+void Mesh::init(BSDF *bsdf) {
+  this->bsdf = bsdf;
 
   scale = Vector3D(1., 1., 1.);
   scales.setValue(0, scale);
@@ -31,6 +31,28 @@ class Mesh : public SceneObject {
  public:
   Mesh(Collada::PolymeshInfo &polyMesh, const Matrix4x4 &transform);
 
+  /**
+   * Make a mesh that is built later with build. Scenes allocate their meshes
+   * in order on one thread this way, and build them on several.
+   */
+  Mesh() {}
+
+  /**
+   * Build the mesh from a polygon mesh of a scene description, placed by the
+   * given transformation. Meshes being built share no data, so different
+   * meshes can be built at once.
+   */
+  void build(Collada::PolymeshInfo &polyMesh, const Matrix4x4 &transform);
+
+  /**
+   * Build a mesh from polygons whose vertices are already in world space, as
+   * a binary scene file stores them, with the texture coordinates of their
+   * vertices if the mesh has them.
+   */
+  Mesh(const vector<vector<size_t>> &polygons,
+       const vector<Vector3D> &vertices, BSDF *bsdf,
+       const vector<vector<Vector2D>> &texcoords = vector<vector<Vector2D>>());
+
   ~Mesh();
 
   void set_draw_styles(DrawStyle *defaultStyle, DrawStyle *hoveredStyle,
@@ -109,6 +131,9 @@ class Mesh : public SceneObject {
   void draw_halfedge_arrow(const Halfedge *h) const;
   DrawStyle *get_draw_style(const HalfedgeElement *element) const;
 
+  // Sets up everything but the halfedge mesh, shared by the constructors.
+  void init(BSDF *bsdf);
+
   void check_finite_positions();
   bool alreadyCheckingPositions;
 
@@ -1,6 +1,7 @@
 #ifndef CMU462_DYNAMICSCENE_SCENE_H
 #define CMU462_DYNAMICSCENE_SCENE_H
 
+#include <atomic>
 #include <string>
 #include <vector>
 #include <set>
@@ -19,6 +20,7 @@
 #include "../halfEdgeMesh.h"
 #include "../spline.h"
 #include "../timeline.h"
+#include "../collada/light_info.h"
 
 namespace CMU462 {
 namespace DynamicScene {
@@ -37,7 +39,11 @@ class XFormWidget;
 class SceneObject {
  public:
   SceneObject()
-      : scene(NULL), isVisible(true), isGhosted(false), isPickable(true) {}
+      : scene(NULL),
+        isVisible(true),
+        isGhosted(false),
+        isPickable(true),
+        serial(next_serial++) {}
 
   /**
    * Passes in logic for how to render the object in OpenGL.
@@ -146,6 +152,32 @@ class SceneObject {
    * Is this object pickable right now?
    */
   bool isPickable;
+
+  /**
+   * Number of objects made before this one. Scenes keep their objects in
+   * this order, so the order does not depend on where, or on which thread,
+   * the objects were allocated.
+   */
+  size_t serial;
+
+  /**
+   * Number the object as if it were made now, for objects made on other
+   * threads, which the loading thread numbers again in scene order.
+   */
+  void renumber() { serial = next_serial++; }
+
+ private:
+  static std::atomic<size_t> next_serial;
+};
+
+/**
+ * Orders scene objects by when they were made.
+ */
+struct SceneObjectOrder {
+  bool operator()(const SceneObject *a, const SceneObject *b) const {
+    if (a->serial != b->serial) return a->serial < b->serial;
+    return a < b;
+  }
 };
 
 // A Selection stores information about any object or widget that is
@@ -187,6 +219,11 @@ class Selection {
 class SceneLight {
  public:
   virtual StaticScene::SceneLight *get_static_light() const = 0;
+
+  // The description and transformation the light was made from, kept so
+  // that the scene can be saved
+  Collada::LightInfo info;
+  Matrix4x4 transform;
 };
 
 /**
@@ -317,7 +354,7 @@ class Scene {
    */
   void clearSelections();
 
-  std::set<SceneObject *> objects;
+  std::set<SceneObject *, SceneObjectOrder> objects;
   std::set<SceneLight *> lights;
 
  private:
@@ -34,6 +34,9 @@ class Sphere : public SceneObject {
   BSDF* get_bsdf();
   StaticScene::SceneObject* get_static_object();
 
+  const Vector3D& get_center() const { return p; }
+  double get_radius() const { return r; }
+
   /**
    * Rather than drawing the object geometry for display, this method draws the
    * object with unique colors that can be used to determine which object was
@@ -0,0 +1,194 @@
+#include "environment_map.h"
+
+#include <math.h>
+
+#include <algorithm>
+#include <iostream>
+
+#include "CMU462/misc.h"
+#include "CMU462/tinyexr.h"
+
+using namespace std;
+
+namespace CMU462 {
+
+EnvironmentMap* EnvironmentMap::load(const char* path) {
+  const char* err;
+
+  EXRImage exr;
+  InitEXRImage(&exr);
+
+  int ret = ParseMultiChannelEXRHeaderFromFile(&exr, path, &err);
+  if (ret != 0) {
+    cerr << "[Scotty3D] Error parsing OpenEXR file: " << err << endl;
+    return NULL;
+  }
+
+  for (int i = 0; i < exr.num_channels; i++) {
+    if (exr.pixel_types[i] == TINYEXR_PIXELTYPE_HALF) {
+      exr.requested_pixel_types[i] = TINYEXR_PIXELTYPE_FLOAT;
+    }
+  }
+
+  EnvironmentMap* map = new EnvironmentMap();
+  string file_path = path;
+  map->loaded = async(launch::async, [map, exr, file_path]() mutable {
+    const char* err;
+    int ret = LoadMultiChannelEXRFromFile(&exr, file_path.c_str(), &err);
+    if (ret != 0) {
+      cerr << "[Scotty3D] Error loading OpenEXR file: " << err << endl;
+      return false;
+    }
+
+    map->levels.resize(1);
+    HDRImageBuffer& image = map->levels[0];
+    image.resize(exr.width, exr.height);
+    float* channel_r = (float*)exr.images[2];
+    float* channel_g = (float*)exr.images[1];
+    float* channel_b = (float*)exr.images[0];
+    for (size_t i = 0; i < image.w * image.h; i++) {
+      image.data[i] = Spectrum(channel_r[i], channel_g[i], channel_b[i]);
+    }
+    FreeEXRImage(&exr);
+
+    map->build_pyramid();
+    map->build_distribution();
+    return true;
+  }).share();
+  return map;
+}
+
+/**
+ * Shrink n rows of an image to size texels each, averaging the texels each
+ * new texel covers, weighted by how much of them it covers.
+ * \param in rows of the image, stride apart, each step texels after the
+ *        one before
+ * \param out rows of the shrunk image, in the same layout
+ */
+static void shrink(const Spectrum* in, size_t in_size, size_t in_step,
+                   size_t in_stride, Spectrum* out, size_t out_size,
+                   size_t out_step, size_t out_stride, size_t n) {
+  double ratio = (double)in_size / out_size;
+  for (size_t i = 0; i < out_size; i++) {
+    double start = i * ratio, end = (i + 1) * ratio;
+    for (size_t row = 0; row < n; row++) {
+      Spectrum sum;
+      for (size_t j = (size_t)start; j < end && j < in_size; j++) {
+        double cover = min(end, j + 1.0) - max(start, (double)j);
+        sum += in[row * in_stride + j * in_step] * (float)(cover / ratio);
+      }
+      out[row * out_stride + i * out_step] = sum;
+    }
+  }
+}
+
+void EnvironmentMap::build_pyramid() {
+  // Each level is half the size of the one before, rounded down, and each of
+  // its texels the average of the area it covers in the level before, so
+  // that all levels keep the average of the map.
+  while (levels.back().w > 1 || levels.back().h > 1) {
+    const HDRImageBuffer& fine = levels.back();
+    size_t w = max<size_t>(fine.w / 2, 1), h = max<size_t>(fine.h / 2, 1);
+    HDRImageBuffer narrow(w, fine.h), coarse(w, h);
+    shrink(fine.data.data(), fine.w, 1, fine.w, narrow.data.data(), w, 1, w,
+           fine.h);
+    shrink(narrow.data.data(), fine.h, w, 1, coarse.data.data(), h, w, 1, w);
+    levels.push_back(std::move(coarse));
+  }
+}
+
+void EnvironmentMap::build_distribution() {
+  size_t l = 0;
+  while (levels[l].w > max_distribution_width) l++;
+  const HDRImageBuffer& image = levels[l];
+  dist_w = image.w;
+  dist_h = image.h;
+
+  // Rows are weighed by the sine of their polar angle, the area their texels
+  // cover on the sphere. The cdfs are summed in double and normalized, and a
+  // row or map without power is sampled uniformly.
+  marginal.assign(dist_h + 1, 0);
+  conditional.assign((dist_w + 1) * dist_h, 0);
+  vector<double> row_power(dist_h);
+  double total = 0;
+  for (size_t y = 0; y < dist_h; y++) {
+    double sin_theta = sin(PI * (y + 0.5) / dist_h);
+    float* cdf = &conditional[y * (dist_w + 1)];
+    double sum = 0;
+    for (size_t x = 0; x < dist_w; x++) {
+      sum += max(image.data[x + y * dist_w].illum(), 0.f) * sin_theta;
+      cdf[x + 1] = sum;
+    }
+    for (size_t x = 1; x < dist_w; x++) {
+      cdf[x] = sum > 0 ? cdf[x] / sum : (double)x / dist_w;
+    }
+    cdf[dist_w] = 1;
+    row_power[y] = sum;
+    total += sum;
+  }
+  double sum = 0;
+  for (size_t y = 0; y < dist_h; y++) {
+    sum += total > 0 ? row_power[y] / total : 1.0 / dist_h;
+    marginal[y + 1] = sum;
+  }
+  marginal[dist_h] = 1;
+}
+
+Spectrum EnvironmentMap::lookup_level(const HDRImageBuffer& image, double u,
+                                      double v) const {
+  double s = (u - floor(u)) * image.w - 0.5;
+  double t = clamp(v, 0.0, 1.0) * image.h - 0.5;
+  double fs = floor(s), ft = floor(t);
+  float a = s - fs, b = t - ft;
+
+  long w = image.w, h = image.h;
+  long x0 = ((long)fs % w + w) % w, x1 = (x0 + 1) % w;
+  long y0 = max(0L, (long)ft), y1 = min(h - 1, (long)ft + 1);
+
+  const Spectrum* row0 = &image.data[y0 * w];
+  const Spectrum* row1 = &image.data[y1 * w];
+  return (row0[x0] * (1 - a) + row0[x1] * a) * (1 - b) +
+         (row1[x0] * (1 - a) + row1[x1] * a) * b;
+}
+
+Spectrum EnvironmentMap::lookup(double u, double v, double level) const {
+  level = clamp(level, 0.0, (double)levels.size() - 1);
+  size_t l = (size_t)level;
+  float f = level - l;
+  Spectrum c = lookup_level(levels[l], u, v);
+  if (f == 0) return c;
+  return c * (1 - f) + lookup_level(levels[l + 1], u, v) * f;
+}
+
+double EnvironmentMap::level_for_solid_angle(double solid_angle) const {
+  // each texel of the first level covers 4 pi / (w h) on average, and the
+  // texels of each level cover four times those of the level before
+  const HDRImageBuffer& image = levels[0];
+  double texel = 4 * PI / (image.w * image.h);
+  double level = 0.5 * log2(max(solid_angle / texel, 1.0));
+  return min(level, (double)levels.size() - 1);
+}
+
+double EnvironmentMap::sample(double r1, double r2, double* u,
+                              double* v) const {
+  size_t y = upper_bound(marginal.begin() + 1, marginal.end() - 1, r1) -
+             marginal.begin() - 1;
+  const float* cdf = &conditional[y * (dist_w + 1)];
+  size_t x = upper_bound(cdf + 1, cdf + dist_w, r2) - cdf - 1;
+
+  double py = marginal[y + 1] - marginal[y];
+  double px = cdf[x + 1] - cdf[x];
+  *v = (y + clamp((r1 - marginal[y]) / py, 0.0, 1.0)) / dist_h;
+  *u = (x + clamp((r2 - cdf[x]) / px, 0.0, 1.0)) / dist_w;
+  return py * px * dist_w * dist_h;
+}
+
+double EnvironmentMap::pdf(double u, double v) const {
+  size_t x = min((size_t)((u - floor(u)) * dist_w), dist_w - 1);
+  size_t y = min((size_t)(clamp(v, 0.0, 1.0) * dist_h), dist_h - 1);
+  const float* cdf = &conditional[y * (dist_w + 1)];
+  return (marginal[y + 1] - marginal[y]) * (cdf[x + 1] - cdf[x]) * dist_w *
+         dist_h;
+}
+
+}  // namespace CMU462
@@ -0,0 +1,121 @@
+#ifndef CMU462_ENVIRONMENT_MAP_H
+#define CMU462_ENVIRONMENT_MAP_H
+
+#include <future>
+#include <vector>
+
+#include "CMU462/spectrum.h"
+
+#include "image.h"
+
+namespace CMU462 {
+
+/**
+ * An environment map in latitude-longitude layout, with u along the width,
+ * wrapping around, and v along the height, v = 0 being the first row of the
+ * image. The OpenEXR file is decoded on a background thread, so that the
+ * scene loads and its BVH builds meanwhile, and one map is shared by all the
+ * path tracers rendering with it. Besides the image it keeps
+ * - a pyramid of prefiltered levels, each half the size of the one before,
+ *   for lookups that stand for more than a texel, e.g. after rough bounces,
+ * - the distribution for importance sampling the map by power, computed once
+ *   for all the lights using the map.
+ */
+class EnvironmentMap {
+ public:
+  /**
+   * Start loading an OpenEXR file. Only its header is read before returning,
+   * the pixels are loaded on a background thread.
+   * \param path path of the file
+   * \return the map, NULL if the file is not an OpenEXR file
+   */
+  static EnvironmentMap* load(const char* path);
+
+  /**
+   * Destructor. Waits for the map to load.
+   */
+  ~EnvironmentMap() { wait(); }
+
+  /**
+   * Wait for the map to load. The map may only be used after, and only if
+   * it loaded.
+   * \return false if the pixels could not be loaded
+   */
+  bool wait() const { return loaded.get(); }
+
+  /**
+   * Number of levels of the pyramid, the last one being a single texel.
+   */
+  size_t num_levels() const { return levels.size(); }
+
+  /**
+   * Level of the pyramid, 0 for the full resolution image.
+   */
+  const HDRImageBuffer& level(size_t i) const { return levels[i]; }
+
+  /**
+   * Bilinear lookup in the pyramid, blending two levels when the level is
+   * fractional.
+   * \param u horizontal coordinate, wraps around
+   * \param v vertical coordinate, clamped to [0, 1]
+   * \param level level to look up, clamped to the levels of the pyramid
+   */
+  Spectrum lookup(double u, double v, double level = 0) const;
+
+  /**
+   * Level whose texels cover the given solid angle, for a lookup standing
+   * for a cone of directions, e.g. the lobe of a rough BSDF.
+   */
+  double level_for_solid_angle(double solid_angle) const;
+
+  /**
+   * Draw a point of the map with probability proportional to its power, the
+   * illuminance of its texel times the sine of its polar angle. The
+   * distribution is computed on the largest level at most
+   * max_distribution_width texels wide.
+   * \param r1 uniform random number in [0, 1) choosing the row
+   * \param r2 uniform random number in [0, 1) choosing the column
+   * \param u horizontal coordinate of the point drawn
+   * \param v vertical coordinate of the point drawn
+   * \return density of the point over the unit square of (u, v), which is
+   *         the density over solid angle times 2 pi^2 sin(theta)
+   */
+  double sample(double r1, double r2, double* u, double* v) const;
+
+  /**
+   * Density of drawing the point (u, v) with sample.
+   */
+  double pdf(double u, double v) const;
+
+  static const size_t max_distribution_width = 2048;
+
+ private:
+  EnvironmentMap() : dist_w(0), dist_h(0) {}
+  EnvironmentMap(const EnvironmentMap&);             // not supported
+  EnvironmentMap& operator=(const EnvironmentMap&);  // not supported
+
+  /**
+   * Build the levels after the first and the distribution.
+   */
+  void build_pyramid();
+  void build_distribution();
+
+  /**
+   * Bilinear lookup in a single level.
+   */
+  Spectrum lookup_level(const HDRImageBuffer& image, double u, double v) const;
+
+  std::shared_future<bool> loaded;  ///< ready when the map is loaded,
+                                    ///< false if it failed to load
+  std::vector<HDRImageBuffer> levels;
+
+  size_t dist_w;  ///< width of the level the distribution is over
+  size_t dist_h;  ///< height of the level the distribution is over
+  std::vector<float> marginal;  ///< cdf of the rows, dist_h + 1 entries
+  std::vector<float> conditional;  ///< cdf of each row, dist_w + 1 entries
+                                   ///< per row
+};
+
+}  // namespace CMU462
+
+#endif  // CMU462_ENVIRONMENT_MAP_H
@@ -0,0 +1,83 @@
+#include "exr_writer.h"
+
+#include <algorithm>
+
+#include "CMU462/tinyexr.h"
+
+namespace CMU462 {
+
+std::vector<float>& EXRWriter::add_channel(const std::string& name) {
+  channels.push_back(std::make_pair(name, std::vector<float>(w * h)));
+  return channels.back().second;
+}
+
+void EXRWriter::add_rgb(const std::string& layer,
+                        const HDRImageBuffer& image) {
+  std::string prefix = layer.empty() ? "" : layer + ".";
+  std::vector<float>& r = add_channel(prefix + "R");
+  std::vector<float>& g = add_channel(prefix + "G");
+  std::vector<float>& b = add_channel(prefix + "B");
+  for (size_t i = 0; i < w * h; ++i) {
+    const Spectrum& s = image.data[flip(i)];
+    r[i] = s.r, g[i] = s.g, b[i] = s.b;
+  }
+}
+
+void EXRWriter::add_xyz(const std::string& layer,
+                        const std::vector<Vector3D>& image) {
+  std::vector<float>& x = add_channel(layer + ".X");
+  std::vector<float>& y = add_channel(layer + ".Y");
+  std::vector<float>& z = add_channel(layer + ".Z");
+  for (size_t i = 0; i < w * h; ++i) {
+    const Vector3D& v = image[flip(i)];
+    x[i] = v.x, y[i] = v.y, z[i] = v.z;
+  }
+}
+
+void EXRWriter::add_scalar(const std::string& name,
+                           const std::vector<float>& image) {
+  std::vector<float>& c = add_channel(name);
+  for (size_t i = 0; i < w * h; ++i) c[i] = image[flip(i)];
+}
+
+bool EXRWriter::write(const std::string& filename) const {
+  std::vector<const std::pair<std::string, std::vector<float> >*> sorted;
+  for (const auto& channel : channels) sorted.push_back(&channel);
+  std::sort(sorted.begin(), sorted.end(),
+            [](const std::pair<std::string, std::vector<float> >* a,
+               const std::pair<std::string, std::vector<float> >* b) {
+              return a->first < b->first;
+            });
+
+  int num_channels = sorted.size();
+  std::vector<const char*> names(num_channels);
+  std::vector<unsigned char*> images(num_channels);
+  std::vector<int> pixel_types(num_channels, TINYEXR_PIXELTYPE_FLOAT);
+  std::vector<int> requested_pixel_types(
+      num_channels,
+      type == HALF ? TINYEXR_PIXELTYPE_HALF : TINYEXR_PIXELTYPE_FLOAT);
+  for (int c = 0; c < num_channels; ++c) {
+    names[c] = sorted[c]->first.c_str();
+    images[c] = (unsigned char*)&sorted[c]->second[0];
+  }
+
+  EXRImage exr;
+  InitEXRImage(&exr);
+  exr.num_channels = num_channels;
+  exr.channel_names = &names[0];
+  exr.images = &images[0];
+  exr.pixel_types = &pixel_types[0];
+  exr.requested_pixel_types = &requested_pixel_types[0];
+  exr.width = w;
+  exr.height = h;
+
+  const char* err;
+  if (SaveMultiChannelEXRToFile(&exr, filename.c_str(), &err) != 0) {
+    fprintf(stderr, "Error writing OpenEXR file %s: %s\n", filename.c_str(),
+            err);
+    return false;
+  }
+  return true;
+}
+
+}  // namespace CMU462
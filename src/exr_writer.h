@@ -0,0 +1,93 @@
+#ifndef CMU462_EXR_WRITER_H
+#define CMU462_EXR_WRITER_H
+
+#include <list>
+#include <string>
+#include <vector>
+
+#include "CMU462/vector3D.h"
+
+#include "image.h"
+
+namespace CMU462 {
+
+/**
+ * Writes float images as multi-channel OpenEXR files.
+ * The channels are copied into the writer as they are added, so once all of
+ * them are in, the writer no longer refers to the source buffers and can
+ * compress and write the file on another thread while the sources change.
+ * Images are given bottom row first, as the path tracer stores them, and
+ * flipped to the top row first order of OpenEXR.
+ */
+class EXRWriter {
+ public:
+  /**
+   * Pixel type the channels are stored as in the file.
+   */
+  enum PixelType {
+    HALF,  ///< 16 bit floats, half the size, about 3 decimal digits
+    FLOAT  ///< 32 bit floats, exact copy of the render
+  };
+
+  /**
+   * Constructor.
+   * Creates a writer for images of the given size.
+   * \param w width of the image
+   * \param h height of the image
+   * \param type pixel type of the file
+   */
+  EXRWriter(size_t w, size_t h, PixelType type = FLOAT)
+      : w(w), h(h), type(type) {}
+
+  /**
+   * Add a channel. The returned plane is filled by the caller, top row
+   * first, and stays valid as more channels are added.
+   * \param name name of the channel, e.g. "R" or "albedo.R"
+   * \return plane of the channel
+   */
+  std::vector<float>& add_channel(const std::string& name);
+
+  /**
+   * Add the R, G and B channels of a layer.
+   * \param layer name of the layer, empty for the main color
+   * \param image image to copy, bottom row first
+   */
+  void add_rgb(const std::string& layer, const HDRImageBuffer& image);
+
+  /**
+   * Add the X, Y and Z channels of a layer.
+   * \param layer name of the layer
+   * \param image image to copy, bottom row first
+   */
+  void add_xyz(const std::string& layer, const std::vector<Vector3D>& image);
+
+  /**
+   * Add a single channel.
+   * \param name name of the channel
+   * \param image image to copy, bottom row first
+   */
+  void add_scalar(const std::string& name, const std::vector<float>& image);
+
+  /**
+   * Write the file. The channels are sorted by name as OpenEXR requires.
+   * \param filename path of the file to write
+   * \return false if the file could not be written
+   */
+  bool write(const std::string& filename) const;
+
+ private:
+  /**
+   * Index of pixel i of a top row first image in a bottom row first image.
+   */
+  size_t flip(size_t i) const { return (i % w) + (h - 1 - i / w) * w; }
+
+  size_t w;        ///< width
+  size_t h;        ///< height
+  PixelType type;  ///< pixel type of the file
+
+  std::list<std::pair<std::string, std::vector<float> > > channels;
+};
+
+}  // namespace CMU462
+
+#endif  // CMU462_EXR_WRITER_H
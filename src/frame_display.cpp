@@ -0,0 +1,147 @@
+#include "frame_display.h"
+
+#include <string.h>
+
+#include "GL/glew.h"
+
+namespace CMU462 {
+
+FrameDisplay::~FrameDisplay() {
+  if (texture) glDeleteTextures(1, &texture);
+  if (pbo) glDeleteBuffers(1, &pbo);
+}
+
+void FrameDisplay::mark_dirty(size_t x0, size_t y0, size_t x1, size_t y1) {
+  if (x1 <= x0 || y1 <= y0) return;
+  std::lock_guard<std::mutex> guard(lock);
+  if (!all_dirty) dirty.push_back(Rect(x0, y0, x1, y1));
+}
+
+void FrameDisplay::mark_all_dirty() {
+  std::lock_guard<std::mutex> guard(lock);
+  all_dirty = true;
+  dirty.clear();
+}
+
+void FrameDisplay::draw(const ImageBuffer& frame) {
+  if (frame.is_empty()) return;
+
+  // (re)create the texture when the frame changes size
+  if (!texture || tex_w != frame.w || tex_h != frame.h) {
+    if (!texture) glGenTextures(1, &texture);
+    if (!pbo) glGenBuffers(1, &pbo);
+    tex_w = frame.w;
+    tex_h = frame.h;
+
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, tex_w, tex_h, 0, GL_RGBA,
+                 GL_UNSIGNED_BYTE, NULL);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, tex_w * tex_h * sizeof(uint32_t),
+                 NULL, GL_STREAM_DRAW);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    mark_all_dirty();
+  }
+
+  // take the regions changed so far; regions marked while uploading are
+  // picked up by the next draw
+  std::vector<Rect> rects;
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    if (all_dirty) {
+      rects.push_back(Rect(0, 0, tex_w, tex_h));
+      all_dirty = false;
+    } else {
+      rects.swap(dirty);
+    }
+  }
+  if (!rects.empty()) upload(frame, rects);
+
+  // draw the texture over the whole viewport
+  glPushAttrib(GL_ENABLE_BIT | GL_TEXTURE_BIT | GL_CURRENT_BIT);
+  glDisable(GL_LIGHTING);
+  glDisable(GL_DEPTH_TEST);
+  glDisable(GL_BLEND);
+  glEnable(GL_TEXTURE_2D);
+  glBindTexture(GL_TEXTURE_2D, texture);
+  glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
+
+  glMatrixMode(GL_PROJECTION);
+  glPushMatrix();
+  glLoadIdentity();
+  glMatrixMode(GL_MODELVIEW);
+  glPushMatrix();
+  glLoadIdentity();
+
+  // row 0 of the frame buffer is the bottom of the window
+  glColor4f(1.0, 1.0, 1.0, 1.0);
+  glBegin(GL_QUADS);
+  glTexCoord2f(0, 0);
+  glVertex2f(-1, -1);
+  glTexCoord2f(1, 0);
+  glVertex2f(1, -1);
+  glTexCoord2f(1, 1);
+  glVertex2f(1, 1);
+  glTexCoord2f(0, 1);
+  glVertex2f(-1, 1);
+  glEnd();
+
+  glPopMatrix();
+  glMatrixMode(GL_PROJECTION);
+  glPopMatrix();
+  glMatrixMode(GL_MODELVIEW);
+
+  glBindTexture(GL_TEXTURE_2D, 0);
+  glPopAttrib();
+}
+
+void FrameDisplay::upload(const ImageBuffer& frame,
+                          const std::vector<Rect>& rects) {
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+
+  // orphan the previous contents so that mapping does not wait for the
+  // uploads of the last frame to finish
+  size_t size = tex_w * tex_h * sizeof(uint32_t);
+  glBufferData(GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_STREAM_DRAW);
+  uint32_t* mapped = (uint32_t*)glMapBufferRange(
+      GL_PIXEL_UNPACK_BUFFER, 0, size,
+      GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+  if (!mapped) {
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    mark_all_dirty();
+    return;
+  }
+
+  // the buffer has the layout of the frame, so each region is copied to the
+  // same place and uploaded from there
+  for (const Rect& r : rects) {
+    for (size_t y = r.y0; y < r.y1; ++y) {
+      size_t offset = r.x0 + y * tex_w;
+      memcpy(mapped + offset, &frame.data[offset],
+             (r.x1 - r.x0) * sizeof(uint32_t));
+    }
+  }
+  glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+  glBindTexture(GL_TEXTURE_2D, texture);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  glPixelStorei(GL_UNPACK_ROW_LENGTH, tex_w);
+  for (const Rect& r : rects) {
+    size_t offset = (r.x0 + r.y0 * tex_w) * sizeof(uint32_t);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, r.x0, r.y0, r.x1 - r.x0, r.y1 - r.y0,
+                    GL_RGBA, GL_UNSIGNED_BYTE, (const void*)offset);
+  }
+  glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+  glBindTexture(GL_TEXTURE_2D, 0);
+
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+}  // namespace CMU462
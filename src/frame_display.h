@@ -0,0 +1,81 @@
+#ifndef CMU462_FRAME_DISPLAY_H
+#define CMU462_FRAME_DISPLAY_H
+
+#include <mutex>
+#include <vector>
+
+#include "image.h"
+
+namespace CMU462 {
+
+/**
+ * Shows a frame buffer in the window as a textured quad.
+ * The texture is kept between frames and only the parts of the frame buffer
+ * marked dirty since the last draw are uploaded, through a pixel buffer
+ * object so that the driver copies them to the texture asynchronously.
+ * Regions can be marked dirty from any thread; drawing needs the GL context.
+ */
+class FrameDisplay {
+ public:
+  /**
+   * Default constructor.
+   * No GL objects are created until the first draw.
+   */
+  FrameDisplay() : texture(0), pbo(0), tex_w(0), tex_h(0), all_dirty(true) {}
+
+  /**
+   * Destructor.
+   * Frees the GL objects, which must happen with the GL context current.
+   */
+  ~FrameDisplay();
+
+  /**
+   * Mark a region of the frame buffer as changed.
+   * \param x0 left column of the region
+   * \param y0 bottom row of the region
+   * \param x1 column past the right edge of the region
+   * \param y1 row past the top edge of the region
+   */
+  void mark_dirty(size_t x0, size_t y0, size_t x1, size_t y1);
+
+  /**
+   * Mark the whole frame buffer as changed.
+   */
+  void mark_all_dirty();
+
+  /**
+   * Upload the changed regions of a frame buffer and draw it over the whole
+   * viewport.
+   * \param frame frame buffer to show
+   */
+  void draw(const ImageBuffer& frame);
+
+ private:
+  /**
+   * A region of the frame buffer.
+   */
+  struct Rect {
+    Rect(size_t x0, size_t y0, size_t x1, size_t y1)
+        : x0(x0), y0(y0), x1(x1), y1(y1) {}
+    size_t x0, y0, x1, y1;
+  };
+
+  /**
+   * Copy the regions into the pixel buffer object and from there into the
+   * texture.
+   */
+  void upload(const ImageBuffer& frame, const std::vector<Rect>& rects);
+
+  unsigned int texture;  ///< texture holding the frame
+  unsigned int pbo;      ///< pixel buffer object the uploads go through
+  size_t tex_w;          ///< width of the texture
+  size_t tex_h;          ///< height of the texture
+
+  std::mutex lock;          ///< guards the dirty regions
+  std::vector<Rect> dirty;  ///< regions changed since the last draw
+  bool all_dirty;           ///< the whole frame changed since the last draw
+};
+
+}  // namespace CMU462
+
+#endif  // CMU462_FRAME_DISPLAY_H
@@ -1,5 +1,7 @@
 #include "halfEdgeMesh.h"
+#include <algorithm>
 #include <sstream>
+#include <unordered_map>
 
 #include "error_dialog.h"
 
@@ -45,31 +47,28 @@ Vector3D Face::normal() const {
 }
 
 void HalfedgeMesh::build(const vector<vector<Index> >& polygons,
-                         const vector<Vector3D>& vertexPositions)
+                         const vector<Vector3D>& vertexPositions,
+                         const vector<vector<Vector2D> >& texcoords)
 // This method initializes the halfedge data structure from a raw list of
 // polygons, where each input polygon is specified as a list of vertex indices.
 // The input must describe a manifold, oriented surface, where the orientation
 // of a polygon is determined by the order of vertices in the list. Polygons
 // must have at least three vertices.  Note that there are no special conditions
 // on the vertex indices, i.e., they do not have to start at 0 or 1, nor does
-// the collection of indices have to be contiguous.  Overall, this initializer
-// is designed to be robust but perhaps not incredibly fast (though of course
-// this does not affect the performance of the resulting data structure).  One
-// could also implement faster initializers that handle important special cases
-// (e.g., all triangles, or data that is known to be manifold). Since there are
-// no strong conditions on the indices of polygons, we assume that the list of
-// vertex positions is given in lexicographic order (i.e., that the lowest index
-// appearing in any polygon corresponds to the first entry of the list of
-// positions and so on).
+// the collection of indices have to be contiguous.  The bookkeeping is kept in
+// flat arrays and a hash table rather than in ordered maps, since meshes with
+// millions of polygons are built whenever a scene is loaded; indices that are
+// dense, as they are in nearly every file, are looked up in a plain array.
+// Since there are no strong conditions on the indices of polygons, we assume
+// that the list of vertex positions is given in lexicographic order (i.e.,
+// that the lowest index appearing in any polygon corresponds to the first
+// entry of the list of positions and so on).
 {
   // define some types, to improve readability
   typedef vector<Index> IndexList;
   typedef IndexList::const_iterator IndexListCIter;
   typedef vector<IndexList> PolygonList;
   typedef PolygonList::const_iterator PolygonListCIter;
-  typedef pair<Index, Index> IndexPair;  // ordered pair of vertex indices,
-                                         // corresponding to an edge of an
-                                         // oriented polygon
 
   // Clear any existing elements.
   halfedges.clear();
@@ -81,23 +80,44 @@ void HalfedgeMesh::build(const vector<vector<Index> >& polygons,
   // Since the vertices in our halfedge mesh are stored in a linked list,
   // we will temporarily need to keep track of the correspondence between
   // indices of vertices in our input and pointers to vertices in the new
-  // mesh (which otherwise can't be accessed by index).  Note that since
-  // we're using a general-purpose map (rather than, say, a vector), we can
-  // be a bit more flexible about the indexing scheme: input vertex indices
-  // aren't required to be 0-based or 1-based; in fact, the set of indices
-  // doesn't even have to be contiguous.  Taking advantage of this fact makes
-  // our conversion a bit more robust to different types of input, including
-  // data that comes from a subset of a full mesh.
+  // mesh (which otherwise can't be accessed by index).  Each vertex gets a
+  // consecutive id when its index is first seen, which is also its place in
+  // the list of vertices, and all other bookkeeping is done by id.  Input
+  // vertex indices aren't required to be 0-based or 1-based, nor contiguous:
+  // when they are spread too thinly for an array indexed by vertex index,
+  // a hash map takes its place.
+  const Index noVertex = (Index)-1;
+  Size nIndices = 0;
+  Index maxIndex = 0;
+  for (PolygonListCIter p = polygons.begin(); p != polygons.end(); p++) {
+    nIndices += p->size();
+    for (IndexListCIter i = p->begin(); i != p->end(); i++) {
+      maxIndex = max(maxIndex, *i);
+    }
+  }
+  bool dense = maxIndex <= 2 * (nIndices + vertexPositions.size());
+  vector<Index> indexToId(dense ? maxIndex + 1 : 0, noVertex);
+  unordered_map<Index, Index> sparseIndexToId;
 
-  // maps a vertex index to the corresponding vertex
-  map<Index, VertexIter> indexToVertex;
+  // maps an id to the corresponding vertex
+  vector<VertexIter> idToVertex;
 
   // Also store the vertex degree, i.e., the number of polygons that use each
   // vertex; this information will be used to check that the mesh is manifold.
-  map<VertexIter, Size> vertexDegree;
+  vector<Size> vertexDegree;
+
+  // the last polygon (counting from 1) each vertex was seen in, to find
+  // polygons that use a vertex twice
+  vector<Size> lastPolygon;
+
+  // the ids of the vertices of all polygons, one after the other
+  vector<Index> polygonIds;
+  polygonIds.reserve(nIndices);
 
   // First, we do some basic sanity checks on the input.
+  Size polygonNumber = 0;
   for (PolygonListCIter p = polygons.begin(); p != polygons.end(); p++) {
+    polygonNumber++;
     if (p->size() < 3) {
       // Refuse to build the mesh if any of the polygons have fewer than three
       // vertices.(Note that if we omit this check the code will still
@@ -111,33 +131,39 @@ void HalfedgeMesh::build(const vector<vector<Index> >& polygons,
       exit(1);
     }
 
-    // We want to count the number of distinct vertex indices in this
-    // polygon, to make sure it's the same as the number of vertices
-    // in the polygon---if they disagree, then the polygon is not valid
-    // (or at least, for simplicity we don't handle polygons of this type!).
-    set<Index> polygonIndices;
+    // We want to know if any vertex index appears twice in this polygon---if
+    // so, then the polygon is not valid (or at least, for simplicity we
+    // don't handle polygons of this type!).
+    bool repeated = false;
 
     // loop over polygon vertices
     for (IndexListCIter i = p->begin(); i != p->end(); i++) {
-      polygonIndices.insert(*i);
+      Index& id = dense ? indexToId[*i]
+                        : sparseIndexToId.insert(make_pair(*i, noVertex))
+                              .first->second;
 
       // allocate one vertex for each new index we encounter
-      if (indexToVertex.find(*i) == indexToVertex.end()) {
+      if (id == noVertex) {
+        id = idToVertex.size();
         VertexIter v = newVertex();
         v->halfedge() =
             halfedges.end();  // this vertex doesn't yet point to any halfedge
-        indexToVertex[*i] = v;
-        vertexDegree[v] = 1;  // we've now seen this vertex only once
+        idToVertex.push_back(v);
+        vertexDegree.push_back(1);  // we've now seen this vertex only once
+        lastPolygon.push_back(0);
       } else {
         // keep track of the number of times we've seen this vertex
-        vertexDegree[indexToVertex[*i]]++;
+        vertexDegree[id]++;
       }
 
+      if (lastPolygon[id] == polygonNumber) repeated = true;
+      lastPolygon[id] = polygonNumber;
+      polygonIds.push_back(id);
+
     }  // end loop over polygon vertices
 
     // check that all vertices of the current polygon are distinct
-    Size degree = p->size();  // number of vertices in this polygon
-    if (polygonIndices.size() < degree) {
+    if (repeated) {
       cerr << "Error converting polygons to halfedge mesh: one of the input "
               "polygons does not have distinct vertices!"
            << endl;
@@ -153,39 +179,62 @@ void HalfedgeMesh::build(const vector<vector<Index> >& polygons,
 
   // The number of vertices in the mesh is the
   // number of unique indices seen in the input.
-  Size nVertices = indexToVertex.size();
+  Size nVertices = idToVertex.size();
 
   // The number of faces is just the number of polygons in the input.
   Size nFaces = polygons.size();
   faces.resize(nFaces);  // allocate storage for faces in our new mesh
 
-  // We will store a map from ordered pairs of vertex indices to
-  // the corresponding halfedge object in our new (halfedge) mesh;
-  // this map gets constructed during the next loop over polygons.
-  map<IndexPair, HalfedgeIter> pairToHalfedge;
+  // We will store a map from ordered pairs of vertex ids to the
+  // corresponding halfedge object in our new (halfedge) mesh; this map gets
+  // constructed during the next loop over polygons.  A vertex starts one
+  // halfedge in each polygon that contains it, so the map is split into one
+  // small hash table per vertex, with twice as many slots as the vertex's
+  // degree, keyed by the id of the vertex the halfedge points to.  The tables
+  // sit one after another in flat arrays, in the order of the vertex ids, so
+  // that lookups for neighboring vertices stay close together in memory.
+  vector<Size> pairTableStart(nVertices + 1);
+  for (Index v = 0; v < nVertices; v++) {
+    pairTableStart[v + 1] = pairTableStart[v] + 2 * vertexDegree[v];
+  }
+  vector<Index> pairEnds(pairTableStart[nVertices], noVertex);
+  vector<HalfedgeIter> pairHalfedges(pairTableStart[nVertices]);
+  auto findPair = [&](Index a, Index b) {
+    Size start = pairTableStart[a];
+    Size size = pairTableStart[a + 1] - start;
+    Size slot = (Size)(b * 0x9E3779B97F4A7C15ULL >> 32) % size;
+    while (pairEnds[start + slot] != b && pairEnds[start + slot] != noVertex) {
+      if (++slot == size) slot = 0;
+    }
+    return start + slot;
+  };
 
   // Next, we actually build the halfedge connectivity by again looping over
   // polygons
   PolygonListCIter p;
   FaceIter f;
+  const Index* ids = polygonIds.data();
+  _hasTexcoords = !texcoords.empty();
+  vector<vector<Vector2D> >::const_iterator t = texcoords.begin();
+  vector<HalfedgeIter> faceHalfedges;  // cyclically ordered list of the half
+                                       // edges of this face
   for (p = polygons.begin(), f = faces.begin(); p != polygons.end(); p++, f++) {
-    vector<HalfedgeIter> faceHalfedges;  // cyclically ordered list of the half
-                                         // edges of this face
-    Size degree = p->size();             // number of vertices in this polygon
+    Size degree = p->size();  // number of vertices in this polygon
+    faceHalfedges.clear();
 
     // loop over the halfedges of this face (equivalently, the ordered pairs of
     // consecutive vertices)
     for (Index i = 0; i < degree; i++) {
-      Index a = (*p)[i];                 // current index
-      Index b = (*p)[(i + 1) % degree];  // next index, in cyclic order
-      IndexPair ab(a, b);
+      Index a = ids[i];                 // current vertex
+      Index b = ids[(i + 1) % degree];  // next vertex, in cyclic order
       HalfedgeIter hab;
 
       // check if this halfedge already exists; if so, we have a problem!
-      if (pairToHalfedge.find(ab) != pairToHalfedge.end()) {
+      Size ab = findPair(a, b);
+      if (pairEnds[ab] != noVertex) {
         cerr << "Error converting polygons to halfedge mesh: found multiple "
                 "oriented edges with indices ("
-             << a << ", " << b << ")." << endl;
+             << (*p)[i] << ", " << (*p)[(i + 1) % degree] << ")." << endl;
         cerr << "This means that either (i) more than two faces contain this "
                 "edge (hence the surface is nonmanifold), or"
              << endl;
@@ -198,16 +247,20 @@ void HalfedgeMesh::build(const vector<vector<Index> >& polygons,
       {
         // so, we point this vertex pair to a new halfedge
         hab = newHalfedge();
-        pairToHalfedge[ab] = hab;
+        pairEnds[ab] = b;
+        pairHalfedges[ab] = hab;
 
         // link the new halfedge to its face
         hab->face() = f;
         hab->face()->halfedge() = hab;
 
         // also link it to its starting vertex
-        hab->vertex() = indexToVertex[a];
+        hab->vertex() = idToVertex[a];
         hab->vertex()->halfedge() = hab;
 
+        // and give it the texture coordinate of the face at that vertex
+        if (_hasTexcoords) hab->texcoord = (*t)[i];
+
         // keep a list of halfedges in this face, so that we can later
         // link them together in a loop (via their "next" pointers)
         faceHalfedges.push_back(hab);
@@ -218,10 +271,9 @@ void HalfedgeMesh::build(const vector<vector<Index> >& polygons,
       // together and allocate their shared halfedge.  By the end of this pass
       // over polygons, the only halfedges that will not have a twin will hence
       // be those that sit along the domain boundary.
-      IndexPair ba(b, a);
-      map<IndexPair, HalfedgeIter>::iterator iba = pairToHalfedge.find(ba);
-      if (iba != pairToHalfedge.end()) {
-        HalfedgeIter hba = iba->second;
+      Size ba = findPair(b, a);
+      if (pairEnds[ba] != noVertex) {
+        HalfedgeIter hba = pairHalfedges[ba];
 
         // link the twins
         hab->twin() = hba;
@@ -250,6 +302,8 @@ void HalfedgeMesh::build(const vector<vector<Index> >& polygons,
       faceHalfedges[i]->next() = faceHalfedges[j];
     }
 
+    ids += degree;
+    if (_hasTexcoords) t++;
   }  // done building basic halfedge connectivity
 
   // For each vertex on the boundary, advance its halfedge pointer to one that
@@ -355,8 +409,10 @@ void HalfedgeMesh::build(const vector<vector<Index> >& polygons,
     v->halfedge() = v->halfedge()->twin()->next();
   }
 
-  // Finally, we check that all vertices are manifold.
-  for (VertexIter v = vertices.begin(); v != vertices.end(); v++) {
+  // Finally, we check that all vertices are manifold.  The vertices are
+  // listed in the order of their ids.
+  Index id = 0;
+  for (VertexIter v = vertices.begin(); v != vertices.end(); v++, id++) {
     // First check that this vertex is not a "floating" vertex;
     // if it is then we do not have a valid 2-manifold surface.
     if (v->halfedge() == halfedges.end()) {
@@ -380,7 +436,7 @@ void HalfedgeMesh::build(const vector<vector<Index> >& polygons,
       h = h->twin()->next();
     } while (h != v->halfedge());
 
-    if (count != vertexDegree[v]) {
+    if (count != vertexDegree[id]) {
       cerr << "Error converting polygons to halfedge mesh: at least one of the "
               "vertices is nonmanifold."
            << endl;
@@ -399,21 +455,27 @@ void HalfedgeMesh::build(const vector<vector<Index> >& polygons,
     cerr << "(  number of vertices in mesh: " << vertices.size() << ")" << endl;
     exit(1);
   }
-  // Since an STL map internally sorts its keys, we can iterate over the map
-  // from vertex indices to vertex iterators to visit our (input) vertices in
-  // lexicographic order
-  int i = 0;
-  for (map<Index, VertexIter>::const_iterator e = indexToVertex.begin();
-       e != indexToVertex.end(); e++) {
-    // grab a pointer to the vertex associated with the current key (i.e., the
-    // current index)
-    VertexIter v = e->second;
-
+  // The vertices take the positions in lexicographic order of their indices:
+  // the array of ids is already in that order, and the ids of a hash map are
+  // sorted by index first.
+  vector<Index> sortedIds;
+  if (dense) {
+    sortedIds.reserve(nVertices);
+    for (Index i = 0; i <= maxIndex; i++) {
+      if (indexToId[i] != noVertex) sortedIds.push_back(indexToId[i]);
+    }
+  } else {
+    vector<pair<Index, Index> > sorted(sparseIndexToId.begin(),
+                                       sparseIndexToId.end());
+    sort(sorted.begin(), sorted.end());
+    for (const pair<Index, Index>& e : sorted) sortedIds.push_back(e.second);
+  }
+  for (Index i = 0; i < nVertices; i++) {
     // set the att of this vertex to the corresponding
     // position in the input
+    VertexIter v = idToVertex[sortedIds[i]];
     v->position = vertexPositions[i];
     v->bindPosition = v->position;
-    i++;
   }
 
 }  // end HalfedgeMesh::build()
@@ -426,7 +488,8 @@ void HalfedgeMesh::build(const vector<vector<Index> >& polygons,
  * by this call.
  */
 void HalfedgeMesh::rebuild(const vector<vector<Index> >& polygons,
-                           const vector<Vector3D>& vertexPositions) {
+                           const vector<Vector3D>& vertexPositions,
+                           const vector<vector<Vector2D> >& texcoords) {
   // Clear old elements
   halfedges.clear();
   vertices.clear();
@@ -435,7 +498,7 @@ void HalfedgeMesh::rebuild(const vector<vector<Index> >& polygons,
   boundaries.clear();
 
   // Create new mesh
-  build(polygons, vertexPositions);
+  build(polygons, vertexPositions, texcoords);
 }
 
 const HalfedgeMesh& HalfedgeMesh::operator=(const HalfedgeMesh& mesh)
@@ -493,6 +556,8 @@ const HalfedgeMesh& HalfedgeMesh::operator=(const HalfedgeMesh& mesh)
   for (FaceIter b = boundariesBegin(); b != boundariesEnd(); b++)
     b->halfedge() = halfedgeOldToNew[b->halfedge()];
 
+  _hasTexcoords = mesh._hasTexcoords;
+
   // Return a reference to the new mesh.
   return *this;
 }
@@ -422,6 +422,8 @@ class Halfedge : public HalfedgeElement {
   void getPickPoints(Vector3D& a, Vector3D& b, Vector3D& p, Vector3D& q,
                      Vector3D& r) const;
 
+  Vector2D texcoord;  ///< texture coordinate of the face at the vertex
+
  protected:
   HalfedgeIter _twin;  ///< halfedge on the "other side" of the edge
   HalfedgeIter _next;  ///< next halfedge around the current face
@@ -643,8 +645,8 @@ class Vertex : public HalfedgeElement {
     return N;
   }
 
-  // TODO : add texcoord support
-  // Complex texcoord;  ///< vertex texture coordinate
+  // Texture coordinates are stored per face corner, on the halfedges
+  // leaving the vertex, so that they can differ across seams.
 
   float offset;
   float velocity;
@@ -784,7 +786,7 @@ class HalfedgeMesh {
   /**
    * Constructor.
    */
-  HalfedgeMesh() {}
+  HalfedgeMesh() : _hasTexcoords(false) {}
 
   /**
    * The assignment operator does a "deep" copy of the halfedge mesh data
@@ -808,10 +810,13 @@ class HalfedgeMesh {
    * polygons, where each input polygon is specified as a list of (0-based)
    * vertex indices. The input must describe a manifold, oriented surface,
    * where the orientation of a polygon is determined by the order of vertices
-   * in the list.
+   * in the list. The texture coordinates, if given, hold one coordinate per
+   * vertex of each polygon, which the halfedge leaving that vertex gets.
    */
   void build(const vector<vector<Index>>& polygons,
-             const vector<Vector3D>& vertexPositions);
+             const vector<Vector3D>& vertexPositions,
+             const vector<vector<Vector2D>>& texcoords =
+                 vector<vector<Vector2D>>());
 
   /**
    * This method does the same thing as HalfedgeMesh::build(), but also
@@ -821,7 +826,15 @@ class HalfedgeMesh {
    * by this call.
    */
   void rebuild(const vector<vector<Index>>& polygons,
-               const vector<Vector3D>& vertexPositions);
+               const vector<Vector3D>& vertexPositions,
+               const vector<vector<Vector2D>>& texcoords =
+                   vector<vector<Vector2D>>());
+
+  /**
+   * If the mesh was built with texture coordinates. Halfedges made by edits
+   * afterwards have a zero texture coordinate.
+   */
+  bool hasTexcoords() const { return _hasTexcoords; }
 
   // These methods return the total number of elements of each type.
   Size nHalfedges() const {
@@ -1060,6 +1073,8 @@ class HalfedgeMesh {
   list<Face> faces;
   list<Face> boundaries;
 
+  bool _hasTexcoords;  ///< if the mesh was built with texture coordinates
+
 };  // class HalfedgeMesh
 
 inline Halfedge* HalfedgeElement::getHalfedge() {
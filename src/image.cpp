@@ -0,0 +1,255 @@
+#include "image.h"
+
+#include <cmath>
+#include <mutex>
+#include <thread>
+#include <limits>
+#include <algorithm>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace CMU462 {
+
+static_assert(sizeof(Spectrum) == 3 * sizeof(float),
+              "the conversion kernels read spectra as packed floats");
+
+/**
+ * Quantizes linear values to 8-bit display codes, computing
+ * floor(pow(clamp(x, 0, 1), 1 / gamma) * 255) without calling pow.
+ * A table indexed by the exponent and the top mantissa bits of x gives the
+ * code at the low end of the bucket x falls in. Buckets are narrower than
+ * the gap between two code boundaries, so at most one boundary falls inside
+ * a bucket, and comparing x against it gives the exact code.
+ */
+class DisplayLUT {
+ public:
+  static const int kMantissaBits = 10;  ///< mantissa bits in the index
+  static const int kShift = 23 - kMantissaBits;
+
+  DisplayLUT(float gamma) : gamma(gamma) {
+    // x is at least boundary[k] if and only if its code is at least k
+    boundary[0] = 0.f;
+    for (int k = 1; k < 256; ++k) {
+      boundary[k] = (float)pow(k / 255.0, (double)gamma);
+    }
+    boundary[256] = std::numeric_limits<float>::infinity();
+
+    // values below the smallest bucket all have code 0
+    int min_exponent = std::max(-126, (int)floor(log2(boundary[1])));
+    min_value = ldexp(1.f, min_exponent);
+    base = bits(min_value) >> kShift;
+
+    size_t num_buckets = (bits(1.f) >> kShift) - base + 1;
+    table.resize(num_buckets);
+    int code = 0;
+    for (size_t i = 0; i < num_buckets; ++i) {
+      float low = from_bits((uint32_t)(i + base) << kShift);
+      while (boundary[code + 1] <= low) code++;
+      table[i] = code;
+    }
+  }
+
+  /**
+   * Code of a value that is already clamped to [0,1].
+   */
+  inline uint32_t code(float x, int32_t index) const {
+    uint32_t c = table[index];
+    return c + (x >= boundary[c + 1]);
+  }
+
+  /**
+   * Table index of a value that is already clamped to [0,1].
+   */
+  inline int32_t index(float x) const {
+    return (int32_t)(bits(std::max(x, min_value)) >> kShift) - base;
+  }
+
+  float gamma;      ///< gamma the table was built for
+  float min_value;  ///< low end of the first bucket
+  int32_t base;     ///< index bits of min_value
+
+ private:
+  static uint32_t bits(float x) {
+    uint32_t u;
+    memcpy(&u, &x, sizeof(u));
+    return u;
+  }
+
+  static float from_bits(uint32_t u) {
+    float x;
+    memcpy(&x, &u, sizeof(x));
+    return x;
+  }
+
+  std::vector<uint8_t> table;  ///< code at the low end of each bucket
+  float boundary[257];         ///< smallest value of each code
+};
+
+/**
+ * Get the display table for a gamma. Tables are built on first use and
+ * kept for the lifetime of the program.
+ */
+static const DisplayLUT& display_lut(float gamma) {
+  static std::mutex mutex;
+  static std::vector<DisplayLUT*> luts;
+
+  std::lock_guard<std::mutex> lock(mutex);
+  for (const DisplayLUT* lut : luts) {
+    if (lut->gamma == gamma) return *lut;
+  }
+  luts.push_back(new DisplayLUT(gamma));
+  return *luts.back();
+}
+
+/**
+ * Scale a row of linear RGB values, clamp them to [0,1] and convert them to
+ * RGBA colors. The SSE2 path and the scalar path perform exactly the same
+ * float operations, so the output is the same on every machine.
+ * \param lut display table
+ * \param in row of RGB values
+ * \param n number of pixels in the row
+ * \param scale factor applied to all values
+ * \param out row of RGBA colors to write
+ */
+static void quantize_row(const DisplayLUT& lut, const float* in, size_t n,
+                         float scale, uint32_t* out) {
+  const size_t kChunk = 64;  // pixels per chunk
+  float v[3 * kChunk];
+  int32_t index[3 * kChunk];
+
+  for (size_t p0 = 0; p0 < n; p0 += kChunk) {
+    size_t count = 3 * std::min(kChunk, n - p0);
+    const float* src = in + 3 * p0;
+
+    size_t i = 0;
+#ifdef __SSE2__
+    const __m128 s4 = _mm_set1_ps(scale);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.f);
+    const __m128 min4 = _mm_set1_ps(lut.min_value);
+    const __m128i base4 = _mm_set1_epi32(lut.base);
+    for (; i + 4 <= count; i += 4) {
+      // max(x, 0) returns 0 for a NaN x, as the scalar path does
+      __m128 x = _mm_mul_ps(_mm_loadu_ps(src + i), s4);
+      x = _mm_min_ps(_mm_max_ps(x, zero), one);
+      __m128i bits = _mm_castps_si128(_mm_max_ps(x, min4));
+      __m128i idx = _mm_sub_epi32(
+          _mm_srli_epi32(bits, DisplayLUT::kShift), base4);
+      _mm_storeu_ps(v + i, x);
+      _mm_storeu_si128((__m128i*)(index + i), idx);
+    }
+#endif
+    for (; i < count; ++i) {
+      float x = src[i] * scale;
+      x = x > 0.f ? x : 0.f;
+      x = std::min(x, 1.f);
+      v[i] = x;
+      index[i] = lut.index(x);
+    }
+
+    for (size_t p = 0; p < count / 3; ++p) {
+      uint32_t r = lut.code(v[3 * p], index[3 * p]);
+      uint32_t g = lut.code(v[3 * p + 1], index[3 * p + 1]);
+      uint32_t b = lut.code(v[3 * p + 2], index[3 * p + 2]);
+      out[p0 + p] = 0xFF000000u | (b << 16) | (g << 8) | r;
+    }
+  }
+}
+
+/**
+ * ACES filmic curve, as fitted by Krzysztof Narkowicz.
+ */
+static inline float aces(float x) {
+  return (x * (2.51f * x + 0.03f)) / (x * (2.43f * x + 0.59f) + 0.14f);
+}
+
+void HDRImageBuffer::tonemap(ImageBuffer& target, float gamma, float level,
+                             float key, float wht, ToneOperator op,
+                             size_t num_threads) const {
+  if (is_empty()) return;
+
+  const DisplayLUT& lut = display_lut(gamma);
+  num_threads = std::max<size_t>(1, num_threads);
+
+  // Compute global log average luminance, which only the curves need. Rows are summed in fixed blocks
+  // and the blocks are added up in order, so the average does not depend on
+  // how the rows are split between the threads.
+  const size_t kBlockRows = 16;
+  size_t num_blocks = op == TONEMAP_NONE ? 0 : (h + kBlockRows - 1) / kBlockRows;
+  std::vector<double> block_sum(num_blocks, 0.0);
+  auto sum_blocks = [&](size_t t) {
+    for (size_t b = t; b < num_blocks; b += num_threads) {
+      size_t end = std::min(h, (b + 1) * kBlockRows) * w;
+      double sum = 0.0;
+      for (size_t i = b * kBlockRows * w; i < end; ++i) {
+        // the small delta value below is used to avoids singularity
+        sum += log(0.0000001f + data[i].illum());
+      }
+      block_sum[b] = sum;
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (size_t t = 1; t < num_threads; ++t) threads.emplace_back(sum_blocks, t);
+  sum_blocks(0);
+  for (std::thread& t : threads) t.join();
+  threads.clear();
+
+  double log_sum = 0.0;
+  for (double sum : block_sum) log_sum += sum;
+  float avg = op == TONEMAP_NONE ? 1.f : exp(log_sum / (w * h));
+
+  // apply on pixels
+  float exposure = sqrt(pow(2, level));
+  float scale = op == TONEMAP_NONE ? 1.f : key / avg;
+  float inv_wht2 = 1.f / (wht * wht);
+  auto map_rows = [&](size_t t) {
+    std::vector<float> row(3 * w);
+    for (size_t y = t; y < h; y += num_threads) {
+      const Spectrum* src = &data[y * w];
+      for (size_t x = 0; x < w; ++x) {
+        const Spectrum& s = src[x];
+        float* dst = &row[3 * x];
+        if (op == TONEMAP_NONE) {
+          dst[0] = s.r, dst[1] = s.g, dst[2] = s.b;
+        } else if (op == TONEMAP_ACES) {
+          dst[0] = aces(s.r * scale);
+          dst[1] = aces(s.g * scale);
+          dst[2] = aces(s.b * scale);
+        } else {
+          // compress the scaled luminance, burning out above the white point
+          float l = s.illum();
+          float ls = l * scale;
+          float ld = ls * (1.f + ls * inv_wht2) / (1.f + ls);
+          float f = l > 0.f ? ld / l : 0.f;
+          dst[0] = s.r * f;
+          dst[1] = s.g * f;
+          dst[2] = s.b * f;
+        }
+      }
+      quantize_row(lut, &row[0], w, exposure, &target.data[y * target.w]);
+    }
+  };
+
+  for (size_t t = 1; t < num_threads; ++t) threads.emplace_back(map_rows, t);
+  map_rows(0);
+  for (std::thread& t : threads) t.join();
+}
+
+void HDRImageBuffer::toColor(ImageBuffer& target, size_t x0, size_t y0,
+                             size_t x1, size_t y1) const {
+  if (x1 <= x0) return;
+
+  float gamma = 2.2f;
+  float level = 1.0f;
+  float exposure = sqrt(pow(2, level));
+  const DisplayLUT& lut = display_lut(gamma);
+  for (size_t y = y0; y < y1; ++y) {
+    quantize_row(lut, &data[x0 + y * w].r, x1 - x0, exposure,
+                 &target.data[x0 + y * target.w]);
+  }
+}
+
+}  // namespace CMU462
@@ -60,7 +60,7 @@ struct ImageBuffer {
   /**
    * If the buffer is empty.
    */
-  bool is_empty() { return (w == 0 && h == 0); }
+  bool is_empty() const { return (w == 0 && h == 0); }
 
   /**
    * Clear image data.
@@ -74,6 +74,15 @@ struct ImageBuffer {
   std::vector<uint32_t> data;  ///< pixel buffer
 };
 
+/**
+ * Tone curves of HDRImageBuffer::tonemap.
+ */
+enum ToneOperator {
+  TONEMAP_NONE,      ///< no curve, only exposure and gamma
+  TONEMAP_REINHARD,  ///< Reinhard's global operator with a white point
+  TONEMAP_ACES       ///< ACES filmic curve (Narkowicz's fit)
+};
+
 /**
  * High Dynamic Range image buffer which stores linear space spectrum
  * values with 32 bit floating points.
@@ -134,63 +143,30 @@ struct HDRImageBuffer {
 
   /**
    * Tonemap and convert to color space image.
+   * The rows are split over the given number of threads. The result does not
+   * depend on the number of threads.
    * \param target target color buffer to store output
    * \param gamma gamma value
    * \param level exposure level adjustment
    * \key   key value to map average tone to (higher means brighter)
    * \why   white point (higher means larger dynamic range)
+   * \param op tone curve applied after mapping the average to the key
+   * \param num_threads number of threads to use
    */
   void tonemap(ImageBuffer& target, float gamma, float level, float key,
-               float wht) {
-    // compute global log average luminance!
-    float avg = 0;
-    for (size_t i = 0; i < w * h; ++i) {
-      // the small delta value below is used to avoids singularity
-      avg += log(0.0000001f + data[i].illum());
-    }
-    avg = exp(avg / (w * h));
-
-    // apply on pixels
-    float one_over_gamma = 1.0f / gamma;
-    float exposure = sqrt(pow(2, level));
-    for (size_t y = 0; y < h; ++y) {
-      for (size_t x = 0; x < w; ++x) {
-        Spectrum s = data[x + y * w];
-        float l = s.illum();
-        s *= key / avg;
-        s *= ((l + 1) / (wht * wht)) / (l + 1);
-        float r = pow(s.r * exposure, one_over_gamma);
-        float g = pow(s.g * exposure, one_over_gamma);
-        float b = pow(s.b * exposure, one_over_gamma);
-        target.update_pixel(Color(r, g, b, 1.0), x, y);
-      }
-    }
-  }
+               float wht, ToneOperator op = TONEMAP_REINHARD,
+               size_t num_threads = 1) const;
 
   /**
    * Convert the given tile of the buffer to color.
    */
   void toColor(ImageBuffer& target, size_t x0, size_t y0, size_t x1,
-               size_t y1) {
-    float gamma = 2.2f;
-    float level = 1.0f;
-    float one_over_gamma = 1.0f / gamma;
-    float exposure = sqrt(pow(2, level));
-    for (size_t y = y0; y < y1; ++y) {
-      for (size_t x = x0; x < x1; ++x) {
-        const Spectrum& s = data[x + y * w];
-        float r = pow(s.r * exposure, one_over_gamma);
-        float g = pow(s.g * exposure, one_over_gamma);
-        float b = pow(s.b * exposure, one_over_gamma);
-        target.update_pixel(Color(r, g, b, 1.0), x, y);
-      }
-    }
-  }
+               size_t y1) const;
 
   /**
    * If the buffer is empty
    */
-  bool is_empty() { return (w == 0 && h == 0); }
+  bool is_empty() const { return (w == 0 && h == 0); }
 
   /**
    * Clear image buffer.
@@ -3,6 +3,7 @@
 
 #include <vector>
 
+#include "CMU462/vector2D.h"
 #include "CMU462/vector3D.h"
 #include "CMU462/spectrum.h"
 #include "CMU462/misc.h"
@@ -25,7 +26,17 @@ struct Intersection {
 
   const Primitive* primitive;  ///< the primitive intersected
 
-  Vector3D n;  ///< normal at point of intersection
+  Vector3D n;  ///< shading normal at point of intersection, interpolated
+               ///< from the vertex normals of meshes
+
+  Vector3D ng;  ///< geometric normal at point of intersection, the normal of
+                ///< the surface itself, on the same side as the shading one
+
+  Vector2D bary;  ///< barycentric coordinates of the point of intersection in
+                  ///< a triangle, the weights of its second and third vertices
+
+  Vector2D uv;  ///< texture coordinates at point of intersection, zero for
+                ///< surfaces without them
 
   BSDF* bsdf;  ///< BSDF of the surface at point of intersection
 
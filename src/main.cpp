@@ -5,7 +5,13 @@
 #include "CMU462/tinyexr.h"
 
 #include "application.h"
+#include "render_server.h"
+#include "tile_farm.h"
 #include "image.h"
+#include "environment_map.h"
+#include "scene_file.h"
+
+#include "CMU462/timer.h"
 
 #include <iostream>
 #include <sstream>
@@ -31,55 +37,95 @@ void usage(const char* binaryName) {
   printf("  -l  <INT>        Number of samples per area light\n");
   printf("  -t  <INT>        Number of render threads\n");
   printf("  -m  <INT>        Maximum ray depth\n");
+  printf("  -f               Use the wavefront integrator\n");
+  printf("  -n               Denoise the render\n");
+  printf("  -a  <PATH>       Also save the render with its AOVs as OpenEXR to PATH\n");
+  printf("  -o  <LIST>       AOVs to save, comma separated list of albedo, normal,\n");
+  printf("                   depth, primid, objid, count, variance or all (default)\n");
   printf("  -e  <PATH>       Path to environment map\n");
   printf("  -w  <PATH>       Run Pathtracer without GUI, save render to PATH\n");
+  printf("                   (OpenEXR if PATH ends in .exr, PNG otherwise)\n");
+  printf("  -x  <TYPE>       Pixel type of OpenEXR output, half or float (default)\n");
+  printf("  -g  <CURVE>      Tone curve of PNG output and display, none (default),\n");
+  printf("                   reinhard or aces\n");
   printf("  -d  <w>x<h>      Width and height of output when pathtracing without GUI.\n");
   printf("                   Given via two integers with an x between them (e.g 800x600).\n");
+  printf("  --animation <s>:<e>\n");
+  printf("  -A  <s>:<e>      Render frames s to e of the animation without GUI, saving\n");
+  printf("                   each to PATH of -w with the frame number added (e.g. a_0007.png)\n");
+  printf("  -j  <INT>        Number of animation frames rendered at once (default 1)\n");
+  printf("  -b  <PATH>       Render the jobs in the file at PATH (- for stdin) without GUI,\n");
+  printf("                   one job per line, e.g. scene=a.dae out=a.png spp=64 size=640x480\n");
+  printf("                   aov=a.exr camera=px,py,pz,tx,ty,tz\n");
+  printf("  -u  <PATH>       Render jobs sent to the UNIX socket at PATH without GUI\n");
+  printf("  -c  <INT>        Number of scenes kept loaded by -b and -u (default 4)\n");
+  printf("  -k  <PATH>       Save the progress of the -w render to PATH every -K seconds\n");
+  printf("  -K  <SEC>        Seconds between checkpoints (default 60)\n");
+  printf("  --resume         Go on with the -w render from the checkpoint of -k\n");
+  printf("  -D  <PORT>       Split the render between workers connecting to PORT,\n");
+  printf("                   save it to PATH of -w\n");
+  printf("  -W  <HOST:PORT>  Render tiles for the -D render at HOST:PORT until it is done\n");
+  printf("  -C  <PATH>       Save the scene in the binary format to PATH (.s3d) and exit\n");
+  printf("  -L               Load the scene, print how long each step takes and exit\n");
   printf("  -h               Print this help message\n");
   printf("\n");
 }
 
-HDRImageBuffer* load_exr(const char* file_path) {
-  const char* err;
-
-  EXRImage exr;
-  InitEXRImage(&exr);
-
-  int ret = ParseMultiChannelEXRHeaderFromFile(&exr, file_path, &err);
-  if (ret != 0) {
-    msg("Error parsing OpenEXR file: " << err);
-    return NULL;
-  }
-
-  for (int i = 0; i < exr.num_channels; i++) {
-    if (exr.pixel_types[i] == TINYEXR_PIXELTYPE_HALF) {
-      exr.requested_pixel_types[i] = TINYEXR_PIXELTYPE_FLOAT;
-    }
-  }
-
-  ret = LoadMultiChannelEXRFromFile(&exr, file_path, &err);
-  if (ret != 0) {
-    msg("Error loading OpenEXR file: " << err);
-    exit(EXIT_FAILURE);
-  }
-
-  HDRImageBuffer* envmap = new HDRImageBuffer();
-  envmap->resize(exr.width, exr.height);
-  float* channel_r = (float*)exr.images[2];
-  float* channel_g = (float*)exr.images[1];
-  float* channel_b = (float*)exr.images[0];
-  for (size_t i = 0; i < exr.width * exr.height; i++) {
-    envmap->data[i] = Spectrum(channel_r[i], channel_g[i], channel_b[i]);
-  }
-
-  return envmap;
+/**
+ * Parse the frames of an animation to render, given as <start>:<end>.
+ */
+static bool parse_frame_range(const char* range, int* start, int* end) {
+  return sscanf(range, "%d:%d", start, end) == 2 && *end >= *start;
 }
 
 int main(int argc, char** argv) {
   // get the options
   AppConfig config;
+  int aovs = AOV_ALL;
+  bool aovs_given = false;
+  string job_file_path, socket_path;
+  size_t scene_cache_size = 4;
+  bool animation = false;
+  int start_frame = 0, end_frame = 0;
+  size_t num_concurrent_frames = 1;
+  int coordinator_port = 0;
+  string checkpoint_path;
+  double checkpoint_interval = 60;
+  bool checkpoint_interval_given = false;
+  bool resume = false;
+  string coordinator_address;
+  string convert_path;
+  bool load_only = false;
   int opt;
-  while ((opt = getopt(argc, argv, "s:l:t:m:e:w:d:h")) !=
+
+  // the bundled getopt has no long options, so --resume and --animation
+  // are taken out first
+  for (int i = 1; i < argc;) {
+    string arg = argv[i];
+    int taken = 0;
+    if (arg == "--resume") {
+      resume = true;
+      taken = 1;
+    } else if (arg == "--animation" ||
+               arg.compare(0, 12, "--animation=") == 0) {
+      taken = arg == "--animation" ? 2 : 1;
+      const char* range = taken == 2 ? (i + 1 < argc ? argv[i + 1] : NULL)
+                                     : argv[i] + 12;
+      if (!range || !parse_frame_range(range, &start_frame, &end_frame)) {
+        usage(argv[0]);
+        return 1;
+      }
+      animation = true;
+    }
+    if (!taken) {
+      i++;
+      continue;
+    }
+    for (int j = i; j + taken < argc; ++j) argv[j] = argv[j + taken];
+    argc -= taken;
+  }
+
+  while ((opt = getopt(argc, argv, "s:l:t:m:fna:o:x:g:e:w:d:A:j:b:u:c:k:K:D:W:C:Lh")) !=
          -1) {  // for each option...
     switch (opt) {
       case 's':
@@ -94,8 +140,42 @@ int main(int argc, char** argv) {
       case 'm':
         config.pathtracer_max_ray_depth = atoi(optarg);
         break;
+      case 'f':
+        config.pathtracer_wavefront = true;
+        break;
+      case 'n':
+        config.pathtracer_denoise = true;
+        break;
+      case 'a':
+        config.pathtracer_aov_path = optarg;
+        break;
+      case 'o':
+        if (!parse_aov_list(optarg, &aovs)) {
+          usage(argv[0]);
+          return 1;
+        }
+        aovs_given = true;
+        break;
+      case 'x':
+        if (string(optarg) == "half") {
+          config.pathtracer_exr_half = true;
+        } else if (string(optarg) != "float") {
+          usage(argv[0]);
+          return 1;
+        }
+        break;
+      case 'g':
+        if (string(optarg) == "reinhard") {
+          config.pathtracer_tone_operator = TONEMAP_REINHARD;
+        } else if (string(optarg) == "aces") {
+          config.pathtracer_tone_operator = TONEMAP_ACES;
+        } else if (string(optarg) != "none") {
+          usage(argv[0]);
+          return 1;
+        }
+        break;
       case 'e':
-        config.pathtracer_envmap = load_exr(optarg);
+        config.pathtracer_envmap = EnvironmentMap::load(optarg);
         break;
       case 'w':
         if(optarg != nullptr) {
@@ -115,12 +195,94 @@ int main(int argc, char** argv) {
                 config.pathtracer_result_height = config.pathtracer_result_width * 3 / 4;
         }
         break;
+      case 'A':
+        if (!parse_frame_range(optarg, &start_frame, &end_frame)) {
+          usage(argv[0]);
+          return 1;
+        }
+        animation = true;
+        break;
+      case 'j':
+        num_concurrent_frames = atoi(optarg);
+        break;
+      case 'b':
+        job_file_path = optarg;
+        break;
+      case 'u':
+        socket_path = optarg;
+        break;
+      case 'c':
+        scene_cache_size = atoi(optarg);
+        break;
+      case 'k':
+        checkpoint_path = optarg;
+        break;
+      case 'K':
+        checkpoint_interval = atof(optarg);
+        checkpoint_interval_given = true;
+        if (checkpoint_interval <= 0) {
+          usage(argv[0]);
+          return 1;
+        }
+        break;
+      case 'D':
+        coordinator_port = atoi(optarg);
+        if (coordinator_port <= 0 || coordinator_port > 65535) {
+          usage(argv[0]);
+          return 1;
+        }
+        break;
+      case 'W':
+        coordinator_address = optarg;
+        break;
+      case 'C':
+        convert_path = optarg;
+        break;
+      case 'L':
+        load_only = true;
+        break;
       default:
         usage(argv[0]);
         return 1;
     }
   }
 
+  // animations are only rendered headless, one frame at a time
+  if (animation) {
+    if (config.pathtracer_result_path == "") {
+      msg("Error: --animation needs an output path given with -w");
+      exit(EXIT_FAILURE);
+    }
+    if (job_file_path != "" || socket_path != "" || coordinator_port ||
+        coordinator_address != "" || convert_path != "" || load_only) {
+      msg("Error: --animation cannot be used with -b, -u, -D, -W, -C or -L");
+      exit(EXIT_FAILURE);
+    }
+    if (checkpoint_path != "" || checkpoint_interval_given || resume) {
+      msg("Error: --animation cannot save checkpoints (-k, -K, --resume)");
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  if (config.pathtracer_aov_path != "") config.pathtracer_aovs = aovs;
+
+  // batch rendering: jobs name their own scenes, and ask for AOV files only
+  // when AOVs were listed with -o
+  if (job_file_path != "" || socket_path != "") {
+    if (aovs_given) config.pathtracer_aovs = aovs;
+    RenderServer server(config, scene_cache_size);
+    bool ok = true;
+    if (job_file_path != "") ok = server.run_job_file(job_file_path) == 0;
+    if (socket_path != "") ok = server.run_socket(socket_path) && ok;
+    exit(ok ? EXIT_SUCCESS : EXIT_FAILURE);
+  }
+
+  // distributed rendering: workers get the scene from the coordinator
+  if (coordinator_address != "") {
+    exit(run_tile_worker(coordinator_address, config) ? EXIT_SUCCESS
+                                                      : EXIT_FAILURE);
+  }
+
   // print usage if no argument given
   if (optind >= argc) {
     usage(argv[0]);
@@ -130,16 +292,87 @@ int main(int argc, char** argv) {
   string sceneFilePath = argv[optind];
   msg("Input scene file: " << sceneFilePath);
 
+  if (coordinator_port) {
+    if (config.pathtracer_result_path == "") {
+      usage(argv[0]);
+      return 1;
+    }
+    TileCoordinator coordinator(config, sceneFilePath);
+    exit(coordinator.run(coordinator_port) ? EXIT_SUCCESS : EXIT_FAILURE);
+  }
+
   // parse scene
-  Collada::SceneInfo* sceneInfo = new Collada::SceneInfo();
-  if (Collada::ColladaParser::load(sceneFilePath.c_str(), sceneInfo) < 0) {
-    msg("Error: parsing failed!");
-    delete sceneInfo;
-    exit(0);
+  Timer timer;
+  timer.start();
+  Collada::SceneInfo* sceneInfo = NULL;
+  SceneFile* sceneFile = NULL;
+  if (SceneFile::is_scene_file(sceneFilePath)) {
+    sceneFile = new SceneFile();
+    if (!sceneFile->load(sceneFilePath)) {
+      msg("Error: parsing failed!");
+      delete sceneFile;
+      exit(0);
+    }
+  } else {
+    sceneInfo = new Collada::SceneInfo();
+    if (Collada::ColladaParser::load(sceneFilePath.c_str(), sceneInfo) < 0) {
+      msg("Error: parsing failed!");
+      delete sceneInfo;
+      exit(0);
+    }
+  }
+  timer.stop();
+
+  // conversion and load timing: the scene is loaded as the editor would load
+  // it, or, for timing, as a headless render would
+  if (convert_path != "" || load_only) {
+    fprintf(stdout, "[Scotty3D] Parsing scene... Done! (%.4f sec)\n",
+            timer.duration());
+    Application app(config);
+    app.init_headless = true;
+    app.init();
+
+    timer.start();
+    if (sceneFile) {
+      app.load(sceneFile, convert_path != "");
+    } else {
+      app.load(sceneInfo);
+      if (convert_path != "") app.load_animation(sceneFilePath.c_str());
+    }
+    timer.stop();
+    fprintf(stdout, "[Scotty3D] Building scene... Done! (%.4f sec)\n",
+            timer.duration());
+
+    if (convert_path != "") {
+      if (!SceneFile::is_scene_file(convert_path)) {
+        msg("Error: " << convert_path << " does not end in .s3d");
+        exit(EXIT_FAILURE);
+      }
+      app.writeScene(convert_path.c_str());
+      exit(EXIT_SUCCESS);
+    }
+
+    fprintf(stdout, "[Scotty3D] Converting scene for rendering... ");
+    fflush(stdout);
+    timer.start();
+    app.build_static_scene();
+    timer.stop();
+    fprintf(stdout, "Done! (%.4f sec)\n", timer.duration());
+    exit(EXIT_SUCCESS);
   }
 
   const bool headless = config.pathtracer_result_path != "";
 
+  if (resume && checkpoint_path == "") {
+    msg("Error: --resume needs a checkpoint file given with -k");
+    exit(EXIT_FAILURE);
+  }
+  if (headless) {
+    config.pathtracer_checkpoint_path = checkpoint_path;
+    config.pathtracer_checkpoint_interval = checkpoint_interval;
+    config.pathtracer_resume = resume;
+  }
+
   // create application
   Application app(config);
 
@@ -151,12 +384,27 @@ int main(int argc, char** argv) {
       // Application::init() manually (normally, the Viewer calls init()).
       app.init();
 
-      // load scene
-      app.load(sceneInfo);
+      // load scene; stills from binary scene files skip building halfedge
+      // meshes, and the skeletons of animations are in the file itself
+      if (sceneFile) {
+        app.load(sceneFile, animation);
+      } else {
+        app.load(sceneInfo);
+        if (animation) app.load_animation(sceneFilePath.c_str());
+      }
+
+      if (animation) {
+        bool saved = app.render_animation(start_frame, end_frame,
+                                          config.pathtracer_result_path,
+                                          config.pathtracer_aov_path,
+                                          num_concurrent_frames);
+        exit(saved ? EXIT_SUCCESS : EXIT_FAILURE);
+      }
 
       // Now render the scene in headless mode and exit.
-      app.render_scene(config.pathtracer_result_path);
-      exit(EXIT_SUCCESS);
+      bool saved = app.render_scene(config.pathtracer_result_path,
+                                    config.pathtracer_aov_path);
+      exit(saved ? EXIT_SUCCESS : EXIT_FAILURE);
   }
 
   // create viewer
@@ -169,9 +417,12 @@ int main(int argc, char** argv) {
   viewer.init();
 
   // load scene
-  app.load(sceneInfo);
-
-  delete sceneInfo;
+  if (sceneFile) {
+    app.load(sceneFile);
+  } else {
+    app.load(sceneInfo);
+    delete sceneInfo;
+  }
 
   // NOTE (sky): are we copying everything to dynamic scene? If so:
   // TODO (sky): check and make sure the destructor is freeing everything
@@ -179,6 +430,9 @@ int main(int argc, char** argv) {
   // start viewer
   viewer.start();
 
+  // let scenes being saved finish
+  app.wait_for_writes();
+
   // TODO:
   // apparently the meshEdit renderer instance was not destroyed properly
   // not sure if this is due to the recent refactor but if anyone got some
@@ -0,0 +1,107 @@
+#include "mapped_file.h"
+
+#include <stdio.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace CMU462 {
+
+#ifndef _WIN32
+
+bool MappedFile::open(const char* path) {
+  close();
+
+  int fd = ::open(path, O_RDONLY);
+  if (fd < 0) return false;
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+    ::close(fd);
+    return false;
+  }
+  size_t file_size = st.st_size;
+
+  // Reserve room for the file and the null byte with zeroed memory, then
+  // map the file over its start. The part of the last page past the end of
+  // the file reads as zero, and if the file ends on a page boundary the
+  // null byte is in the zeroed page that follows.
+  void* region = mmap(NULL, file_size + 1, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (region == MAP_FAILED) {
+    ::close(fd);
+    return false;
+  }
+  if (file_size > 0 &&
+      mmap(region, file_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED,
+           fd, 0) == MAP_FAILED) {
+    munmap(region, file_size + 1);
+    ::close(fd);
+    return false;
+  }
+  ::close(fd);
+
+  // the file is usually read from start to end
+  madvise(region, file_size + 1, MADV_SEQUENTIAL);
+
+  contents = (char*)region;
+  length = file_size;
+  mapped = true;
+  return true;
+}
+
+void MappedFile::close() {
+  if (contents) {
+    if (mapped) {
+      munmap(contents, length + 1);
+    } else {
+      delete[] contents;
+    }
+  }
+  contents = NULL;
+  length = 0;
+  mapped = false;
+}
+
+#else
+
+bool MappedFile::open(const char* path) {
+  close();
+
+  FILE* file = fopen(path, "rb");
+  if (!file) return false;
+
+  fseek(file, 0, SEEK_END);
+  long file_size = ftell(file);
+  fseek(file, 0, SEEK_SET);
+  if (file_size < 0) {
+    fclose(file);
+    return false;
+  }
+
+  contents = new char[file_size + 1];
+  length = fread(contents, 1, file_size, file);
+  contents[length] = 0;
+  fclose(file);
+
+  if (length != (size_t)file_size) {
+    close();
+    return false;
+  }
+  return true;
+}
+
+void MappedFile::close() {
+  delete[] contents;
+  contents = NULL;
+  length = 0;
+  mapped = false;
+}
+
+#endif
+
+}  // namespace CMU462
@@ -0,0 +1,55 @@
+#ifndef CMU462_MAPPED_FILE_H
+#define CMU462_MAPPED_FILE_H
+
+#include <stddef.h>
+
+namespace CMU462 {
+
+/**
+ * A file mapped into memory. The mapping is private, so the contents can be
+ * changed in place without touching the file, and only the pages that are
+ * written take memory of their own; the rest are shared with the page cache
+ * and can be dropped by the system at any time. The contents are followed
+ * by a null byte, so a text file can be parsed as a C string.
+ *
+ * Where memory maps are not available the file is read into memory instead.
+ */
+class MappedFile {
+ public:
+  MappedFile() : contents(NULL), length(0), mapped(false) {}
+  ~MappedFile() { close(); }
+
+  /**
+   * Map a file, unmapping any file mapped before.
+   * \param path path of the file
+   * \return false if the file could not be opened or mapped
+   */
+  bool open(const char* path);
+
+  /**
+   * Unmap the file.
+   */
+  void close();
+
+  /**
+   * Contents of the file, followed by a null byte. NULL if no file is open.
+   */
+  char* data() const { return contents; }
+
+  /**
+   * Size of the file in bytes, without the null byte.
+   */
+  size_t size() const { return length; }
+
+ private:
+  MappedFile(const MappedFile&);             // not supported
+  MappedFile& operator=(const MappedFile&);  // not supported
+
+  char* contents;  ///< start of the mapping
+  size_t length;   ///< size of the file
+  bool mapped;     ///< if contents is a map or a heap copy
+};
+
+}  // namespace CMU462
+
+#endif  // CMU462_MAPPED_FILE_H
@@ -359,7 +359,8 @@ void HalfedgeMesh::splitPolygons(vector<FaceIter>& fcs) {
 
 void HalfedgeMesh::splitPolygon(FaceIter f) {
   // TODO: (meshedit) 
-  // Triangulate a polygonal face
+  // Triangulate a polygonal face. A new halfedge should get the texcoord of
+  // the halfedge of the face leaving the same vertex.
   showError("splitPolygon() not implemented.");
 }
 
@@ -0,0 +1,87 @@
+#ifndef CMU462_PATH_POOL_H
+#define CMU462_PATH_POOL_H
+
+#include <vector>
+
+#include "CMU462/spectrum.h"
+
+#include "ray.h"
+#include "bsdf.h"
+#include "intersection.h"
+#include "aov.h"
+
+namespace CMU462 {
+
+/**
+ * Paths in flight in the wavefront integrator.
+ * The state is kept as a structure of arrays indexed by slot, so that each
+ * stage (generate, extend, shade, connect, accumulate) only streams through
+ * the fields it actually touches. Slots are recycled: when a path ends its
+ * slot is put back on the idle list and the generate stage starts a new
+ * camera path in it.
+ */
+struct PathPool {
+  /**
+   * Prepare the pool for a new tile.
+   * \param num_slots maximum number of paths in flight
+   * \param num_pixels number of pixels in the tile
+   */
+  void reset(size_t num_slots, size_t num_pixels) {
+    rays.resize(num_slots);
+    isects.resize(num_slots);
+    throughput.resize(num_slots);
+    radiance.resize(num_slots);
+    pixel.resize(num_slots);
+    specular.resize(num_slots);
+    alive.resize(num_slots);
+
+    active.clear();
+    idle.clear();
+    for (size_t i = num_slots; i > 0; --i) idle.push_back(i - 1);
+
+    accum.assign(num_pixels, Spectrum());
+  }
+
+  /**
+   * Prepare the AOV sums for a new tile.
+   * \param num_pixels number of pixels in the tile
+   */
+  void reset_aovs(size_t num_pixels) {
+    hits.resize(rays.size());
+    aovs.assign(num_pixels, AOVPixel());
+  }
+
+  // Path state, indexed by slot //
+
+  std::vector<Ray> rays;                           ///< ray to trace next
+  std::vector<StaticScene::Intersection> isects;  ///< closest hit of the ray
+  std::vector<Spectrum> throughput;  ///< product of the path weights so far
+  std::vector<Spectrum> radiance;    ///< radiance gathered so far
+  std::vector<size_t> pixel;         ///< tile pixel the path belongs to
+  std::vector<unsigned char> specular;  ///< ray left the camera or a delta bsdf
+  std::vector<unsigned char> alive;     ///< path goes on after this bounce
+
+  std::vector<size_t> active;  ///< slots holding a path in flight
+  std::vector<size_t> idle;    ///< slots free for new paths
+
+  std::vector<size_t> queues[NUM_BSDF_TYPES];  ///< hit slots per BSDF type
+
+  // Shadow rays produced by the shade stage //
+
+  std::vector<Ray> shadow_rays;           ///< light connections to test
+  std::vector<Spectrum> shadow_L;         ///< contribution if unoccluded
+  std::vector<size_t> shadow_path;        ///< slot the contribution goes to
+  std::vector<size_t> shadow_stream;      ///< indices of all shadow rays
+  std::vector<unsigned char> shadow_hit;  ///< occlusion result
+
+  std::vector<Spectrum> accum;  ///< sum of finished paths per tile pixel
+
+  // AOVs, only kept when the path tracer has some enabled //
+
+  std::vector<AOVHit> hits;     ///< first hit of the path in each slot
+  std::vector<AOVPixel> aovs;  ///< AOV sums per tile pixel
+};
+
+}  // namespace CMU462
+
+#endif  // CMU462_PATH_POOL_H
@@ -1,6 +1,7 @@
 #include "pathtracer.h"
 #include "bsdf.h"
 #include "ray.h"
+#include "rng.h"
 
 #include <stack>
 #include <random>
@@ -26,9 +27,51 @@ namespace CMU462 {
 
 // #define ENABLE_RAY_LOGGING 1
 
+/**
+ * Power heuristic (with an exponent of 2) for weighing a sample drawn from
+ * a strategy with density pdf_f against another strategy with density pdf_g.
+ */
+static inline float power_heuristic(float pdf_f, float pdf_g) {
+  float f2 = pdf_f * pdf_f;
+  float g2 = pdf_g * pdf_g;
+  return f2 / (f2 + g2);
+}
+
+/**
+ * Whether a direction leaving a surface is on the same side of it by the
+ * geometric normal as by the shading normal. Directions that are not would
+ * go through the surface, or off its back, and are dropped so that shading
+ * normals do not leak light.
+ * \param dir direction in world space
+ * \param cos_theta cosine of the direction with the shading normal
+ * \param ng geometric normal
+ */
+static inline bool same_side(const Vector3D &dir, double cos_theta,
+                             const Vector3D &ng) {
+  return dot(dir, ng) * cos_theta > 0;
+}
+
+// Per-thread ray counters. They are only added to the pathtracer's shared
+// totals once per tile so that tracing never touches a contended cache line.
+static thread_local size_t tl_num_samples = 0;
+static thread_local size_t tl_num_segments = 0;
+static thread_local size_t tl_num_rays = 0;
+
+// First hit of the last camera ray traced by the thread, for the AOVs.
+static thread_local AOVHit tl_hit;
+
+// Per-thread scratch space for the shadow rays of one shading point.
+static thread_local vector<Ray> tl_shadow_rays;
+static thread_local vector<Spectrum> tl_shadow_L;
+
+// sums of the tile pass a worker is rendering, merged into the tile when done
+static thread_local vector<Float4> tl_tile_pass;
+
 PathTracer::PathTracer(size_t ns_aa, size_t max_ray_depth, size_t ns_area_light,
                        size_t ns_diff, size_t ns_glsy, size_t ns_refr,
-                       size_t num_threads, HDRImageBuffer *envmap) {
+                       size_t num_threads, EnvironmentMap *envmap,
+                       bool wavefront, bool denoise, int aovs,
+                       bool exr_half, ToneOperator tone_operator) {
   state = INIT, this->ns_aa = ns_aa;
   this->max_ray_depth = max_ray_depth;
   this->ns_area_light = ns_area_light;
@@ -36,7 +79,20 @@ PathTracer::PathTracer(size_t ns_aa, size_t max_ray_depth, size_t ns_area_light,
   this->ns_glsy = ns_diff;
   this->ns_refr = ns_refr;
 
+  use_wavefront = wavefront;
+  wavefront_pool_size = 8192;
+
+  use_denoiser = denoise;
+  aovBuffer.set_enabled(denoise ? aovs | AOV_DENOISER : aovs);
+
+  exr_pixel_type = exr_half ? EXRWriter::HALF : EXRWriter::FLOAT;
 
+  rr_min_depth = 3;
+  rr_min_prob = 0.05f;
+  rr_max_prob = 0.95f;
+
+
+  this->envMap = envmap;
   if (envmap) {
     this->envLight = new EnvironmentLight(envmap);
   } else {
@@ -53,6 +109,11 @@ PathTracer::PathTracer(size_t ns_aa, size_t max_ray_depth, size_t ns_area_light,
   show_rays = true;
 
   imageTileSize = 32;
+  render_seed = 0;
+
+  checkpoint_interval = 60;
+  checkpointStop = false;
+  writeFailed = false;
   numWorkerThreads = num_threads;
   workerThreads.resize(numWorkerThreads);
 
@@ -60,10 +121,13 @@ PathTracer::PathTracer(size_t ns_aa, size_t max_ray_depth, size_t ns_area_light,
   tm_level = 1.0f;
   tm_key = 0.18;
   tm_wht = 5.0f;
+  tm_operator = tone_operator;
 }
 
 PathTracer::~PathTracer() {
-  delete bvh;
+  stop();
+  wait_for_writes();
+  delete_scene();
   delete gridSampler;
   delete hemisphereSampler;
 }
@@ -74,18 +138,35 @@ void PathTracer::set_scene(Scene *scene) {
   }
 
   if (this->scene != nullptr) {
-    delete scene;
-    delete bvh;
+    delete_scene();
     selectionHistory.pop();
   }
 
+  this->scene = scene;
+  build_accel();
+
+  // the environment map loads while the scene loads and the BVH builds, a
+  // map that failed to load is left out and the scene renders without it
+  if (envMap) {
+    fprintf(stdout, "[PathTracer] Loading environment map... ");
+    fflush(stdout);
+    timer.start();
+    bool loaded = envMap->wait();
+    timer.stop();
+    if (loaded) {
+      fprintf(stdout, "Done! (%.4f sec)\n", timer.duration());
+    } else {
+      fprintf(stdout, "Failed! Rendering without it.\n");
+      delete envLight;
+      envLight = NULL;
+      envMap = NULL;
+    }
+  }
+
   if (this->envLight != nullptr) {
     scene->lights.push_back(this->envLight);
   }
 
-  this->scene = scene;
-  build_accel();
-
   if (has_valid_configuration()) {
     state = READY;
   }
@@ -108,6 +189,8 @@ void PathTracer::set_frame_size(size_t width, size_t height) {
   }
   sampleBuffer.resize(width, height);
   frameBuffer.resize(width, height);
+  frameDisplay.mark_all_dirty();
+  aovBuffer.resize(width, height);
   if (has_valid_configuration()) {
     state = READY;
   }
@@ -127,13 +210,8 @@ void PathTracer::update_screen() {
       visualize_accel();
       break;
     case RENDERING:
-      glDrawPixels(frameBuffer.w, frameBuffer.h, GL_RGBA, GL_UNSIGNED_BYTE,
-                   &frameBuffer.data[0]);
-      break;
     case DONE:
-      // sampleBuffer.tonemap(frameBuffer, tm_gamma, tm_level, tm_key, tm_wht);
-      glDrawPixels(frameBuffer.w, frameBuffer.h, GL_RGBA, GL_UNSIGNED_BYTE,
-                   &frameBuffer.data[0]);
+      frameDisplay.draw(frameBuffer);
       break;
   }
 }
@@ -156,20 +234,33 @@ void PathTracer::stop() {
         workerThreads[i]->join();
         delete workerThreads[i];
       }
+      if (checkpointThread.joinable()) checkpointThread.join();
       state = READY;
       break;
   }
 }
 
-void PathTracer::clear() {
-  if (state != READY) return;
+void PathTracer::delete_scene() {
   delete bvh;
   bvh = NULL;
-  scene = NULL;
+  if (scene) {
+    scene->lights.erase(
+        std::remove(scene->lights.begin(), scene->lights.end(), envLight),
+        scene->lights.end());
+    delete scene;
+    scene = NULL;
+  }
+}
+
+void PathTracer::clear() {
+  if (state != READY) return;
+  delete_scene();
   camera = NULL;
   selectionHistory.pop();
   sampleBuffer.resize(0, 0);
   frameBuffer.resize(0, 0);
+  aovBuffer.resize(0, 0);
+  denoisedBuffer.resize(0, 0);
   state = INIT;
 }
 
@@ -181,6 +272,16 @@ void PathTracer::start_visualizing() {
 }
 
 void PathTracer::start_raytracing() {
+  vector<WorkItem> work;
+  for (size_t y = 0; y < sampleBuffer.h; y += imageTileSize) {
+    for (size_t x = 0; x < sampleBuffer.w; x += imageTileSize) {
+      work.push_back(WorkItem(x, y, imageTileSize, imageTileSize));
+    }
+  }
+  start_raytracing(work);
+}
+
+void PathTracer::start_raytracing(const vector<WorkItem> &work) {
   if (state != READY) return;
 
   rayLog.clear();
@@ -189,19 +290,57 @@ void PathTracer::start_raytracing() {
   state = RENDERING;
   continueRaytracing = true;
   workerDoneCount = 0;
+  num_samples = 0;
+  num_segments = 0;
+  num_rays = 0;
 
   sampleBuffer.clear();
   frameBuffer.clear();
+  frameDisplay.mark_all_dirty();
+  if (use_denoiser && !aovBuffer.has(AOV_DENOISER)) {
+    aovBuffer.set_enabled(aovBuffer.enabled | AOV_DENOISER);
+  }
+  aovBuffer.clear();
+  denoisedBuffer.resize(0, 0);
   num_tiles_w = sampleBuffer.w / imageTileSize + 1;
   num_tiles_h = sampleBuffer.h / imageTileSize + 1;
-  tile_samples.resize(num_tiles_w * num_tiles_h);
-  memset(&tile_samples[0], 0, num_tiles_w * num_tiles_h * sizeof(int));
+  vector<TileBuffer>(num_tiles_w * num_tiles_h).swap(tiles);
 
-  // populate the tile work queue
-  for (size_t y = 0; y < sampleBuffer.h; y += imageTileSize) {
-    for (size_t x = 0; x < sampleBuffer.w; x += imageTileSize) {
-      workQueue.put_work(WorkItem(x, y, imageTileSize, imageTileSize));
+  for (const WorkItem &item : work) {
+    size_t x = item.tile_x, y = item.tile_y;
+    size_t tile_idx = x / imageTileSize + y / imageTileSize * num_tiles_w;
+    tiles[tile_idx].reset(x, y, std::min(imageTileSize, sampleBuffer.w - x),
+                          std::min(imageTileSize, sampleBuffer.h - y));
+  }
+
+  // tiles restored from a checkpoint are not rendered again
+  vector<bool> restored(tiles.size(), false);
+  size_t num_restored = 0;
+  for (const RenderCheckpoint::Tile &saved : resumeState.tiles) {
+    if (saved.index >= tiles.size() || restored[saved.index]) continue;
+    TileBuffer &tile = tiles[saved.index];
+    if (tile.w == 0 || saved.sum.size() != tile.w * tile.h ||
+        !aovBuffer.load_region(tile.x0, tile.y0, tile.w, tile.h,
+                               saved.layers)) {
+      continue;
     }
+    tile.restore(saved.sum, saved.num_passes, sampleBuffer);
+    sampleBuffer.toColor(frameBuffer, tile.x0, tile.y0, tile.x0 + tile.w,
+                         tile.y0 + tile.h);
+    restored[saved.index] = true;
+    num_restored++;
+  }
+  if (!resumeState.tiles.empty()) {
+    fprintf(stdout, "[PathTracer] Resumed %zu of %zu tiles\n", num_restored,
+            work.size());
+    resumeState.tiles.clear();
+  }
+
+  // populate the tile work queue
+  for (const WorkItem &item : work) {
+    size_t tile_idx = item.tile_x / imageTileSize +
+                      item.tile_y / imageTileSize * num_tiles_w;
+    if (!restored[tile_idx]) workQueue.put_work(item);
   }
 
   // launch threads
@@ -210,6 +349,92 @@ void PathTracer::start_raytracing() {
   for (int i = 0; i < numWorkerThreads; i++) {
     workerThreads[i] = new std::thread(&PathTracer::worker_thread, this);
   }
+
+  if (!checkpoint_path.empty()) {
+    if (checkpointThread.joinable()) checkpointThread.join();
+    checkpointStop = false;
+    checkpointThread = std::thread(&PathTracer::checkpoint_thread, this);
+  }
+}
+
+void PathTracer::set_checkpoint(const string &path, double interval) {
+  checkpoint_path = path;
+  checkpoint_interval = std::max(interval, 1.0);
+}
+
+bool PathTracer::resume(const string &path) {
+  if (state != READY) return false;
+
+  RenderCheckpoint checkpoint;
+  if (!checkpoint.read(path)) {
+    fprintf(stderr, "[PathTracer] Could not read checkpoint %s\n",
+            path.c_str());
+    return false;
+  }
+  if (!checkpoint.same_render(checkpoint_header())) {
+    fprintf(stderr,
+            "[PathTracer] Checkpoint %s is of a render with other settings\n",
+            path.c_str());
+    return false;
+  }
+  std::swap(resumeState, checkpoint);
+  return true;
+}
+
+RenderCheckpoint PathTracer::checkpoint_header() const {
+  RenderCheckpoint header;
+  header.width = sampleBuffer.w;
+  header.height = sampleBuffer.h;
+  header.tile_size = imageTileSize;
+  header.seed = render_seed;
+  header.ns_aa = ns_aa;
+  header.max_ray_depth = max_ray_depth;
+  header.ns_area_light = ns_area_light;
+  header.aovs = aovBuffer.enabled;
+  return header;
+}
+
+void PathTracer::write_checkpoint() {
+  Timer timer;
+  timer.start();
+
+  // the workers only hold the lock of a tile while merging a pass into it,
+  // and finished tiles are not written again, so copying them does not
+  // hold up the render
+  RenderCheckpoint checkpoint = checkpoint_header();
+  for (size_t i = 0; i < tiles.size(); ++i) {
+    RenderCheckpoint::Tile saved;
+    saved.index = i;
+    saved.num_passes = tiles[i].snapshot(&saved.sum);
+    if (saved.num_passes == 0) continue;
+
+    const TileBuffer &tile = tiles[i];
+    aovBuffer.save_region(tile.x0, tile.y0, tile.w, tile.h, saved.layers);
+    checkpoint.tiles.push_back(saved);
+  }
+
+  if (!checkpoint.write(checkpoint_path)) {
+    fprintf(stderr, "[PathTracer] Error writing checkpoint %s\n",
+            checkpoint_path.c_str());
+    return;
+  }
+  timer.stop();
+  fprintf(stderr, "[PathTracer] Checkpoint of %zu tiles saved to %s (%.4f sec)\n",
+          checkpoint.tiles.size(), checkpoint_path.c_str(), timer.duration());
+}
+
+void PathTracer::checkpoint_thread() {
+  std::unique_lock<std::mutex> guard(checkpointLock);
+  while (!checkpointStop) {
+    checkpointWake.wait_for(
+        guard, std::chrono::duration<double>(checkpoint_interval),
+        [this]() { return checkpointStop; });
+
+    // once more when the render stops, with all the tiles it finished
+    guard.unlock();
+    write_checkpoint();
+    guard.lock();
+  }
 }
 
 void PathTracer::build_accel() {
@@ -218,10 +443,12 @@ void PathTracer::build_accel() {
   fflush(stdout);
   timer.start();
   vector<Primitive *> primitives;
+  aovBuffer.clear_ids();
   for (SceneObject *obj : scene->objects) {
     const vector<Primitive *> &obj_prims = obj->get_primitives();
     primitives.reserve(primitives.size() + obj_prims.size());
     primitives.insert(primitives.end(), obj_prims.begin(), obj_prims.end());
+    if (aovBuffer.enabled & AOV_IDS) aovBuffer.add_object_ids(obj_prims);
   }
   timer.stop();
   fprintf(stdout, "Done! (%.4f sec)\n", timer.duration());
@@ -392,18 +619,25 @@ void PathTracer::key_press(int key) {
 }
 
 
-Spectrum PathTracer::trace_ray(const Ray &r) {
+Spectrum PathTracer::trace_ray(const Ray &r, const Spectrum &throughput,
+                               bool specular) {
   Intersection isect;
 
+  if (r.depth == 0) tl_num_samples++;
+  tl_num_segments++;
+  tl_num_rays++;
+
   if (!bvh->intersect(r, &isect)) {
 // log ray miss
 #ifdef ENABLE_RAY_LOGGING
     log_ray_miss(r);
 #endif
 
-    // TODO (PathTracer):
-    // (Task 7) If you have an environment map, return the Spectrum this ray
-    // samples from the environment map. If you don't return black.
+    if (r.depth == 0) tl_hit = AOVHit();
+
+    // The environment map is one of the scene lights, so after a non-delta
+    // bounce it has already been accounted for by direct lighting.
+    if (envLight && specular) return envLight->sample_dir(r);
     return Spectrum(0, 0, 0);
   }
 
@@ -412,20 +646,30 @@ Spectrum PathTracer::trace_ray(const Ray &r) {
   log_ray_hit(r, isect.t);
 #endif
 
-  Spectrum L_out = isect.bsdf->get_emission();  // Le
+  // the BSDF with its textures looked up at the hit
+  BSDFStorage bsdf_storage;
+  BSDF *bsdf = isect.bsdf->at(isect.uv, &bsdf_storage);
+
+  if (r.depth == 0 && aovBuffer.enabled) {
+    tl_hit.albedo = bsdf->rasterize_color;
+    tl_hit.normal = isect.n;
+    tl_hit.depth = isect.t;
+    tl_hit.primitive = isect.primitive;
+  }
 
-  // TODO (PathTracer):
-  // Instead of initializing this value to a constant color, use the direct,
-  // indirect lighting components calculated in the code below. The starter
-  // code overwrites L_out by (.5,.5,.5) so that you can test your geometry
-  // queries before you implement path tracing.
-  L_out = Spectrum(5.f, 5.f, 5.f);
+  // Le. After a non-delta bounce, the emission of surfaces that scene
+  // lights stand in for was already counted by direct lighting at the
+  // previous vertex.
+  Spectrum L_out = bsdf->get_emission();
+  if (!specular && L_out != Spectrum() && emission_counted(r, isect.t)) {
+    L_out = Spectrum();
+  }
 
   Vector3D hit_p = r.o + r.d * isect.t;
-  Vector3D hit_n = isect.n;
 
   // make a coordinate system for a hit point
-  // with N aligned with the Z direction.
+  // with N aligned with the Z direction. N is the shading normal, while
+  // directions leaving the point are kept to its side of the surface itself.
   Matrix3x3 o2w;
   make_coord_space(o2w, isect.n);
   Matrix3x3 w2o = o2w.T();
@@ -436,75 +680,197 @@ Spectrum PathTracer::trace_ray(const Ray &r) {
   w_out.normalize();
 
 
-  if (!isect.bsdf->is_delta()) {
-    Vector3D dir_to_light;
-    float dist_to_light;
-    float pr;
-
-    // ### Estimate direct lighting integral
-    for (SceneLight* light : scene->lights) {
+  // ### Estimate direct lighting integral
+  if (!bsdf->is_delta()) {
+    tl_shadow_rays.clear();
+    tl_shadow_L.clear();
+    sample_direct_lighting(hit_p, isect.ng, o2w, w_out, bsdf, tl_shadow_rays,
+                           tl_shadow_L);
 
-      // no need to take multiple samples from a point/directional source
-      int num_light_samples = light->is_delta_light() ? 1 : ns_area_light;
+    // only accumulate light if the surface is not in shadow
+    for (size_t i = 0; i < tl_shadow_rays.size(); ++i) {
+      tl_num_rays++;
+      if (!bvh->intersect(tl_shadow_rays[i])) L_out += tl_shadow_L[i];
+    }
+  }
 
-      // integrate light over the hemisphere about the normal
-      for (int i = 0; i < num_light_samples; i++) {
+  // ### Estimate indirect lighting integral
+  Ray bounce;
+  Spectrum weight;
+  if (sample_bounce(r, hit_p, isect.ng, o2w, w_out, bsdf, throughput, &bounce,
+                    &weight)) {
+    L_out += weight * trace_ray(bounce, throughput * weight, bsdf->is_delta());
+  }
 
-        // returns a vector 'dir_to_light' that is a direction from
-        // point hit_p to the point on the light source.  It also returns
-        // the distance from point x to this point on the light source.
-        // (pr is the probability of randomly selecting the random
-        // sample point on the light source -- more on this in part 2)
-        const Spectrum& light_L = light->sample_L(hit_p, &dir_to_light, &dist_to_light, &pr);
+  return L_out;
+}
 
-        // convert direction into coordinate space of the surface, where
-        // the surface normal is [0 0 1]
-        const Vector3D& w_in = w2o * dir_to_light;
-        if (w_in.z < 0) continue;
+bool PathTracer::emission_counted(const Ray &r, double t) const {
+  // the shadow rays of direct lighting stop EPS_F short of the light
+  for (SceneLight *light : scene->lights) {
+    if (light->is_delta_light()) continue;
+    float dist_to_light;
+    if (light->eval_L(r.o, r.d, &dist_to_light) != Spectrum() &&
+        dist_to_light < t + EPS_F) {
+      return true;
+    }
+  }
+  return false;
+}
 
-          // note that computing dot(n,w_in) is simple
+template <typename BSDFClass>
+void PathTracer::sample_direct_lighting(const Vector3D &hit_p,
+                                        const Vector3D &hit_ng,
+                                        const Matrix3x3 &o2w,
+                                        const Vector3D &w_out, BSDFClass *bsdf,
+                                        vector<Ray> &shadow_rays,
+                                        vector<Spectrum> &shadow_L) {
+  Matrix3x3 w2o = o2w.T();
+  Vector3D dir_to_light;
+  float dist_to_light;
+  float pr = 0;
+
+  // Each light is estimated with two strategies, sampling the light and
+  // sampling the BSDF, and the two are combined by multiple importance
+  // sampling with the power heuristic. Light sampling does well on small
+  // lights, BSDF sampling on large lights seen through a glossy lobe, and
+  // the weights let whichever strategy is better dominate a direction.
+  for (SceneLight *light : scene->lights) {
+
+    // no need to take multiple samples from a point/directional source
+    bool is_delta_light = light->is_delta_light();
+    int num_light_samples = is_delta_light ? 1 : ns_area_light;
+    double scale = 1.0 / num_light_samples;
+
+    // integrate light over the hemisphere about the normal
+    for (int i = 0; i < num_light_samples; i++) {
+
+      // returns a vector 'dir_to_light' that is a direction from
+      // point hit_p to the point on the light source.  It also returns
+      // the distance from point x to this point on the light source.
+      // (pr is the probability of randomly selecting the random
+      // sample point on the light source -- more on this in part 2)
+      const Spectrum &light_L =
+          light->sample_L(hit_p, &dir_to_light, &dist_to_light, &pr);
+
+      // convert direction into coordinate space of the surface, where
+      // the surface normal is [0 0 1]
+      const Vector3D &w_in = w2o * dir_to_light;
+      if (light_L != Spectrum() && pr > 0 && w_in.z > 0 &&
+          same_side(dir_to_light, w_in.z, hit_ng)) {
+
+        // note that computing dot(n,w_in) is simple
         // in surface coordinates since the normal is (0,0,1)
         double cos_theta = w_in.z;
-          
+
         // evaluate surface bsdf
-        const Spectrum& f = isect.bsdf->f(w_out, w_in);
+        const Spectrum &f = bsdf->f(w_out, w_in);
 
-        // TODO (PathTracer):
-        // (Task 4) Construct a shadow ray and compute whether the intersected surface is
-        // in shadow. Only accumulate light if not in shadow.
-        L_out += (cos_theta / (num_light_samples * pr)) * f * light_L;
+        double w = is_delta_light ? 1.0
+                                  : power_heuristic(pr, bsdf->pdf(w_out, w_in));
+        shadow_rays.push_back(Ray(hit_p, dir_to_light, dist_to_light - EPS_F));
+        shadow_rays.back().min_t = EPS_F;
+        shadow_L.push_back((w * scale * cos_theta / pr) * f * light_L);
       }
+
+      // a delta light can never be hit by a sampled direction
+      if (is_delta_light) continue;
+
+      // sample the BSDF and see if the sampled direction reaches the light
+      Vector3D w_in_bsdf;
+      float pb;
+      const Spectrum &f = bsdf->sample_f(w_out, &w_in_bsdf, &pb);
+      if (w_in_bsdf.z <= 0 || pb <= 0 || f == Spectrum()) continue;
+
+      Vector3D dir = o2w * w_in_bsdf;
+      dir.normalize();
+      if (!same_side(dir, w_in_bsdf.z, hit_ng)) continue;
+      const Spectrum &bsdf_L = light->eval_L(hit_p, dir, &dist_to_light);
+      if (bsdf_L == Spectrum()) continue;
+
+      double w = power_heuristic(pb, light->pdf(hit_p, dir));
+      shadow_rays.push_back(Ray(hit_p, dir, dist_to_light - EPS_F));
+      shadow_rays.back().min_t = EPS_F;
+      shadow_L.push_back((w * scale * w_in_bsdf.z / pb) * f * bsdf_L);
     }
   }
+}
 
-  // TODO (PathTracer):
-  // ### (Task 5) Compute an indirect lighting estimate using pathtracing with Monte Carlo.
-
+template <typename BSDFClass>
+bool PathTracer::sample_bounce(const Ray &r, const Vector3D &hit_p,
+                               const Vector3D &hit_ng, const Matrix3x3 &o2w,
+                               const Vector3D &w_out, BSDFClass *bsdf,
+                               const Spectrum &throughput, Ray *bounce,
+                               Spectrum *weight) {
+  // max_ray_depth is a hard cap on the path length. Below it, paths are
+  // ended by Russian roulette once they are rr_min_depth long, with a
+  // survival probability given by the luminance of the path throughput.
+  // Surviving paths are reweighted by the inverse of that probability, so
+  // the estimate stays unbiased while dark paths end early.
+  if (r.depth + 1 >= max_ray_depth) return false;
 
-  // Note that Ray objects have a depth field now; you should use this to avoid
-  // traveling down one path forever.
-  
   // (1) randomly select a new ray direction (it may be
   // reflection or transmittence ray depending on
   // surface type -- see BSDF::sample_f()
+  Vector3D w_in;
+  float pdf;
+  const Spectrum &f = bsdf->sample_f(w_out, &w_in, &pdf);
+  if (pdf <= 0 || f == Spectrum()) return false;
+
+  Vector3D dir = o2w * w_in;
+  dir.normalize();
+  if (!same_side(dir, w_in.z, hit_ng)) return false;
+
+  *weight = f * (abs_cos_theta(w_in) / pdf);
 
   // (2) potentially terminate path (using Russian roulette)
+  if (r.depth + 1 >= rr_min_depth) {
+    Spectrum path_throughput = throughput * *weight;
+    float survive = clamp(path_throughput.illum(), rr_min_prob, rr_max_prob);
+    if (random_uniform() >= survive) return false;
+    *weight *= 1.f / survive;
+  }
 
-  // (3) evaluate weighted reflectance contribution due 
+  // (3) the caller evaluates the weighted reflectance contribution due
   // to light from this direction
+  *bounce = Ray(hit_p, dir, (int)r.depth + 1);
+  bounce->min_t = EPS_F;
+  // Only paths of delta bounces look up the environment map through their
+  // rays, so a bounce keeps the spread of the ray it continues.
+  bounce->spread = r.spread;
+  return true;
+}
 
-  return L_out;
+double PathTracer::pixel_solid_angle() const {
+  double w = 2 * tan(radians(camera->h_fov()) / 2) / sampleBuffer.w;
+  double h = 2 * tan(radians(camera->v_fov()) / 2) / sampleBuffer.h;
+  return w * h;
 }
 
 Spectrum PathTracer::raytrace_pixel(size_t x, size_t y) {
-  // TODO (PathTracer):
   // Sample the pixel with coordinate (x,y) and return the result spectrum.
   // The sample rate is given by the number of camera rays per pixel.
 
+  // The enabled AOVs are gathered along the way.
+
   int num_samples = ns_aa;
+  bool aovs = aovBuffer.enabled;
+  double spread = pixel_solid_angle();
+
+  Spectrum L;
+  AOVPixel aov;
+  for (int i = 0; i < num_samples; i++) {
+    Vector2D p = Vector2D(x, y) + gridSampler->get_sample();
+    Ray r = camera->generate_ray(p.x / sampleBuffer.w, p.y / sampleBuffer.h);
+    r.spread = spread;
+    Spectrum L_i = trace_ray(r);
+    L += L_i;
+    if (aovs) aov.add(L_i, tl_hit);
+  }
 
-  Vector2D p = Vector2D(0.5, 0.5);
-  return trace_ray(camera->generate_ray(p.x, p.y));
+  L *= 1.f / num_samples;
+  if (aovs) aovBuffer.update_pixel(aov, L, x, y);
+  return L;
 }
 
 void PathTracer::raytrace_tile(int tile_x, int tile_y, int tile_w, int tile_h) {
@@ -519,40 +885,270 @@ void PathTracer::raytrace_tile(int tile_x, int tile_y, int tile_w, int tile_h) {
 
   size_t tile_idx_x = tile_x / imageTileSize;
   size_t tile_idx_y = tile_y / imageTileSize;
-  size_t num_samples_tile = tile_samples[tile_idx_x + tile_idx_y * num_tiles_w];
+  seed_random(render_seed + tile_idx_x + tile_idx_y * num_tiles_w);
 
+  size_t span_x = tile_end_x - tile_start_x;
+  tl_tile_pass.resize(span_x * (tile_end_y - tile_start_y));
+  Float4 *pass = &tl_tile_pass[0];
   for (size_t y = tile_start_y; y < tile_end_y; y++) {
     if (!continueRaytracing) return;
     for (size_t x = tile_start_x; x < tile_end_x; x++) {
       Spectrum s = raytrace_pixel(x, y);
-      sampleBuffer.update_pixel(s, x, y);
+      *pass++ = Float4(s * ns_aa, ns_aa);
     }
   }
 
-  tile_samples[tile_idx_x + tile_idx_y * num_tiles_w] += 1;
+  num_samples += tl_num_samples;
+  num_segments += tl_num_segments;
+  num_rays += tl_num_rays;
+  tl_num_samples = tl_num_segments = tl_num_rays = 0;
+
+  tiles[tile_idx_x + tile_idx_y * num_tiles_w].add_pass(tl_tile_pass,
+                                                        sampleBuffer);
   sampleBuffer.toColor(frameBuffer, tile_start_x, tile_start_y, tile_end_x,
                        tile_end_y);
+  frameDisplay.mark_dirty(tile_start_x, tile_start_y, tile_end_x, tile_end_y);
+}
+
+void PathTracer::raytrace_tile_wavefront(int tile_x, int tile_y, int tile_w,
+                                         int tile_h, PathPool &pool) {
+  size_t w = sampleBuffer.w;
+  size_t h = sampleBuffer.h;
+
+  size_t tile_start_x = tile_x;
+  size_t tile_start_y = tile_y;
+
+  size_t tile_end_x = std::min(tile_start_x + tile_w, w);
+  size_t tile_end_y = std::min(tile_start_y + tile_h, h);
+
+  size_t tile_idx_x = tile_x / imageTileSize;
+  size_t tile_idx_y = tile_y / imageTileSize;
+  seed_random(render_seed + tile_idx_x + tile_idx_y * num_tiles_w);
+
+  size_t span_x = tile_end_x - tile_start_x;
+  size_t num_pixels = span_x * (tile_end_y - tile_start_y);
+  size_t num_paths = num_pixels * ns_aa;
+  size_t next_path = 0;
+
+  pool.reset(std::min(num_paths, wavefront_pool_size), num_pixels);
+  bool aovs = aovBuffer.enabled;
+  double spread = pixel_solid_angle();
+  if (aovs) pool.reset_aovs(num_pixels);
+
+  while (true) {
+    if (!continueRaytracing) return;
+
+    // (1) generate: start new camera paths in the idle slots. Consecutive
+    // paths go to neighboring pixels so that the stream stays coherent.
+    while (!pool.idle.empty() && next_path < num_paths) {
+      size_t slot = pool.idle.back();
+      pool.idle.pop_back();
+
+      size_t pixel = next_path++ % num_pixels;
+      Vector2D p = Vector2D(tile_start_x + pixel % span_x,
+                            tile_start_y + pixel / span_x) +
+                   gridSampler->get_sample();
+      pool.rays[slot] = camera->generate_ray(p.x / w, p.y / h);
+      pool.rays[slot].spread = spread;
+      pool.throughput[slot] = Spectrum(1, 1, 1);
+      pool.radiance[slot] = Spectrum();
+      pool.pixel[slot] = pixel;
+      pool.specular[slot] = 1;
+      pool.active.push_back(slot);
+      tl_num_samples++;
+    }
+    if (pool.active.empty()) break;
+
+    // (2) extend: find the closest hit of every path's ray
+    for (size_t slot : pool.active) pool.isects[slot] = Intersection();
+    bvh->intersect(pool.rays, pool.active, pool.isects);
+    tl_num_segments += pool.active.size();
+    tl_num_rays += pool.active.size();
+
+    // (3) shade: add emission, queue up light connections and sample the
+    // continuation of each path, exactly as trace_ray does. Hits are first
+    // sorted by BSDF type so that each queue runs code for a single BSDF.
+    pool.shadow_rays.clear();
+    pool.shadow_L.clear();
+    pool.shadow_path.clear();
+    for (vector<size_t> &queue : pool.queues) queue.clear();
+    for (size_t slot : pool.active) {
+      const Intersection &isect = pool.isects[slot];
+      pool.alive[slot] = 0;
+
+      if (aovs && pool.rays[slot].depth == 0) {
+        AOVHit &hit = pool.hits[slot];
+        hit = AOVHit();
+        if (isect.t != INF_D) {
+          BSDFStorage bsdf_storage;
+          BSDF *bsdf = isect.bsdf->at(isect.uv, &bsdf_storage);
+          hit.albedo = bsdf->rasterize_color;
+          hit.normal = isect.n;
+          hit.depth = isect.t;
+          hit.primitive = isect.primitive;
+        }
+      }
+
+      if (isect.t == INF_D) {
+        if (envLight && pool.specular[slot]) {
+          pool.radiance[slot] +=
+              pool.throughput[slot] * envLight->sample_dir(pool.rays[slot]);
+        }
+        continue;
+      }
+
+      pool.queues[isect.bsdf->type].push_back(slot);
+    }
+    shade_queue<DiffuseBSDF>(pool, pool.queues[DIFFUSE_BSDF]);
+    shade_queue<MirrorBSDF>(pool, pool.queues[MIRROR_BSDF]);
+    shade_queue<GlossyBSDF>(pool, pool.queues[GLOSSY_BSDF]);
+    shade_queue<RefractionBSDF>(pool, pool.queues[REFRACTION_BSDF]);
+    shade_queue<GlassBSDF>(pool, pool.queues[GLASS_BSDF]);
+    shade_queue<EmissionBSDF>(pool, pool.queues[EMISSION_BSDF]);
+
+    // (4) connect: resolve all the light connections in one stream
+    size_t num_shadow_rays = pool.shadow_rays.size();
+    if (num_shadow_rays > 0) {
+      pool.shadow_stream.resize(num_shadow_rays);
+      for (size_t i = 0; i < num_shadow_rays; ++i) pool.shadow_stream[i] = i;
+      pool.shadow_hit.assign(num_shadow_rays, 0);
+      bvh->occluded(pool.shadow_rays, pool.shadow_stream, pool.shadow_hit);
+      for (size_t i = 0; i < num_shadow_rays; ++i) {
+        if (!pool.shadow_hit[i]) {
+          pool.radiance[pool.shadow_path[i]] += pool.shadow_L[i];
+        }
+      }
+      tl_num_rays += num_shadow_rays;
+    }
+
+    // (5) accumulate: retire the paths that ended and free their slots
+    size_t num_active = 0;
+    for (size_t slot : pool.active) {
+      if (pool.alive[slot]) {
+        pool.active[num_active++] = slot;
+      } else {
+        pool.accum[pool.pixel[slot]] += pool.radiance[slot];
+        if (aovs) {
+          pool.aovs[pool.pixel[slot]].add(pool.radiance[slot],
+                                          pool.hits[slot]);
+        }
+        pool.idle.push_back(slot);
+      }
+    }
+    pool.active.resize(num_active);
+  }
+
+  float scale = 1.f / ns_aa;
+  tl_tile_pass.resize(num_pixels);
+  for (size_t pixel = 0; pixel < num_pixels; ++pixel) {
+    tl_tile_pass[pixel] = Float4(pool.accum[pixel], ns_aa);
+  }
+  if (aovs) {
+    for (size_t y = tile_start_y; y < tile_end_y; y++) {
+      for (size_t x = tile_start_x; x < tile_end_x; x++) {
+        size_t pixel = (x - tile_start_x) + (y - tile_start_y) * span_x;
+        aovBuffer.update_pixel(pool.aovs[pixel], pool.accum[pixel] * scale, x,
+                               y);
+      }
+    }
+  }
+
+  num_samples += tl_num_samples;
+  num_segments += tl_num_segments;
+  num_rays += tl_num_rays;
+  tl_num_samples = tl_num_segments = tl_num_rays = 0;
+
+  tiles[tile_idx_x + tile_idx_y * num_tiles_w].add_pass(tl_tile_pass,
+                                                        sampleBuffer);
+  sampleBuffer.toColor(frameBuffer, tile_start_x, tile_start_y, tile_end_x,
+                       tile_end_y);
+  frameDisplay.mark_dirty(tile_start_x, tile_start_y, tile_end_x, tile_end_y);
+}
+
+template <typename BSDFClass>
+void PathTracer::shade_queue(PathPool &pool, const vector<size_t> &queue) {
+  for (size_t slot : queue) {
+    const Ray &r = pool.rays[slot];
+    const Intersection &isect = pool.isects[slot];
+    BSDFStorage bsdf_storage;
+    BSDFClass *bsdf =
+        static_cast<BSDFClass *>(isect.bsdf->at(isect.uv, &bsdf_storage));
+    Spectrum &throughput = pool.throughput[slot];
+
+    Spectrum emission = bsdf->get_emission();
+    if (emission != Spectrum() &&
+        (pool.specular[slot] || !emission_counted(r, isect.t))) {
+      pool.radiance[slot] += throughput * emission;
+    }
+
+    Vector3D hit_p = r.o + r.d * isect.t;
+
+    Matrix3x3 o2w;
+    make_coord_space(o2w, isect.n);
+    Matrix3x3 w2o = o2w.T();
+
+    Vector3D w_out = w2o * (r.o - hit_p);
+    w_out.normalize();
+
+    if (!bsdf->is_delta()) {
+      size_t first = pool.shadow_rays.size();
+      sample_direct_lighting(hit_p, isect.ng, o2w, w_out, bsdf,
+                             pool.shadow_rays, pool.shadow_L);
+      for (size_t i = first; i < pool.shadow_rays.size(); ++i) {
+        pool.shadow_L[i] *= throughput;
+        pool.shadow_path.push_back(slot);
+      }
+    }
+
+    Ray bounce;
+    Spectrum weight;
+    if (sample_bounce(r, hit_p, isect.ng, o2w, w_out, bsdf, throughput,
+                      &bounce, &weight)) {
+      pool.specular[slot] = bsdf->is_delta();
+      pool.rays[slot] = bounce;
+      throughput *= weight;
+      pool.alive[slot] = 1;
+    }
+  }
 }
 
 void PathTracer::worker_thread() {
   Timer timer;
   timer.start();
 
+  PathPool pool;  // only used by the wavefront integrator
+
   WorkItem work;
   while (continueRaytracing && workQueue.try_get_work(&work)) {
-    raytrace_tile(work.tile_x, work.tile_y, work.tile_w, work.tile_h);
+    if (use_wavefront) {
+      raytrace_tile_wavefront(work.tile_x, work.tile_y, work.tile_w,
+                              work.tile_h, pool);
+    } else {
+      raytrace_tile(work.tile_x, work.tile_y, work.tile_w, work.tile_h);
+    }
   }
 
-  workerDoneCount++;
-  if (!continueRaytracing && workerDoneCount == numWorkerThreads) {
-    timer.stop();
-    fprintf(stdout, "Canceled!\n");
-    state = READY;
+  // only the last worker to finish wraps up the render, so the count is
+  // read once
+  bool last = ++workerDoneCount == (int)numWorkerThreads;
+  if (!last) return;
+
+  {
+    std::lock_guard<std::mutex> guard(checkpointLock);
+    checkpointStop = true;
+    checkpointWake.notify_all();
   }
 
-  if (continueRaytracing && workerDoneCount == numWorkerThreads) {
-    timer.stop();
-    fprintf(stdout, "Done! (%.4fs)\n", timer.duration());
+  timer.stop();
+  if (!continueRaytracing) {
+    fprintf(stdout, "Canceled!\n");
+    state = READY;
+  } else {
+    double samples = std::max<size_t>(num_samples, 1);
+    fprintf(stdout, "Done! (%.4fs) [%.2f rays/sample, average path length %.2f]\n",
+            timer.duration(), num_rays / samples, num_segments / samples);
+    if (use_denoiser && aovBuffer.has(AOV_DENOISER)) apply_denoiser();
+    if (tm_operator != TONEMAP_NONE || use_denoiser) present_result();
     state = DONE;
   }
 }
@@ -569,25 +1165,136 @@ void PathTracer::decrease_area_light_sample_count() {
           ns_area_light);
 }
 
+void PathTracer::apply_denoiser() {
+  denoiser.denoise(sampleBuffer, aovBuffer.albedo, aovBuffer.normal,
+                   aovBuffer.depth, denoisedBuffer, numWorkerThreads);
+}
+
+void PathTracer::present_result() {
+  const HDRImageBuffer &result = result_buffer();
+  if (tm_operator == TONEMAP_NONE) {
+    result.toColor(frameBuffer, 0, 0, frameBuffer.w, frameBuffer.h);
+  } else {
+    result.tonemap(frameBuffer, tm_gamma, tm_level, tm_key, tm_wht,
+                   tm_operator, numWorkerThreads);
+  }
+  frameDisplay.mark_all_dirty();
+}
+
+void PathTracer::toggle_denoiser() {
+  use_denoiser = !use_denoiser;
+  fprintf(stdout, "[PathTracer] Denoiser %s\n", use_denoiser ? "on" : "off");
+
+  if (!use_denoiser) {
+    if (state == DONE) present_result();
+    return;
+  }
+
+  // the features are gathered while rendering, so a render started without
+  // them cannot be denoised
+  if (!aovBuffer.has(AOV_DENOISER)) {
+    fprintf(stdout, "[PathTracer] Denoising starts with the next render\n");
+    return;
+  }
+  if (state != DONE) return;
+
+  if (denoisedBuffer.is_empty()) apply_denoiser();
+  present_result();
+}
+
+void PathTracer::cycle_tone_operator() {
+  const char *names[] = {"off", "Reinhard", "ACES"};
+  tm_operator = (ToneOperator)((tm_operator + 1) % 3);
+  fprintf(stdout, "[PathTracer] Tone mapping %s\n", names[tm_operator]);
+
+  if (state == DONE) present_result();
+}
+
 bool PathTracer::is_done() {
   update_screen();
   return (state == DONE);
 }
 
+const HDRImageBuffer &PathTracer::result_buffer() const {
+  if (use_denoiser && !denoisedBuffer.is_empty()) return denoisedBuffer;
+  return sampleBuffer;
+}
+
+void PathTracer::write_in_background(std::function<bool()> write,
+                                     string fname) {
+  fprintf(stderr, "[PathTracer] Saving to file in the background: %s\n",
+          fname.c_str());
+  writerThreads.push_back(std::thread([this, write, fname]() {
+    Timer timer;
+    timer.start();
+    if (write()) {
+      timer.stop();
+      fprintf(stderr, "[PathTracer] Saved %s (%.4f sec)\n", fname.c_str(),
+              timer.duration());
+    } else {
+      writeFailed = true;
+    }
+  }));
+}
+
+void PathTracer::write_in_background(EXRWriter *writer, string fname) {
+  std::shared_ptr<EXRWriter> file(writer);
+  write_in_background([file, fname]() { return file->write(fname); }, fname);
+}
+
+bool PathTracer::wait_for_writes() {
+  for (std::thread &t : writerThreads) t.join();
+  writerThreads.clear();
+  if (state == DONE && checkpointThread.joinable()) checkpointThread.join();
+  return !writeFailed.exchange(false);
+}
+
+void PathTracer::save_aovs(string fname) {
+  if (state != DONE) {
+    writeFailed = true;
+    return;
+  }
+
+  const HDRImageBuffer &result = result_buffer();
+  EXRWriter *writer = new EXRWriter(result.w, result.h, exr_pixel_type);
+  writer->add_rgb("", result);
+  aovBuffer.add_layers(*writer);
+  write_in_background(writer, fname);
+}
+
 void PathTracer::save_image(string fname) {
-  if (state != DONE) return;
+  if (state != DONE) {
+    writeFailed = true;
+    return;
+  }
+
+  // high dynamic range output, of the linear radiance before tonemapping
+  if (fname.size() >= 4 && fname.compare(fname.size() - 4, 4, ".exr") == 0) {
+    const HDRImageBuffer &result = result_buffer();
+    EXRWriter *writer = new EXRWriter(result.w, result.h, exr_pixel_type);
+    writer->add_rgb("", result);
+    write_in_background(writer, fname);
+    return;
+  }
 
+  // the flipped copy is encoded on a background thread
   uint32_t *frame = &frameBuffer.data[0];
   size_t w = frameBuffer.w;
   size_t h = frameBuffer.h;
-  uint32_t *frame_out = new uint32_t[w * h];
+  std::shared_ptr<vector<uint32_t> > frame_out(new vector<uint32_t>(w * h));
   for (size_t i = 0; i < h; ++i) {
-    memcpy(frame_out + i * w, frame + (h - i - 1) * w, 4 * w);
+    memcpy(&(*frame_out)[i * w], frame + (h - i - 1) * w, 4 * w);
   }
 
-  fprintf(stderr, "[PathTracer] Saving to file: %s... ", fname.c_str());
-  lodepng::encode(fname, (unsigned char *)frame_out, w, h);
-  fprintf(stderr, "Done!\n");
+  write_in_background([frame_out, fname, w, h]() {
+    unsigned error =
+        lodepng::encode(fname, (unsigned char *)&(*frame_out)[0], w, h);
+    if (error) {
+      fprintf(stderr, "Error writing PNG file %s: %s\n", fname.c_str(),
+              lodepng_error_text(error));
+    }
+    return error == 0;
+  }, fname);
 }
 
 }  // namespace CMU462
@@ -4,7 +4,10 @@
 #include <stack>
 #include <thread>
 #include <atomic>
+#include <memory>
 #include <vector>
+#include <functional>
+#include <condition_variable>
 #include <algorithm>
 
 #include "CMU462/timer.h"
@@ -13,7 +16,13 @@
 #include "camera.h"
 #include "sampler.h"
 #include "image.h"
+#include "frame_display.h"
 #include "work_queue.h"
+#include "path_pool.h"
+#include "tile_buffer.h"
+#include "checkpoint.h"
+#include "denoiser.h"
+#include "aov.h"
 
 #include "static_scene/scene.h"
 using CMU462::StaticScene::Scene;
@@ -57,7 +66,9 @@ class PathTracer {
   PathTracer(size_t ns_aa = 1, size_t max_ray_depth = 4,
              size_t ns_area_light = 1, size_t ns_diff = 1, size_t ns_glsy = 1,
              size_t ns_refr = 1, size_t num_threads = 1,
-             HDRImageBuffer* envmap = NULL);
+             EnvironmentMap* envmap = NULL, bool wavefront = false,
+             bool denoise = false, int aovs = AOV_NONE,
+             bool exr_half = false, ToneOperator tone_operator = TONEMAP_NONE);
 
   /**
    * Destructor.
@@ -121,6 +132,43 @@ class PathTracer {
    */
   void start_raytracing();
 
+  /**
+   * If the pathtracer is in READY, transition to RENDERING and render only
+   * the given tiles of the image. The rest of the image is left black.
+   * \param work tiles to render, on the grid of tile_size() squares
+   */
+  void start_raytracing(const vector<WorkItem>& work);
+
+  /**
+   * Save the progress of the next renders to a file, every given number of
+   * seconds and when they stop, so that they can be resumed. The file is
+   * written on a thread of its own, which copies the finished tiles while
+   * the workers go on rendering.
+   * \param path path of the checkpoint file, empty to turn checkpoints off
+   * \param interval seconds between checkpoints
+   */
+  void set_checkpoint(const string& path, double interval);
+
+  /**
+   * If in READY, read a checkpoint, and skip the tiles it holds in the next
+   * render. As every tile is seeded the same in each render, the result is
+   * the same as that of a render that was never interrupted.
+   * \param path path of the checkpoint file
+   * \return false if the file could not be read or is of a render with
+   *         other settings
+   */
+  bool resume(const string& path);
+
+  /**
+   * Size of the square tiles the image is rendered in.
+   */
+  size_t tile_size() const { return imageTileSize; }
+
+  /**
+   * Radiance accumulated by the last render, before any denoising.
+   */
+  const HDRImageBuffer& get_sample_buffer() const { return sampleBuffer; }
+
   /**
    * If the pathtracer is in VISUALIZE, handle key presses to traverse the bvh.
    */
@@ -131,16 +179,53 @@ class PathTracer {
    */
   void increase_area_light_sample_count();
 
+  /**
+   * Set the number of camera rays per pixel of the next render.
+   */
+  void set_ns_aa(size_t ns_aa) { this->ns_aa = std::max<size_t>(ns_aa, 1); }
+
+  /**
+   * If a scene has been given and its BVH built.
+   */
+  bool has_scene() const { return scene != NULL; }
+
   /**
    * Decrease the pathtracer's area light sample count parameter by 2X
    */
   void decrease_area_light_sample_count();
 
   /**
-   * Save rendered result to png file.
+   * Turn the denoiser on or off. If the render is done, the displayed
+   * result switches between the denoised and the raw image right away.
+   */
+  void toggle_denoiser();
+
+  /**
+   * Switch to the next tone curve: none, Reinhard, then ACES. If the render
+   * is done, the displayed result is mapped again right away.
+   */
+  void cycle_tone_operator();
+
+  /**
+   * Save rendered result to png file, or if the file name ends in .exr, the
+   * radiance before tonemapping to an OpenEXR file. The file is written on
+   * a background thread.
    */
   void save_image(string filename);
 
+  /**
+   * Save rendered result and its AOVs to a multi-layer OpenEXR file. The
+   * file is written on a background thread.
+   */
+  void save_aovs(string filename);
+
+  /**
+   * Wait for the files being written in the background.
+   * \return false if any file saved since the last wait could not be
+   *         written, or if saving was asked for before the render was done
+   */
+  bool wait_for_writes();
+
   /**
    * Wait for the scene to finish raytracing.  Additionally calls
    * update_screen to update the screen with the current output.
@@ -166,6 +251,12 @@ class PathTracer {
    */
   void build_accel();
 
+  /**
+   * Delete the BVH and the scene, whose objects its primitives belong to,
+   * keeping the environment light.
+   */
+  void delete_scene();
+
   /**
    * Visualize acceleration structures.
    */
@@ -173,8 +264,75 @@ class PathTracer {
 
   /**
    * Trace an ray in the scene.
+   * \param ray the ray to trace
+   * \param throughput product of the BSDF weights along the path so far,
+   *        used to decide Russian roulette termination
+   * \param specular whether the ray left a delta BSDF (or the camera), in
+   *        which case the lights it reaches were not sampled directly
+   */
+  Spectrum trace_ray(const Ray& ray,
+                     const Spectrum& throughput = Spectrum(1, 1, 1),
+                     bool specular = true);
+
+  /**
+   * Whether the emission of a surface a ray hits after a non-delta bounce
+   * was already counted by direct lighting at the origin of the ray. It was
+   * if a scene light stands in for the surface, one the ray meets no
+   * farther than the surface, so that its shadow ray was not blocked by it.
+   * Other emitting surfaces are only found by the bounce.
+   * \param r ray that left a non-delta BSDF
+   * \param t time at which the ray hits the surface
+   */
+  bool emission_counted(const Ray& r, double t) const;
+
+  /**
+   * Estimate direct lighting at a shading point. Instead of tracing shadow
+   * rays itself, it appends the shadow ray of every light connection and the
+   * radiance the connection contributes if unoccluded, so that each
+   * integrator can resolve visibility in its own way.
+   * BSDFClass is either BSDF, or a concrete (final) BSDF class, in which
+   * case the BSDF calls are resolved statically.
+   * \param hit_p shading point
+   * \param hit_ng geometric normal at the shading point
+   * \param o2w local to world transform of the shading frame
+   * \param w_out outgoing direction in the shading frame
+   * \param bsdf non-delta BSDF at the shading point
+   * \param shadow_rays array to append shadow rays to
+   * \param shadow_L array to append contributions to
+   */
+  template <typename BSDFClass>
+  void sample_direct_lighting(const Vector3D& hit_p, const Vector3D& hit_ng,
+                              const Matrix3x3& o2w, const Vector3D& w_out,
+                              BSDFClass* bsdf,
+                              vector<Ray>& shadow_rays,
+                              vector<Spectrum>& shadow_L);
+
+  /**
+   * Sample the continuation of a path at a shading point, applying the
+   * depth cap and Russian roulette.
+   * \param r ray that reached the shading point
+   * \param hit_p shading point
+   * \param hit_ng geometric normal at the shading point
+   * \param o2w local to world transform of the shading frame
+   * \param w_out outgoing direction in the shading frame
+   * \param bsdf BSDF at the shading point
+   * \param throughput path throughput up to the shading point
+   * \param bounce address to store the next ray of the path
+   * \param weight address to store the weight of the bounce
+   * \return false if the path ends here
+   */
+  template <typename BSDFClass>
+  bool sample_bounce(const Ray& r, const Vector3D& hit_p,
+                     const Vector3D& hit_ng, const Matrix3x3& o2w,
+                     const Vector3D& w_out, BSDFClass* bsdf,
+                     const Spectrum& throughput, Ray* bounce,
+                     Spectrum* weight);
+
+  /**
+   * Solid angle a pixel covers at the center of the image, the spread of
+   * camera rays.
    */
-  Spectrum trace_ray(const Ray& ray);
+  double pixel_solid_angle() const;
 
   /**
    * Trace a camera ray given by the pixel coordinate.
@@ -187,6 +345,69 @@ class PathTracer {
    */
   void raytrace_tile(int tile_x, int tile_y, int tile_w, int tile_h);
 
+  /**
+   * Raytrace a tile with the wavefront integrator. All the samples of the
+   * tile go through the path pool, which advances every path in flight one
+   * stage at a time: generate camera paths into idle slots, extend them with
+   * a ray stream traversal, shade the hits, connect the shadow rays with a
+   * second stream traversal and accumulate the paths that ended. Is run in a
+   * worker thread, which reuses its pool from tile to tile.
+   */
+  void raytrace_tile_wavefront(int tile_x, int tile_y, int tile_w, int tile_h,
+                               PathPool& pool);
+
+  /**
+   * Shade stage of the wavefront integrator for one queue of hits, all of
+   * which have a BSDF of class BSDFClass.
+   */
+  template <typename BSDFClass>
+  void shade_queue(PathPool& pool, const vector<size_t>& queue);
+
+  /**
+   * Denoise the finished render into denoisedBuffer and show it in the
+   * frame buffer.
+   */
+  void apply_denoiser();
+
+  /**
+   * Show the result of the finished render in the frame buffer, mapped with
+   * the selected tone curve.
+   */
+  void present_result();
+
+  /**
+   * The radiance of the render, denoised if the denoiser is on.
+   */
+  const HDRImageBuffer& result_buffer() const;
+
+  /**
+   * Write a file on a new thread.
+   * \param write writes the file, returns false if it failed
+   * \param filename name of the file, for the log
+   */
+  void write_in_background(std::function<bool()> write, string filename);
+
+  /**
+   * Write an OpenEXR file on a new thread, which takes ownership of the
+   * writer.
+   */
+  void write_in_background(EXRWriter* writer, string filename);
+
+  /**
+   * Settings of the render that decide its samples, for checkpoints.
+   */
+  RenderCheckpoint checkpoint_header() const;
+
+  /**
+   * Copy the finished tiles and write them to the checkpoint file.
+   */
+  void write_checkpoint();
+
+  /**
+   * Write checkpoints until the render stops.
+   */
+  void checkpoint_thread();
+
   /**
    * Implementation of a ray tracer worker thread
    */
@@ -225,21 +446,52 @@ class PathTracer {
   size_t ns_glsy;        ///< number of samples - glossy surfaces
   size_t ns_refr;        ///< number of samples - refractive surfaces
 
+  bool use_wavefront;          ///< use the wavefront integrator
+  size_t wavefront_pool_size;  ///< max paths in flight per worker thread
+
+  bool use_denoiser;  ///< denoise the result once rendering is done
+
+  EXRWriter::PixelType exr_pixel_type;  ///< pixel type of OpenEXR output
+
+  size_t rr_min_depth;  ///< depth after which Russian roulette may end paths
+  float rr_min_prob;    ///< lower clamp of the path survival probability
+  float rr_max_prob;    ///< upper clamp of the path survival probability
+
   // Integration state //
 
-  vector<int> tile_samples;  ///< current sample rate for tile
+  vector<TileBuffer> tiles;  ///< samples accumulated in each tile
   size_t num_tiles_w;        ///< number of tiles along width of the image
   size_t num_tiles_h;        ///< number of tiles along height of the image
+  uint64_t render_seed;      ///< seed of the tiles, see seed_random
+
+  std::atomic<size_t> num_samples;   ///< camera rays traced
+  std::atomic<size_t> num_segments;  ///< camera and bounce rays traced
+  std::atomic<size_t> num_rays;      ///< all rays traced, including shadow
+
+  // Checkpoints //
+
+  string checkpoint_path;                  ///< checkpoint file, or empty
+  double checkpoint_interval;              ///< seconds between checkpoints
+  RenderCheckpoint resumeState;            ///< tiles the next render restores
+  std::thread checkpointThread;            ///< writes checkpoints
+  std::mutex checkpointLock;               ///< guards checkpointStop
+  std::condition_variable checkpointWake;  ///< wakes the checkpoint thread
+  bool checkpointStop;                     ///< the render stopped
 
   // Components //
 
-  BVHAccel* bvh;                 ///< BVH accelerator aggregate
-  EnvironmentLight* envLight;    ///< environment map
-  Sampler2D* gridSampler;        ///< samples unit grid
-  Sampler3D* hemisphereSampler;  ///< samples unit hemisphere
-  HDRImageBuffer sampleBuffer;   ///< sample buffer
-  ImageBuffer frameBuffer;       ///< frame buffer
-  Timer timer;                   ///< performance test timer
+  BVHAccel* bvh;                  ///< BVH accelerator aggregate
+  EnvironmentMap* envMap;         ///< environment map, loads in background
+  EnvironmentLight* envLight;     ///< light of the environment map
+  Sampler2D* gridSampler;         ///< samples unit grid
+  Sampler3D* hemisphereSampler;   ///< samples unit hemisphere
+  HDRImageBuffer sampleBuffer;    ///< sample buffer
+  ImageBuffer frameBuffer;        ///< frame buffer
+  FrameDisplay frameDisplay;      ///< shows the frame buffer in the window
+  AOVBuffer aovBuffer;            ///< arbitrary output variables
+  Denoiser denoiser;              ///< denoiser post pass
+  HDRImageBuffer denoisedBuffer;  ///< result of the denoiser
+  Timer timer;                    ///< performance test timer
 
   // Internals //
 
@@ -248,6 +500,8 @@ class PathTracer {
 
   bool continueRaytracing;                  ///< rendering should continue
   std::vector<std::thread*> workerThreads;  ///< pool of worker threads
+  std::vector<std::thread> writerThreads;   ///< files being written
+  std::atomic<bool> writeFailed;            ///< if a file could not be saved
   std::atomic<int> workerDoneCount;         ///< worker threads management
   WorkQueue<WorkItem> workQueue;            ///< queue of work for the workers
 
@@ -258,6 +512,8 @@ class PathTracer {
   float tm_key;    ///< key value
   float tm_wht;    ///< white point
 
+  ToneOperator tm_operator;  ///< tone curve
+
   // Visualizer Controls //
 
   std::stack<BVHNode*> selectionHistory;  ///< node selection history
@@ -20,6 +20,16 @@ struct Ray {
   Vector3D inv_d;  ///< component wise inverse
   int sign[3];     ///< fast ray-bbox intersection
 
+  double spread;  ///< solid angle of the cone of directions the ray stands
+                  ///< for, 0 for a single direction
+
+  /**
+   * Default constructor.
+   * Creates an empty ray so that rays can be kept in arrays and assigned
+   * later, e.g. by the wavefront integrator's path pool.
+   */
+  Ray() : min_t(0.0), max_t(INF_D), depth(0), spread(0.0) {}
+
   /**
    * Constructor.
    * Create a ray instance with given origin and direction.
@@ -28,7 +38,7 @@ struct Ray {
    * \param depth depth of the ray
    */
   Ray(const Vector3D& o, const Vector3D& d, int depth = 0)
-      : o(o), d(d), min_t(0.0), max_t(INF_D), depth(depth) {
+      : o(o), d(d), min_t(0.0), max_t(INF_D), depth(depth), spread(0.0) {
     inv_d = Vector3D(1 / d.x, 1 / d.y, 1 / d.z);
     sign[0] = (inv_d.x < 0);
     sign[1] = (inv_d.y < 0);
@@ -44,7 +54,7 @@ struct Ray {
    * \param depth depth of the ray
    */
   Ray(const Vector3D& o, const Vector3D& d, double max_t, int depth = 0)
-      : o(o), d(d), min_t(0.0), max_t(max_t), depth(depth) {
+      : o(o), d(d), min_t(0.0), max_t(max_t), depth(depth), spread(0.0) {
     inv_d = Vector3D(1 / d.x, 1 / d.y, 1 / d.z);
     sign[0] = (inv_d.x < 0);
     sign[1] = (inv_d.y < 0);
@@ -0,0 +1,279 @@
+#include "render_server.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <fstream>
+#include <sstream>
+#include <iostream>
+
+#include "CMU462/timer.h"
+
+#ifndef _WIN32
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#endif
+
+namespace CMU462 {
+
+bool parse_render_job(const std::string& line, RenderJob* job,
+                      std::string* error) {
+  *job = RenderJob();
+
+  std::stringstream ss(line);
+  std::string token;
+  while (ss >> token) {
+    size_t split = token.find('=');
+    if (split == std::string::npos) {
+      *error = "expected key=value, got " + token;
+      return false;
+    }
+    std::string key = token.substr(0, split);
+    std::string value = token.substr(split + 1);
+
+    if (key == "scene") {
+      job->scene_path = value;
+    } else if (key == "out") {
+      job->output_path = value;
+    } else if (key == "aov") {
+      job->aov_path = value;
+    } else if (key == "spp") {
+      int ns_aa = atoi(value.c_str());
+      if (ns_aa <= 0) {
+        *error = "invalid spp " + value;
+        return false;
+      }
+      job->ns_aa = ns_aa;
+    } else if (key == "size") {
+      int w, h;
+      if (sscanf(value.c_str(), "%dx%d", &w, &h) != 2 || w <= 0 || h <= 0) {
+        *error = "invalid size " + value;
+        return false;
+      }
+      job->width = w;
+      job->height = h;
+    } else if (key == "camera") {
+      Vector3D& p = job->camera_pos;
+      Vector3D& t = job->camera_target;
+      if (sscanf(value.c_str(), "%lf,%lf,%lf,%lf,%lf,%lf", &p.x, &p.y, &p.z,
+                 &t.x, &t.y, &t.z) != 6 ||
+          (p - t).norm() == 0) {
+        *error = "invalid camera " + value;
+        return false;
+      }
+      job->has_camera = true;
+    } else {
+      *error = "unknown key " + key;
+      return false;
+    }
+  }
+
+  if (job->scene_path.empty() || job->output_path.empty()) {
+    *error = "a job needs a scene and an out path";
+    return false;
+  }
+  return true;
+}
+
+RenderServer::RenderServer(const AppConfig& config, size_t cache_size)
+    : config(config), cache_size(std::max<size_t>(cache_size, 1)) {}
+
+RenderServer::~RenderServer() {
+  for (auto& entry : cache) delete entry.second;
+}
+
+Application* RenderServer::get_scene(const std::string& path,
+                                     std::string* error) {
+  for (auto it = cache.begin(); it != cache.end(); ++it) {
+    if (it->first == path) {
+      cache.splice(cache.begin(), cache, it);
+      return it->second;
+    }
+  }
+
+  // binary scene files are only rendered, so they skip halfedge meshes
+  Application* app;
+  if (SceneFile::is_scene_file(path)) {
+    SceneFile* sceneFile = new SceneFile();
+    if (!sceneFile->load(path)) {
+      delete sceneFile;
+      *error = "could not load " + path;
+      return NULL;
+    }
+    app = new Application(config);
+    app->init_headless = true;
+    app->init();
+    app->load(sceneFile, false);
+  } else {
+    Collada::SceneInfo* sceneInfo = new Collada::SceneInfo();
+    if (Collada::ColladaParser::load(path.c_str(), sceneInfo) < 0) {
+      delete sceneInfo;
+      *error = "could not parse " + path;
+      return NULL;
+    }
+    app = new Application(config);
+    app->init_headless = true;
+    app->init();
+    app->load(sceneInfo);
+    delete sceneInfo;
+  }
+
+  if (cache.size() == cache_size) {
+    fprintf(stdout, "[Scotty3D] Unloading %s\n", cache.back().first.c_str());
+    delete cache.back().second;
+    cache.pop_back();
+  }
+  cache.push_front(std::make_pair(path, app));
+  return app;
+}
+
+bool RenderServer::render(const RenderJob& job, std::string* error) {
+  Application* app = get_scene(job.scene_path, error);
+  if (!app) return false;
+
+  app->set_render_size(
+      job.width ? job.width : config.pathtracer_result_width,
+      job.height ? job.height : config.pathtracer_result_height);
+  app->set_render_sample_count(job.ns_aa ? job.ns_aa
+                                         : config.pathtracer_ns_aa);
+  if (job.has_camera) {
+    app->place_camera(job.camera_pos, job.camera_target);
+  } else {
+    app->restore_camera();
+  }
+
+  if (!app->render_scene(job.output_path, job.aov_path)) {
+    *error = "could not write " + job.output_path +
+             (job.aov_path != "" ? " or " + job.aov_path : "");
+    return false;
+  }
+  return true;
+}
+
+size_t RenderServer::run_job_file(const std::string& path) {
+  std::ifstream file;
+  if (path != "-") {
+    file.open(path.c_str());
+    if (!file) {
+      fprintf(stderr, "[Scotty3D] Error opening job file %s\n", path.c_str());
+      return 1;
+    }
+  }
+  std::istream& in = path == "-" ? std::cin : file;
+
+  size_t num_jobs = 0, num_failed = 0;
+  Timer timer;
+  std::string line, error;
+  while (std::getline(in, line)) {
+    size_t start = line.find_first_not_of(" \t\r");
+    if (start == std::string::npos || line[start] == '#') continue;
+
+    num_jobs++;
+    RenderJob job;
+    timer.start();
+    if (!parse_render_job(line, &job, &error) || !render(job, &error)) {
+      fprintf(stderr, "[Scotty3D] Job %zu failed: %s\n", num_jobs,
+              error.c_str());
+      num_failed++;
+      continue;
+    }
+    timer.stop();
+    fprintf(stdout, "[Scotty3D] Job %zu done: %s (%.4f sec)\n", num_jobs,
+            job.output_path.c_str(), timer.duration());
+  }
+
+  fprintf(stdout, "[Scotty3D] %zu of %zu jobs done\n", num_jobs - num_failed,
+          num_jobs);
+  return num_failed;
+}
+
+#ifdef _WIN32
+
+bool RenderServer::run_socket(const std::string& path) {
+  fprintf(stderr, "[Scotty3D] UNIX sockets are not supported here\n");
+  return false;
+}
+
+#else
+
+bool RenderServer::run_socket(const std::string& path) {
+  sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(addr.sun_path)) {
+    fprintf(stderr, "[Scotty3D] Socket path too long: %s\n", path.c_str());
+    return false;
+  }
+  strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+
+  int server = socket(AF_UNIX, SOCK_STREAM, 0);
+  unlink(path.c_str());
+  if (server < 0 || bind(server, (sockaddr*)&addr, sizeof(addr)) < 0 ||
+      listen(server, 8) < 0) {
+    fprintf(stderr, "[Scotty3D] Error listening on %s: %s\n", path.c_str(),
+            strerror(errno));
+    if (server >= 0) close(server);
+    return false;
+  }
+
+  // a client that hangs up early must not kill the server
+  signal(SIGPIPE, SIG_IGN);
+  fprintf(stdout, "[Scotty3D] Listening on %s\n", path.c_str());
+
+  bool quit = false;
+  while (!quit) {
+    int client = accept(server, NULL, NULL);
+    if (client < 0) {
+      if (errno == EINTR) continue;
+      break;
+    }
+
+    std::string pending;
+    char buffer[4096];
+    ssize_t n;
+    while (!quit && (n = read(client, buffer, sizeof(buffer))) > 0) {
+      pending.append(buffer, n);
+
+      size_t end;
+      while (!quit && (end = pending.find('\n')) != std::string::npos) {
+        std::string line = pending.substr(0, end);
+        pending.erase(0, end + 1);
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        if (line.empty()) continue;
+
+        std::string reply;
+        if (line == "quit") {
+          reply = "bye\n";
+          quit = true;
+        } else {
+          RenderJob job;
+          std::string error;
+          Timer timer;
+          timer.start();
+          if (parse_render_job(line, &job, &error) && render(job, &error)) {
+            timer.stop();
+            char seconds[32];
+            snprintf(seconds, sizeof(seconds), "%.4f", timer.duration());
+            reply = "ok " + job.output_path + " " + seconds + "\n";
+          } else {
+            reply = "error " + error + "\n";
+          }
+        }
+        if (write(client, reply.c_str(), reply.size()) < 0) break;
+      }
+    }
+    close(client);
+  }
+
+  close(server);
+  unlink(path.c_str());
+  return true;
+}
+
+#endif
+
+}  // namespace CMU462
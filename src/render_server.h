@@ -0,0 +1,113 @@
+#ifndef CMU462_RENDER_SERVER_H
+#define CMU462_RENDER_SERVER_H
+
+#include <list>
+#include <string>
+
+#include "CMU462/vector3D.h"
+
+#include "application.h"
+
+namespace CMU462 {
+
+/**
+ * A render request to the batch server. Fields left at zero keep the
+ * settings the server was started with.
+ */
+struct RenderJob {
+  RenderJob() : ns_aa(0), width(0), height(0), has_camera(false) {}
+
+  std::string scene_path;   ///< COLLADA file to render
+  std::string output_path;  ///< image to write, OpenEXR if it ends in .exr
+  std::string aov_path;     ///< OpenEXR file for the AOVs, empty for none
+  size_t ns_aa;             ///< camera rays per pixel
+  size_t width;             ///< width of the image
+  size_t height;            ///< height of the image
+
+  bool has_camera;         ///< the job places the camera
+  Vector3D camera_pos;     ///< position of the camera
+  Vector3D camera_target;  ///< point the camera looks at
+};
+
+/**
+ * Parse a job from a line of whitespace separated key=value pairs, e.g.
+ * "scene=cornell.dae out=cornell.png spp=64 size=640x480". The keys are
+ * scene and out, which are required, and aov, spp, size and
+ * camera=px,py,pz,tx,ty,tz.
+ * \param line line to parse
+ * \param job address to store the job
+ * \param error address to store what is wrong with the line
+ * \return false if the line is not a valid job
+ */
+bool parse_render_job(const std::string& line, RenderJob* job,
+                      std::string* error);
+
+/**
+ * Renders jobs back to back without a window, from a job file or from
+ * clients of a UNIX socket. Loaded scenes are kept with their BVHs in a
+ * cache of the most recently used ones, so jobs that render the same scene
+ * again skip parsing and building. Jobs run one at a time, each on all the
+ * render threads the server was configured with.
+ */
+class RenderServer {
+ public:
+  /**
+   * Constructor.
+   * \param config settings of every render, jobs may change some of them
+   * \param cache_size number of scenes kept loaded
+   */
+  RenderServer(const AppConfig& config, size_t cache_size = 4);
+
+  /**
+   * Destructor.
+   * Frees all the loaded scenes.
+   */
+  ~RenderServer();
+
+  /**
+   * Render the jobs of a file, one job per line. Empty lines and lines
+   * starting with # are skipped.
+   * \param path path of the file, - for the standard input
+   * \return number of jobs that failed
+   */
+  size_t run_job_file(const std::string& path);
+
+  /**
+   * Listen on a UNIX socket and render the jobs clients send, one per line.
+   * Each job is answered with a line "ok <output> <seconds>" or
+   * "error <message>". A client sending "quit" stops the server.
+   * \param path path of the socket
+   * \return false if the socket could not be set up
+   */
+  bool run_socket(const std::string& path);
+
+  /**
+   * Render a job.
+   * \param job job to render
+   * \param error address to store why the job failed
+   * \return false if the job failed
+   */
+  bool render(const RenderJob& job, std::string* error);
+
+ private:
+  /**
+   * Get a loaded scene, loading it if it is not in the cache. Loading a
+   * scene into a full cache frees the least recently used one.
+   * \param path COLLADA file of the scene
+   * \param error address to store why the scene could not be loaded
+   * \return application holding the scene, NULL if loading failed
+   */
+  Application* get_scene(const std::string& path, std::string* error);
+
+  AppConfig config;   ///< settings of every render
+  size_t cache_size;  ///< number of scenes kept loaded
+
+  /**
+   * Loaded scenes, most recently used first.
+   */
+  std::list<std::pair<std::string, Application*> > cache;
+};
+
+}  // namespace CMU462
+
+#endif  // CMU462_RENDER_SERVER_H
@@ -0,0 +1,52 @@
+#ifndef CMU462_RNG_H
+#define CMU462_RNG_H
+
+#include <stdint.h>
+
+namespace CMU462 {
+
+/**
+ * Random numbers of the renderer. Every thread has a generator of its own
+ * (PCG32), so threads do not contend for one as they do for std::rand. The
+ * path tracer seeds it at the start of every tile, which makes the samples
+ * of a tile depend only on the tile and not on the thread that renders it,
+ * and a render that is resumed from a checkpoint comes out the same as one
+ * that was never interrupted.
+ */
+inline uint64_t& random_state() {
+  static thread_local uint64_t state = 0x853c49e6748fea9bULL;
+  return state;
+}
+
+/**
+ * Seed the generator of this thread.
+ * \param seed seed, any value
+ */
+inline void seed_random(uint64_t seed) {
+  // mix the bits so that neighbouring seeds start far apart
+  seed += 0x9e3779b97f4a7c15ULL;
+  seed = (seed ^ (seed >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  seed = (seed ^ (seed >> 27)) * 0x94d049bb133111ebULL;
+  random_state() = seed ^ (seed >> 31);
+}
+
+/**
+ * Next 32 random bits of the generator of this thread.
+ */
+inline uint32_t random_uint32() {
+  uint64_t& state = random_state();
+  uint64_t old = state;
+  state = old * 6364136223846793005ULL + 1442695040888963407ULL;
+  uint32_t xorshifted = (uint32_t)(((old >> 18u) ^ old) >> 27u);
+  uint32_t rot = (uint32_t)(old >> 59u);
+  return (xorshifted >> rot) | (xorshifted << ((-rot) & 31));
+}
+
+/**
+ * Uniform random number in [0, 1).
+ */
+inline double random_uniform() { return random_uint32() * (1.0 / 4294967296.0); }
+
+}  // namespace CMU462
+
+#endif  // CMU462_RNG_H
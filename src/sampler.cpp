@@ -1,21 +1,22 @@
 #include "sampler.h"
+#include "rng.h"
 
 namespace CMU462 {
 
 // Uniform Sampler2D Implementation //
 
 Vector2D UniformGridSampler2D::get_sample() const {
-  // TODO (PathTracer):
-  // Implement uniform 2D grid sampler
-  
-  return Vector2D(0.5, 0.5);
+  double Xi1 = random_uniform();
+  double Xi2 = random_uniform();
+
+  return Vector2D(Xi1, Xi2);
 }
 
 // Uniform Hemisphere Sampler3D Implementation //
 
 Vector3D UniformHemisphereSampler3D::get_sample() const {
-  double Xi1 = (double)(std::rand()) / RAND_MAX;
-  double Xi2 = (double)(std::rand()) / RAND_MAX;
+  double Xi1 = random_uniform();
+  double Xi2 = random_uniform();
 
   double theta = acos(Xi1);
   double phi = 2.0 * PI * Xi2;
@@ -33,8 +34,31 @@ Vector3D CosineWeightedHemisphereSampler3D::get_sample() const {
 }
 
 Vector3D CosineWeightedHemisphereSampler3D::get_sample(float *pdf) const {
-  // You may implement this, but don't have to.
-  return Vector3D(0, 0, 1);
+  // Malley's method: sample the unit disk uniformly and project up onto the
+  // hemisphere, which yields directions distributed by cos(theta) / PI.
+  // The disk is sampled with Shirley and Chiu's concentric mapping, which
+  // maps squares to rings without the distortion of the polar mapping, so
+  // stratified inputs stay well stratified on the hemisphere.
+  double Xi1 = 2.0 * random_uniform() - 1.0;
+  double Xi2 = 2.0 * random_uniform() - 1.0;
+
+  double r, phi;
+  if (Xi1 == 0 && Xi2 == 0) {
+    r = phi = 0;
+  } else if (fabs(Xi1) > fabs(Xi2)) {
+    r = Xi1;
+    phi = (PI / 4) * (Xi2 / Xi1);
+  } else {
+    r = Xi2;
+    phi = (PI / 2) - (PI / 4) * (Xi1 / Xi2);
+  }
+
+  double xs = r * cos(phi);
+  double ys = r * sin(phi);
+  double zs = sqrt(std::max(0.0, 1.0 - r * r));
+
+  *pdf = zs / PI;
+  return Vector3D(xs, ys, zs);
 }
 
 }  // namespace CMU462
@@ -0,0 +1,526 @@
+#include "scene_file.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <map>
+
+#include "dynamic_scene/scene.h"
+#include "dynamic_scene/mesh.h"
+#include "dynamic_scene/sphere.h"
+#include "dynamic_scene/skeleton.h"
+#include "dynamic_scene/joint.h"
+#include "static_scene/object.h"
+
+namespace CMU462 {
+
+static const char scene_file_magic[8] = {'S', '3', 'D', 'S', 'C', 'E', 'N', 'E'};
+static const uint32_t scene_file_version = 2;
+
+// the arrays of a mesh are used in place, so they must be laid out as in
+// memory
+static_assert(sizeof(Vector3D) == 3 * sizeof(double),
+              "Vector3D must be three packed doubles");
+static_assert(sizeof(Vector2D) == 2 * sizeof(double),
+              "Vector2D must be two packed doubles");
+
+/**
+ * Writes values and 8 byte aligned arrays to a file.
+ */
+class SceneWriter {
+ public:
+  SceneWriter(FILE* file) : file(file), offset(0), ok(true) {}
+
+  template <typename T>
+  void put(const T& value) {
+    put_bytes(&value, sizeof(T));
+  }
+
+  void put(const Vector3D& v) {
+    put(v.x);
+    put(v.y);
+    put(v.z);
+  }
+
+  void put(const Spectrum& s) {
+    put(s.r);
+    put(s.g);
+    put(s.b);
+  }
+
+  void put(const Matrix4x4& m) {
+    for (int i = 0; i < 4; ++i) {
+      for (int j = 0; j < 4; ++j) put(m(i, j));
+    }
+  }
+
+  void put(const std::string& s) {
+    put((uint32_t)s.size());
+    put_bytes(s.data(), s.size());
+  }
+
+  template <typename T>
+  void put_array(const T* values, size_t n) {
+    static const char zeros[8] = {0};
+    put_bytes(zeros, (8 - offset % 8) % 8);
+    put_bytes(values, n * sizeof(T));
+  }
+
+  bool good() const { return ok; }
+
+ private:
+  void put_bytes(const void* data, size_t size) {
+    if (ok && size && fwrite(data, 1, size, file) != size) ok = false;
+    offset += size;
+  }
+
+  FILE* file;
+  size_t offset;
+  bool ok;
+};
+
+/**
+ * Reads values and 8 byte aligned arrays from a mapped file. Arrays are not
+ * copied; the reader returns pointers into the file.
+ */
+class SceneReader {
+ public:
+  SceneReader(char* data, size_t size)
+      : data(data), size(size), offset(0), ok(true) {}
+
+  template <typename T>
+  void get(T* value) {
+    get_bytes(value, sizeof(T));
+  }
+
+  void get(Vector3D* v) {
+    get(&v->x);
+    get(&v->y);
+    get(&v->z);
+  }
+
+  void get(Spectrum* s) {
+    get(&s->r);
+    get(&s->g);
+    get(&s->b);
+  }
+
+  void get(Matrix4x4* m) {
+    for (int i = 0; i < 4; ++i) {
+      for (int j = 0; j < 4; ++j) get(&(*m)(i, j));
+    }
+  }
+
+  void get(std::string* s) {
+    uint32_t n = 0;
+    get(&n);
+    if (!ok || offset > size || n > size - offset) {
+      ok = false;
+      s->clear();
+      return;
+    }
+    s->assign(data + offset, n);
+    offset += n;
+  }
+
+  template <typename T>
+  T* get_array(size_t n) {
+    offset += (8 - offset % 8) % 8;
+    if (!ok || offset > size || n > (size - offset) / sizeof(T)) {
+      ok = false;
+      return NULL;
+    }
+    T* values = reinterpret_cast<T*>(data + offset);
+    offset += n * sizeof(T);
+    return values;
+  }
+
+  bool good() const { return ok; }
+
+ private:
+  void get_bytes(void* value, size_t n) {
+    if (!ok || offset > size || n > size - offset) {
+      ok = false;
+      memset(value, 0, n);
+      return;
+    }
+    memcpy(value, data + offset, n);
+    offset += n;
+  }
+
+  char* data;
+  size_t size;
+  size_t offset;
+  bool ok;
+};
+
+static void put_knots(SceneWriter& out, const Spline<Vector3D>& spline) {
+  out.put((uint32_t)spline.knots.size());
+  for (const auto& knot : spline.knots) {
+    out.put(knot.first);
+    out.put(knot.second);
+  }
+}
+
+static void get_knots(SceneReader& in,
+                      std::vector<std::pair<double, Vector3D> >* knots) {
+  uint32_t n = 0;
+  in.get(&n);
+  for (uint32_t i = 0; i < n && in.good(); ++i) {
+    std::pair<double, Vector3D> knot;
+    in.get(&knot.first);
+    in.get(&knot.second);
+    knots->push_back(knot);
+  }
+}
+
+static void put_joint(SceneWriter& out, const DynamicScene::Joint* joint,
+                      int32_t parent, int32_t* num_joints) {
+  int32_t index = (*num_joints)++;
+  out.put(parent);
+  out.put(joint->axis);
+  out.put(joint->capsuleRadius);
+  out.put(joint->renderScale);
+  put_knots(out, joint->positions);
+  put_knots(out, joint->rotations);
+  put_knots(out, joint->scales);
+  for (const DynamicScene::Joint* kid : joint->kids) {
+    put_joint(out, kid, index, num_joints);
+  }
+}
+
+static int32_t count_joints(const DynamicScene::Joint* joint) {
+  int32_t n = 1;
+  for (const DynamicScene::Joint* kid : joint->kids) n += count_joints(kid);
+  return n;
+}
+
+static void put_mesh(SceneWriter& out, DynamicScene::Mesh* mesh,
+                     uint32_t material) {
+  HalfedgeMesh& m = mesh->mesh;
+
+  // the triangles as the path tracer would make them
+  StaticScene::Mesh* triangles =
+      static_cast<StaticScene::Mesh*>(mesh->get_static_object());
+  std::vector<uint64_t> triangle_indices = triangles->get_indices();
+
+  // polygons, numbering the vertices as they are iterated
+  std::vector<Vector3D> positions;
+  size_t index = 0;
+  for (VertexIter v = m.verticesBegin(); v != m.verticesEnd(); v++) {
+    v->index = index++;
+    positions.push_back(v->position);
+  }
+  std::vector<uint32_t> degrees;
+  std::vector<uint64_t> polygon_indices;
+  std::vector<Vector2D> polygon_texcoords;
+  for (FaceIter f = m.facesBegin(); f != m.facesEnd(); f++) {
+    degrees.push_back(f->degree());
+    HalfedgeIter h = f->halfedge();
+    do {
+      polygon_indices.push_back(h->vertex()->index);
+      if (m.hasTexcoords()) polygon_texcoords.push_back(h->texcoord);
+      h = h->next();
+    } while (h != f->halfedge());
+  }
+
+  // the polygons share the positions of the triangles when their vertices
+  // are the same, as they are unless triangulating added vertices
+  bool shared = positions.size() == triangles->num_vertices &&
+                (positions.empty() ||
+                 memcmp(&positions[0], triangles->positions,
+                        positions.size() * sizeof(Vector3D)) == 0);
+  if (shared) positions.clear();
+
+  out.put(material);
+  out.put((uint64_t)triangles->num_vertices);
+  out.put((uint64_t)triangle_indices.size());
+  out.put((uint64_t)degrees.size());
+  out.put((uint64_t)polygon_indices.size());
+  out.put((uint64_t)positions.size());
+  out.put((uint64_t)(m.hasTexcoords() ? 1 : 0));
+  out.put_array(triangles->positions, triangles->num_vertices);
+  out.put_array(triangles->normals, triangles->num_vertices);
+  if (m.hasTexcoords()) {
+    out.put_array(triangles->texcoords, triangles->num_vertices);
+  }
+  out.put_array(triangle_indices.data(), triangle_indices.size());
+  out.put_array(degrees.data(), degrees.size());
+  out.put_array(polygon_indices.data(), polygon_indices.size());
+  out.put_array(positions.data(), positions.size());
+  out.put_array(polygon_texcoords.data(), polygon_texcoords.size());
+
+  DynamicScene::Joint* root = mesh->skeleton ? mesh->skeleton->root : NULL;
+  int32_t num_joints = root ? count_joints(root) : 0;
+  out.put(num_joints);
+  num_joints = 0;
+  if (root) put_joint(out, root, -1, &num_joints);
+
+  delete triangles;
+}
+
+bool SceneFile::write(const std::string& path, DynamicScene::Scene& scene,
+                      const Collada::CameraInfo& camera) {
+  // gather what is written, giving each material an index
+  std::vector<DynamicScene::Mesh*> meshes;
+  std::vector<DynamicScene::Sphere*> spheres;
+  std::vector<BSDF*> materials;
+  std::map<BSDF*, uint32_t> material_index;
+  for (DynamicScene::SceneObject* object : scene.objects) {
+    BSDF* bsdf = NULL;
+    if (DynamicScene::Mesh* mesh = dynamic_cast<DynamicScene::Mesh*>(object)) {
+      meshes.push_back(mesh);
+      bsdf = mesh->get_bsdf();
+    } else if (DynamicScene::Sphere* sphere =
+                   dynamic_cast<DynamicScene::Sphere*>(object)) {
+      spheres.push_back(sphere);
+      bsdf = sphere->get_bsdf();
+    } else {
+      continue;
+    }
+    if (material_index.insert(std::make_pair(bsdf, materials.size())).second) {
+      materials.push_back(bsdf);
+    }
+  }
+  std::vector<DynamicScene::SceneLight*> lights;
+  for (DynamicScene::SceneLight* light : scene.lights) {
+    if (light->info.light_type != Collada::LightType::NONE) {
+      lights.push_back(light);
+    }
+  }
+
+  std::string temp_path = path + ".tmp";
+  FILE* file = fopen(temp_path.c_str(), "wb");
+  if (!file) return false;
+  SceneWriter out(file);
+
+  out.put(scene_file_magic);
+  out.put(scene_file_version);
+  out.put((uint32_t)0);
+
+  out.put(camera.view_dir);
+  out.put(camera.up_dir);
+  out.put(camera.hFov);
+  out.put(camera.vFov);
+  out.put(camera.nClip);
+  out.put(camera.fClip);
+
+  out.put((uint32_t)materials.size());
+  for (BSDF* bsdf : materials) {
+    BSDFParameters p = bsdf->get_parameters();
+    out.put((uint32_t)p.type);
+    out.put(p.color);
+    out.put(p.reflectance);
+    out.put(p.roughness);
+    out.put(p.ior);
+    out.put(p.color_texture ? p.color_texture->path() : std::string());
+    out.put(p.roughness_texture ? p.roughness_texture->path()
+                                : std::string());
+  }
+
+  out.put((uint32_t)lights.size());
+  for (DynamicScene::SceneLight* light : lights) {
+    const Collada::LightInfo& info = light->info;
+    out.put((uint32_t)info.light_type);
+    out.put(info.spectrum);
+    out.put(info.position);
+    out.put(info.direction);
+    out.put(info.up);
+    out.put(info.falloff_deg);
+    out.put(info.falloff_exp);
+    out.put(info.constant_att);
+    out.put(info.linear_att);
+    out.put(info.quadratic_att);
+    out.put(light->transform);
+  }
+
+  out.put((uint32_t)spheres.size());
+  for (DynamicScene::Sphere* sphere : spheres) {
+    out.put(sphere->get_center());
+    out.put(sphere->get_radius());
+    out.put(material_index[sphere->get_bsdf()]);
+  }
+
+  out.put((uint32_t)meshes.size());
+  for (DynamicScene::Mesh* mesh : meshes) {
+    put_mesh(out, mesh, material_index[mesh->get_bsdf()]);
+  }
+
+  bool ok = out.good();
+  ok = fclose(file) == 0 && ok;
+  if (!ok || rename(temp_path.c_str(), path.c_str()) != 0) {
+    remove(temp_path.c_str());
+    return false;
+  }
+  return true;
+}
+
+static bool get_mesh(SceneReader& in, SceneFile::Mesh* mesh,
+                     size_t num_materials) {
+  uint64_t num_vertices, num_indices, num_polygons, num_polygon_indices,
+      num_polygon_vertices, has_texcoords;
+  in.get(&mesh->material);
+  in.get(&num_vertices);
+  in.get(&num_indices);
+  in.get(&num_polygons);
+  in.get(&num_polygon_indices);
+  in.get(&num_polygon_vertices);
+  in.get(&has_texcoords);
+  if (!in.good() || mesh->material >= num_materials) return false;
+
+  mesh->num_vertices = num_vertices;
+  mesh->positions = in.get_array<Vector3D>(num_vertices);
+  mesh->normals = in.get_array<Vector3D>(num_vertices);
+  mesh->texcoords =
+      has_texcoords ? in.get_array<Vector2D>(num_vertices) : NULL;
+  mesh->num_indices = num_indices;
+  mesh->indices = in.get_array<uint64_t>(num_indices);
+  mesh->num_polygons = num_polygons;
+  mesh->degrees = in.get_array<uint32_t>(num_polygons);
+  mesh->polygon_indices = in.get_array<uint64_t>(num_polygon_indices);
+  mesh->num_polygon_vertices = num_polygon_vertices;
+  mesh->polygon_positions = in.get_array<Vector3D>(num_polygon_vertices);
+  mesh->polygon_texcoords =
+      has_texcoords ? in.get_array<Vector2D>(num_polygon_indices) : NULL;
+  if (!in.good()) return false;
+
+  // polygons without positions of their own use those of the triangles
+  if (num_polygon_vertices == 0) {
+    mesh->num_polygon_vertices = num_vertices;
+    mesh->polygon_positions = mesh->positions;
+  }
+
+  // indices out of range would be read as vertices by the renderer and the
+  // halfedge mesh builder, so check them here once
+  for (size_t i = 0; i < num_indices; ++i) {
+    if (mesh->indices[i] >= num_vertices) return false;
+  }
+  uint64_t total_degree = 0;
+  for (size_t i = 0; i < num_polygons; ++i) total_degree += mesh->degrees[i];
+  if (num_indices % 3 || total_degree != num_polygon_indices) return false;
+  for (size_t i = 0; i < num_polygon_indices; ++i) {
+    if (mesh->polygon_indices[i] >= mesh->num_polygon_vertices) return false;
+  }
+
+  int32_t num_joints = 0;
+  in.get(&num_joints);
+  for (int32_t i = 0; i < num_joints && in.good(); ++i) {
+    SceneFile::Joint joint;
+    in.get(&joint.parent);
+    in.get(&joint.axis);
+    in.get(&joint.capsule_radius);
+    in.get(&joint.render_scale);
+    get_knots(in, &joint.positions);
+    get_knots(in, &joint.rotations);
+    get_knots(in, &joint.scales);
+    if (joint.parent >= i || (joint.parent < 0) != (i == 0)) return false;
+    mesh->joints.push_back(joint);
+  }
+  return in.good();
+}
+
+bool SceneFile::load(const std::string& path) {
+  materials.clear();
+  lights.clear();
+  spheres.clear();
+  meshes.clear();
+  if (!file.open(path.c_str())) return false;
+
+  SceneReader in(file.data(), file.size());
+  char magic[sizeof(scene_file_magic)];
+  uint32_t version, reserved;
+  in.get(&magic);
+  in.get(&version);
+  in.get(&reserved);
+  if (!in.good() || memcmp(magic, scene_file_magic, sizeof(magic)) != 0 ||
+      version != scene_file_version) {
+    file.close();
+    return false;
+  }
+
+  in.get(&camera.view_dir);
+  in.get(&camera.up_dir);
+  in.get(&camera.hFov);
+  in.get(&camera.vFov);
+  in.get(&camera.nClip);
+  in.get(&camera.fClip);
+
+  uint32_t n = 0;
+  in.get(&n);
+  for (uint32_t i = 0; i < n && in.good(); ++i) {
+    BSDFParameters p;
+    uint32_t type;
+    in.get(&type);
+    in.get(&p.color);
+    in.get(&p.reflectance);
+    in.get(&p.roughness);
+    in.get(&p.ior);
+    // a texture that fails to load is left out, as when parsing COLLADA
+    std::string color_texture, roughness_texture;
+    in.get(&color_texture);
+    in.get(&roughness_texture);
+    if (!in.good()) break;
+    if (!color_texture.empty()) p.color_texture = Texture::load(color_texture);
+    if (!roughness_texture.empty()) {
+      p.roughness_texture = Texture::load(roughness_texture);
+    }
+    p.type = (BSDFType)type;
+    BSDF* bsdf = type < NUM_BSDF_TYPES ? BSDF::make(p) : NULL;
+    if (!bsdf) break;
+    materials.push_back(bsdf);
+  }
+  bool ok = materials.size() == n;
+
+  in.get(&n);
+  for (uint32_t i = 0; ok && i < n && in.good(); ++i) {
+    Light light;
+    uint32_t type;
+    in.get(&type);
+    in.get(&light.info.spectrum);
+    in.get(&light.info.position);
+    in.get(&light.info.direction);
+    in.get(&light.info.up);
+    in.get(&light.info.falloff_deg);
+    in.get(&light.info.falloff_exp);
+    in.get(&light.info.constant_att);
+    in.get(&light.info.linear_att);
+    in.get(&light.info.quadratic_att);
+    in.get(&light.transform);
+    light.info.light_type = (Collada::LightType::T)type;
+    ok = type <= Collada::LightType::SPOT;
+    lights.push_back(light);
+  }
+
+  in.get(&n);
+  for (uint32_t i = 0; ok && i < n && in.good(); ++i) {
+    Sphere sphere;
+    in.get(&sphere.center);
+    in.get(&sphere.radius);
+    in.get(&sphere.material);
+    ok = sphere.material < materials.size();
+    spheres.push_back(sphere);
+  }
+
+  in.get(&n);
+  for (uint32_t i = 0; ok && i < n && in.good(); ++i) {
+    meshes.push_back(Mesh());
+    ok = get_mesh(in, &meshes.back(), materials.size());
+  }
+
+  if (!ok || !in.good()) {
+    for (BSDF* bsdf : materials) delete bsdf;
+    materials.clear();
+    lights.clear();
+    spheres.clear();
+    meshes.clear();
+    file.close();
+    return false;
+  }
+  return true;
+}
+
+bool SceneFile::is_scene_file(const std::string& path) {
+  return path.size() >= 4 && path.compare(path.size() - 4, 4, ".s3d") == 0;
+}
+
+}  // namespace CMU462
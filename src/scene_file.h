@@ -0,0 +1,136 @@
+#ifndef CMU462_SCENE_FILE_H
+#define CMU462_SCENE_FILE_H
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "CMU462/vector2D.h"
+#include "CMU462/vector3D.h"
+#include "CMU462/matrix4x4.h"
+
+#include "bsdf.h"
+#include "mapped_file.h"
+#include "collada/camera_info.h"
+#include "collada/light_info.h"
+
+namespace CMU462 {
+
+namespace DynamicScene {
+class Scene;
+}
+
+/**
+ * Scotty3D's binary scene format (.s3d). It holds a scene as the renderer
+ * needs it: meshes as world-space triangles with vertex normals, next to the
+ * polygons they were made from for editing, plus materials with the paths of
+ * their textures, lights, spheres, the camera and the skeletons of the
+ * meshes. Loading it skips parsing XML,
+ * and a scene that is only rendered also skips building halfedge meshes.
+ *
+ * The file is mapped into memory, and the arrays of the meshes are used
+ * straight from the map, so the file must stay loaded while the scene is in
+ * use. It is a header followed by sections in the byte order of the machine
+ * that wrote it, with every array starting at a multiple of 8 bytes.
+ */
+class SceneFile {
+ public:
+  /**
+   * A light, with the transformation it is placed by.
+   */
+  struct Light {
+    Collada::LightInfo info;
+    Matrix4x4 transform;
+  };
+
+  /**
+   * A sphere.
+   */
+  struct Sphere {
+    Vector3D center;    ///< world-space center
+    double radius;      ///< world-space radius
+    uint32_t material;  ///< index of the material
+  };
+
+  /**
+   * A joint of a skeleton, see DynamicScene::Joint.
+   */
+  struct Joint {
+    int32_t parent;  ///< index of the parent joint, -1 for the root
+    Vector3D axis;
+    double capsule_radius;
+    double render_scale;
+    std::vector<std::pair<double, Vector3D> > positions;  ///< knots
+    std::vector<std::pair<double, Vector3D> > rotations;  ///< knots
+    std::vector<std::pair<double, Vector3D> > scales;     ///< knots
+  };
+
+  /**
+   * A mesh. The arrays point into the file.
+   */
+  struct Mesh {
+    uint32_t material;  ///< index of the material
+
+    // triangles for rendering
+    size_t num_vertices;       ///< number of vertices
+    Vector3D* positions;       ///< world-space vertex positions
+    Vector3D* normals;         ///< vertex normals
+    Vector2D* texcoords;       ///< vertex texture coordinates, NULL if none
+    size_t num_indices;        ///< number of triangle indices
+    const uint64_t* indices;   ///< vertex indices, three per triangle
+
+    // polygons for editing
+    size_t num_polygons;              ///< number of polygons
+    const uint32_t* degrees;          ///< number of vertices of each polygon
+    const uint64_t* polygon_indices;  ///< vertex indices of all polygons
+    size_t num_polygon_vertices;      ///< number of polygon vertex positions
+    const Vector3D* polygon_positions;  ///< world-space vertex positions
+    const Vector2D* polygon_texcoords;  ///< texture coordinates of the
+                                        ///< vertices of all polygons, NULL
+                                        ///< if none
+
+    std::vector<Joint> joints;  ///< skeleton, parents before children
+  };
+
+  SceneFile() {}
+
+  /**
+   * Load a scene file.
+   * \param path path of the file
+   * \return false if the file could not be read or is not a scene file
+   */
+  bool load(const std::string& path);
+
+  /**
+   * Write a scene to a file. Objects other than meshes and spheres, and
+   * lights that were not made from a scene description, are left out.
+   * \param path path of the file
+   * \param scene scene to write
+   * \param camera camera of the scene, its view direction in world space
+   * \return false if the file could not be written
+   */
+  static bool write(const std::string& path, DynamicScene::Scene& scene,
+                    const Collada::CameraInfo& camera);
+
+  /**
+   * If a path names a binary scene file, by its extension.
+   */
+  static bool is_scene_file(const std::string& path);
+
+  Collada::CameraInfo camera;      ///< view direction in world space
+  std::vector<BSDF*> materials;    ///< materials, made when loaded
+  std::vector<Light> lights;       ///< lights
+  std::vector<Sphere> spheres;     ///< spheres
+  std::vector<Mesh> meshes;        ///< meshes
+
+ private:
+  SceneFile(const SceneFile&);             // not supported
+  SceneFile& operator=(const SceneFile&);  // not supported
+
+  MappedFile file;  ///< the file the arrays of the meshes point into
+};
+
+}  // namespace CMU462
+
+#endif  // CMU462_SCENE_FILE_H
@@ -1,22 +1,65 @@
 #include "environment_light.h"
 
+#include "../rng.h"
+
 namespace CMU462 {
 namespace StaticScene {
 
-EnvironmentLight::EnvironmentLight(const HDRImageBuffer* envMap)
-    : envMap(envMap) {
-  // TODO: (PathTracer) initialize things here as needed
+// The map is in latitude-longitude layout around the y axis, v = 0 looking
+// straight up. theta = pi v is the polar angle and phi = 2 pi u the azimuth.
+
+static void dir_to_uv(const Vector3D& dir, double* u, double* v) {
+  Vector3D d = dir.unit();
+  double phi = atan2(d.z, d.x);
+  if (phi < 0) phi += 2 * PI;
+  *u = phi / (2 * PI);
+  *v = acos(clamp(d.y, -1.0, 1.0)) / PI;
+}
+
+static Vector3D uv_to_dir(double u, double v) {
+  double theta = PI * v, phi = 2 * PI * u;
+  double sin_theta = sin(theta);
+  return Vector3D(sin_theta * cos(phi), cos(theta), sin_theta * sin(phi));
+}
+
+/**
+ * Density over solid angle of a density over the unit square of (u, v).
+ */
+static float solid_angle_pdf(double pdf_uv, double v) {
+  double sin_theta = sin(PI * v);
+  if (sin_theta <= 0) return 0;
+  return pdf_uv / (2 * PI * PI * sin_theta);
 }
 
+EnvironmentLight::EnvironmentLight(const EnvironmentMap* envMap)
+    : envMap(envMap) {}
+
 Spectrum EnvironmentLight::sample_L(const Vector3D& p, Vector3D* wi,
                                     float* distToLight, float* pdf) const {
-  // TODO: (PathTracer) Implement
-  return Spectrum(0, 0, 0);
+  double u, v;
+  double pdf_uv = envMap->sample(random_uniform(), random_uniform(), &u, &v);
+  *wi = uv_to_dir(u, v);
+  *distToLight = INF_D;
+  *pdf = solid_angle_pdf(pdf_uv, v);
+  return envMap->lookup(u, v);
+}
+
+float EnvironmentLight::pdf(const Vector3D& p, const Vector3D& wi) const {
+  double u, v;
+  dir_to_uv(wi, &u, &v);
+  return solid_angle_pdf(envMap->pdf(u, v), v);
+}
+
+Spectrum EnvironmentLight::eval_L(const Vector3D& p, const Vector3D& wi,
+                                  float* distToLight) const {
+  *distToLight = INF_D;
+  return sample_dir(Ray(p, wi));
 }
 
 Spectrum EnvironmentLight::sample_dir(const Ray& r) const {
-  // TODO: (PathTracer) Implement
-  return Spectrum(0, 0, 0);
+  double u, v;
+  dir_to_uv(r.d, &u, &v);
+  return envMap->lookup(u, v, envMap->level_for_solid_angle(r.spread));
 }
 
 }  // namespace StaticScene
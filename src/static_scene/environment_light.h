@@ -2,7 +2,7 @@
 #define CMU462_STATICSCENE_ENVIRONMENTLIGHT_H
 
 #include "../sampler.h"
-#include "../image.h"
+#include "../environment_map.h"
 #include "scene.h"
 
 namespace CMU462 {
@@ -15,36 +15,34 @@ namespace StaticScene {
 // model in the scene.
 class EnvironmentLight : public SceneLight {
  public:
-  EnvironmentLight(const HDRImageBuffer* envMap);
+  EnvironmentLight(const EnvironmentMap* envMap);
   /**
-   * In addition to the work done by sample_dir, this function also has to
-   * choose a ray direction to sample along. You should initially use a uniform
-   * randomly distributed direction, but later you'll be required to implement
-   * this with importance sampling. The requirements are:
-   * - Sample within a pixel with probability proportional to the total power
-   *   going through that pixel (so proportional to the pixel's area when
-   *   projected onto the sphere, multiplied by the sum of the components of its
-   *   Spectrum). This is a discrete probability distribution, so there's no
-   *   formula.
-   * - Don't take linear time to generate a single sample! You'll be calling
-   *   this a LOT; it should be fast.
+   * Draw a direction with probability proportional to the power the map
+   * sends along it, see EnvironmentMap::sample, and return the radiance of
+   * the map along it. The pdf is over solid angle.
    */
   Spectrum sample_L(const Vector3D& p, Vector3D* wi, float* distToLight,
                     float* pdf) const;
+  /**
+   * Must agree with the distribution that sample_L draws directions from,
+   * since it is used to weigh BSDF samples against light samples.
+   */
+  float pdf(const Vector3D& p, const Vector3D& wi) const;
+  /**
+   * Radiance along wi, which is simply sample_dir for a ray leaving p.
+   */
+  Spectrum eval_L(const Vector3D& p, const Vector3D& wi,
+                  float* distToLight) const;
   bool is_delta_light() const { return false; }
   /**
-   * Returns the color found on the environment map by travelling in a specific
-   * direction. This entails:
-   * - Converting the 3-d ray direction into a 2-d image coordinate.
-   * - Performing bilinear interpolation to determine the color at the given
-   *   coordinate.
-   * - Handling the edge cases correctly (what happens if you wrap around the
-   *   environment map horizontally? What about vertically?).
+   * Radiance of the map along the ray. A ray standing for a cone of
+   * directions looks up the level of the map's pyramid whose texels cover
+   * its spread, see EnvironmentMap::level_for_solid_angle.
    */
   Spectrum sample_dir(const Ray& r) const;
 
  private:
-  const HDRImageBuffer* envMap;
+  const EnvironmentMap* envMap;
 };  // class EnvironmentLight
 
 }  // namespace StaticScene
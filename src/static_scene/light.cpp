@@ -23,6 +23,15 @@ Spectrum DirectionalLight::sample_L(const Vector3D& p, Vector3D* wi,
   return radiance;
 }
 
+float DirectionalLight::pdf(const Vector3D& p, const Vector3D& wi) const {
+  return 0;
+}
+
+Spectrum DirectionalLight::eval_L(const Vector3D& p, const Vector3D& wi,
+                                  float* distToLight) const {
+  return Spectrum();
+}
+
 // Infinite Hemisphere Light //
 
 InfiniteHemisphereLight::InfiniteHemisphereLight(const Spectrum& rad)
@@ -42,6 +51,19 @@ Spectrum InfiniteHemisphereLight::sample_L(const Vector3D& p, Vector3D* wi,
   return radiance;
 }
 
+float InfiniteHemisphereLight::pdf(const Vector3D& p,
+                                   const Vector3D& wi) const {
+  // sampleToWorld takes the sampled hemisphere to the one around +y
+  return wi.y >= 0 ? 1.0 / (2.0 * M_PI) : 0.0;
+}
+
+Spectrum InfiniteHemisphereLight::eval_L(const Vector3D& p, const Vector3D& wi,
+                                         float* distToLight) const {
+  if (wi.y < 0) return Spectrum();
+  *distToLight = INF_D;
+  return radiance;
+}
+
 // Point Light //
 
 PointLight::PointLight(const Spectrum& rad, const Vector3D& pos)
@@ -56,6 +78,15 @@ Spectrum PointLight::sample_L(const Vector3D& p, Vector3D* wi,
   return radiance;
 }
 
+float PointLight::pdf(const Vector3D& p, const Vector3D& wi) const {
+  return 0;
+}
+
+Spectrum PointLight::eval_L(const Vector3D& p, const Vector3D& wi,
+                            float* distToLight) const {
+  return Spectrum();
+}
+
 // Spot Light //
 
 SpotLight::SpotLight(const Spectrum& rad, const Vector3D& pos,
@@ -66,6 +97,13 @@ Spectrum SpotLight::sample_L(const Vector3D& p, Vector3D* wi,
   return Spectrum();
 }
 
+float SpotLight::pdf(const Vector3D& p, const Vector3D& wi) const { return 0; }
+
+Spectrum SpotLight::eval_L(const Vector3D& p, const Vector3D& wi,
+                           float* distToLight) const {
+  return Spectrum();
+}
+
 // Area Light //
 
 AreaLight::AreaLight(const Spectrum& rad, const Vector3D& pos,
@@ -82,15 +120,44 @@ Spectrum AreaLight::sample_L(const Vector3D& p, Vector3D* wi,
                              float* distToLight, float* pdf) const {
   Vector2D sample = sampler.get_sample() - Vector2D(0.5f, 0.5f);
   Vector3D d = position + sample.x * dim_x + sample.y * dim_y - p;
-  float cosTheta = dot(d, direction);
   float sqDist = d.norm2();
   float dist = sqrt(sqDist);
+  float cosTheta = dot(d, direction) / dist;
   *wi = d / dist;
   *distToLight = dist;
   *pdf = sqDist / (area * fabs(cosTheta));
   return cosTheta < 0 ? radiance : Spectrum();
 };
 
+bool AreaLight::intersect(const Vector3D& p, const Vector3D& wi,
+                          float* dist) const {
+  // the light only emits on the side its direction points to
+  double cosTheta = dot(wi, direction);
+  if (cosTheta >= 0) return false;
+
+  double t = dot(position - p, direction) / cosTheta;
+  if (t <= 0) return false;
+
+  // the rectangle spans [-0.5, 0.5] along both of its (orthogonal) edges
+  Vector3D q = p + t * wi - position;
+  if (fabs(dot(q, dim_x)) > 0.5 * dim_x.norm2()) return false;
+  if (fabs(dot(q, dim_y)) > 0.5 * dim_y.norm2()) return false;
+
+  *dist = t;
+  return true;
+}
+
+float AreaLight::pdf(const Vector3D& p, const Vector3D& wi) const {
+  float dist;
+  if (!intersect(p, wi, &dist)) return 0;
+  return dist * dist / (area * fabs(dot(wi, direction)));
+}
+
+Spectrum AreaLight::eval_L(const Vector3D& p, const Vector3D& wi,
+                           float* distToLight) const {
+  return intersect(p, wi, distToLight) ? radiance : Spectrum();
+}
+
 // Sphere Light //
 
 SphereLight::SphereLight(const Spectrum& rad, const SphereObject* sphere) {}
@@ -100,6 +167,15 @@ Spectrum SphereLight::sample_L(const Vector3D& p, Vector3D* wi,
   return Spectrum();
 }
 
+float SphereLight::pdf(const Vector3D& p, const Vector3D& wi) const {
+  return 0;
+}
+
+Spectrum SphereLight::eval_L(const Vector3D& p, const Vector3D& wi,
+                             float* distToLight) const {
+  return Spectrum();
+}
+
 // Mesh Light
 
 MeshLight::MeshLight(const Spectrum& rad, const Mesh* mesh) {}
@@ -109,5 +185,12 @@ Spectrum MeshLight::sample_L(const Vector3D& p, Vector3D* wi,
   return Spectrum();
 }
 
+float MeshLight::pdf(const Vector3D& p, const Vector3D& wi) const { return 0; }
+
+Spectrum MeshLight::eval_L(const Vector3D& p, const Vector3D& wi,
+                           float* distToLight) const {
+  return Spectrum();
+}
+
 }  // namespace StaticScene
 }  // namespace CMU462
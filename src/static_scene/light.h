@@ -20,6 +20,9 @@ class DirectionalLight : public SceneLight {
   DirectionalLight(const Spectrum& rad, const Vector3D& lightDir);
   Spectrum sample_L(const Vector3D& p, Vector3D* wi, float* distToLight,
                     float* pdf) const;
+  float pdf(const Vector3D& p, const Vector3D& wi) const;
+  Spectrum eval_L(const Vector3D& p, const Vector3D& wi,
+                  float* distToLight) const;
   bool is_delta_light() const { return true; }
 
  private:
@@ -35,6 +38,9 @@ class InfiniteHemisphereLight : public SceneLight {
   InfiniteHemisphereLight(const Spectrum& rad);
   Spectrum sample_L(const Vector3D& p, Vector3D* wi, float* distToLight,
                     float* pdf) const;
+  float pdf(const Vector3D& p, const Vector3D& wi) const;
+  Spectrum eval_L(const Vector3D& p, const Vector3D& wi,
+                  float* distToLight) const;
   bool is_delta_light() const { return false; }
 
  private:
@@ -51,6 +57,9 @@ class PointLight : public SceneLight {
   PointLight(const Spectrum& rad, const Vector3D& pos);
   Spectrum sample_L(const Vector3D& p, Vector3D* wi, float* distToLight,
                     float* pdf) const;
+  float pdf(const Vector3D& p, const Vector3D& wi) const;
+  Spectrum eval_L(const Vector3D& p, const Vector3D& wi,
+                  float* distToLight) const;
   bool is_delta_light() const { return true; }
 
  private:
@@ -67,6 +76,9 @@ class SpotLight : public SceneLight {
             float angle);
   Spectrum sample_L(const Vector3D& p, Vector3D* wi, float* distToLight,
                     float* pdf) const;
+  float pdf(const Vector3D& p, const Vector3D& wi) const;
+  Spectrum eval_L(const Vector3D& p, const Vector3D& wi,
+                  float* distToLight) const;
   bool is_delta_light() const { return true; }
 
  private:
@@ -85,9 +97,18 @@ class AreaLight : public SceneLight {
             const Vector3D& dim_x, const Vector3D& dim_y);
   Spectrum sample_L(const Vector3D& p, Vector3D* wi, float* distToLight,
                     float* pdf) const;
+  float pdf(const Vector3D& p, const Vector3D& wi) const;
+  Spectrum eval_L(const Vector3D& p, const Vector3D& wi,
+                  float* distToLight) const;
   bool is_delta_light() const { return false; }
 
  private:
+  /**
+   * Intersect the ray leaving p along wi with the emitting side of the
+   * light, storing the distance to the hit in dist.
+   */
+  bool intersect(const Vector3D& p, const Vector3D& wi, float* dist) const;
+
   Spectrum radiance;
   Vector3D position;
   Vector3D direction;
@@ -105,6 +126,9 @@ class SphereLight : public SceneLight {
   SphereLight(const Spectrum& rad, const SphereObject* sphere);
   Spectrum sample_L(const Vector3D& p, Vector3D* wi, float* distToLight,
                     float* pdf) const;
+  float pdf(const Vector3D& p, const Vector3D& wi) const;
+  Spectrum eval_L(const Vector3D& p, const Vector3D& wi,
+                  float* distToLight) const;
   bool is_delta_light() const { return false; }
 
  private:
@@ -121,6 +145,9 @@ class MeshLight : public SceneLight {
   MeshLight(const Spectrum& rad, const Mesh* mesh);
   Spectrum sample_L(const Vector3D& p, Vector3D* wi, float* distToLight,
                     float* pdf) const;
+  float pdf(const Vector3D& p, const Vector3D& wi) const;
+  Spectrum eval_L(const Vector3D& p, const Vector3D& wi,
+                  float* distToLight) const;
   bool is_delta_light() const { return false; }
 
  private:
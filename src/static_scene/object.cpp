@@ -4,71 +4,135 @@
 
 #include <vector>
 #include <iostream>
-#include <unordered_map>
 
 using std::vector;
-using std::unordered_map;
 
 namespace CMU462 {
 namespace StaticScene {
 
 // Mesh object //
 
-Mesh::Mesh(const HalfedgeMesh& mesh, BSDF* bsdf) {
-  // triangulate mesh before sending to visualization or render mode
-  HalfedgeMesh _mesh(mesh);
+Mesh::Mesh(HalfedgeMesh& mesh, BSDF* bsdf) : bsdf(bsdf), owns_arrays(true) {
+  // Number the vertices as they are iterated. Faces are triangulated as
+  // they are read, so the halfedge mesh is neither copied nor changed.
+  vector<VertexCIter> verts;
+  verts.reserve(mesh.nVertices());
+  for (VertexIter v = mesh.verticesBegin(); v != mesh.verticesEnd(); v++) {
+    v->index = verts.size();
+    verts.push_back(v);
+  }
 
-  // Triangulate if needed
-  bool triNeeded = false;
-  for (auto f = mesh.facesBegin(); f != mesh.facesEnd(); f++) {
-    if(f->degree() != 3) {
-      triNeeded = true;
+  // A vertex whose faces give it different texture coordinates is split
+  // into one vertex per texture coordinate. The copies of a vertex are
+  // chained through nextCopy, starting from the vertex itself.
+  const size_t none = (size_t)-1;
+  bool hasTexcoords = mesh.hasTexcoords();
+  vector<size_t> copyOf;
+  vector<Vector2D> copyTexcoords;
+  vector<size_t> nextCopy;
+  vector<bool> used;
+  if (hasTexcoords) {
+    for (size_t i = 0; i < verts.size(); i++) copyOf.push_back(i);
+    copyTexcoords.resize(verts.size());
+    nextCopy.assign(verts.size(), none);
+    used.assign(verts.size(), false);
+  }
+  auto label = [&](HalfedgeCIter h) {
+    size_t i = h->vertex()->index;
+    if (!hasTexcoords) return i;
+    if (!used[i]) {
+      used[i] = true;
+      copyTexcoords[i] = h->texcoord;
+      return i;
+    }
+    while (copyTexcoords[i].x != h->texcoord.x ||
+           copyTexcoords[i].y != h->texcoord.y) {
+      if (nextCopy[i] == none) {
+        nextCopy[i] = copyOf.size();
+        copyOf.push_back(copyOf[i]);
+        copyTexcoords.push_back(h->texcoord);
+        nextCopy.push_back(none);
+      }
+      i = nextCopy[i];
     }
+    return i;
+  };
+
+  // Faces with more than three sides are split into a fan of triangles
+  // around their first vertex.
+  size_t numTriangles = 0;
+  for (FaceCIter f = mesh.facesBegin(); f != mesh.facesEnd(); f++) {
+    numTriangles += f->degree() - 2;
   }
-  if(triNeeded) {
-    _mesh.triangulate();
+  triangles.reserve(numTriangles);
+  for (FaceCIter f = mesh.facesBegin(); f != mesh.facesEnd(); f++) {
+    HalfedgeCIter h0 = f->halfedge();
+    HalfedgeCIter h = h0->next();
+    size_t a = label(h0);
+    size_t b = label(h);
+    for (h = h->next(); h != h0; h = h->next()) {
+      size_t c = label(h);
+      triangles.push_back(Triangle(this, a, b, c));
+      b = c;
+    }
   }
 
-  unordered_map<const Vertex*, int> vertexLabels;
-  vector<const Vertex*> verts;
-
-  size_t vertexI = 0;
-  for (VertexCIter it = _mesh.verticesBegin(); it != _mesh.verticesEnd();
-       it++) {
-    const Vertex* v = &*it;
-    verts.push_back(v);
-    vertexLabels[v] = vertexI;
-    vertexI++;
+  num_vertices = hasTexcoords ? copyOf.size() : verts.size();
+  positions = new Vector3D[num_vertices];
+  normals = new Vector3D[num_vertices];
+  texcoords = hasTexcoords ? new Vector2D[num_vertices] : NULL;
+  for (size_t i = 0; i < num_vertices; i++) {
+    VertexCIter v = verts[hasTexcoords ? copyOf[i] : i];
+    positions[i] = v->position;
+    normals[i] = v->normal();
+    if (hasTexcoords) texcoords[i] = copyTexcoords[i];
   }
+}
 
-  positions = new Vector3D[vertexI];
-  normals = new Vector3D[vertexI];
-  for (int i = 0; i < vertexI; i++) {
-    positions[i] = verts[i]->position;
-    normals[i] = verts[i]->normal();
+Mesh::Mesh(Vector3D* positions, Vector3D* normals, Vector2D* texcoords,
+           size_t num_vertices, const uint64_t* indices, size_t num_indices,
+           BSDF* bsdf)
+    : positions(positions),
+      normals(normals),
+      texcoords(texcoords),
+      num_vertices(num_vertices),
+      bsdf(bsdf),
+      owns_arrays(false) {
+  triangles.reserve(num_indices / 3);
+  for (size_t i = 0; i + 2 < num_indices; i += 3) {
+    triangles.push_back(
+        Triangle(this, indices[i], indices[i + 1], indices[i + 2]));
   }
+}
 
-  for (FaceCIter f = _mesh.facesBegin(); f != _mesh.facesEnd(); f++) {
-    HalfedgeCIter h = f->halfedge();
-    indices.push_back(vertexLabels[&*h->vertex()]);
-    indices.push_back(vertexLabels[&*h->next()->vertex()]);
-    indices.push_back(vertexLabels[&*h->next()->next()->vertex()]);
+Mesh::~Mesh() {
+  if (owns_arrays) {
+    delete[] positions;
+    delete[] normals;
+    delete[] texcoords;
   }
-
-  this->bsdf = bsdf;
 }
 
 vector<Primitive*> Mesh::get_primitives() const {
-  vector<Primitive*> primitives;
-  size_t num_triangles = indices.size() / 3;
-  for (size_t i = 0; i < num_triangles; ++i) {
-    Triangle* tri = new Triangle(this, indices[i * 3], indices[i * 3 + 1],
-                                 indices[i * 3 + 2]);
-    primitives.push_back(tri);
+  // the triangles themselves, which stay in the mesh
+  vector<Primitive*> primitives(triangles.size());
+  for (size_t i = 0; i < triangles.size(); ++i) {
+    primitives[i] = const_cast<Triangle*>(&triangles[i]);
   }
   return primitives;
 }
 
+vector<uint64_t> Mesh::get_indices() const {
+  vector<uint64_t> indices;
+  indices.reserve(triangles.size() * 3);
+  for (const Triangle& t : triangles) {
+    indices.push_back(t.v1);
+    indices.push_back(t.v2);
+    indices.push_back(t.v3);
+  }
+  return indices;
+}
+
 BSDF* Mesh::get_bsdf() const { return bsdf; }
 
 // Sphere object //
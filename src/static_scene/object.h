@@ -1,14 +1,21 @@
 #ifndef CMU462_STATICSCENE_OBJECT_H
 #define CMU462_STATICSCENE_OBJECT_H
 
+#include <stdint.h>
+
+#include <vector>
+
 #include "../halfEdgeMesh.h"
 #include "scene.h"
+#include "triangle.h"
 
 namespace CMU462 {
 namespace StaticScene {
 
 /**
- * A triangle mesh object.
+ * A triangle mesh object. It holds flat vertex arrays and its triangles in
+ * a single array, each triangle being the indices of its vertices, which the
+ * BVH refers to directly.
  */
 class Mesh : public SceneObject {
  public:
@@ -16,13 +23,40 @@ class Mesh : public SceneObject {
    * Constructor.
    * Construct a static mesh for rendering from halfedge mesh used in editing.
    * Note that this converts the input halfedge mesh into a collection of
-   * world-space triangle primitives.
+   * world-space triangle primitives, splitting faces with more than three
+   * sides into fans of triangles around their first vertex. If the halfedge
+   * mesh has texture coordinates, vertices on texture seams are split so
+   * that each vertex has a single texture coordinate. The halfedge mesh is
+   * not copied, but its vertices are numbered through Vertex::index.
    */
-  Mesh(const HalfedgeMesh& mesh, BSDF* bsdf);
+  Mesh(HalfedgeMesh& mesh, BSDF* bsdf);
+
+  /**
+   * Constructor.
+   * Construct a static mesh from triangles that are ready for rendering, as
+   * a binary scene file stores them. The vertex arrays are used as they are,
+   * not copied, and must outlive the mesh.
+   * \param positions world-space vertex positions
+   * \param normals vertex normals
+   * \param texcoords vertex texture coordinates, NULL if the mesh has none
+   * \param num_vertices size of the vertex arrays
+   * \param indices vertex indices, three per triangle
+   * \param num_indices size of the index array
+   * \param bsdf BSDF of the surface material
+   */
+  Mesh(Vector3D* positions, Vector3D* normals, Vector2D* texcoords,
+       size_t num_vertices, const uint64_t* indices, size_t num_indices,
+       BSDF* bsdf);
+
+  /**
+   * Destructor. Frees the vertex arrays the mesh made.
+   */
+  ~Mesh();
 
   /**
    * Get all the primitives (Triangle) in the mesh.
-   * Note that Triangle reference the mesh for the actual data.
+   * Note that Triangle reference the mesh for the actual data, and belong
+   * to it.
    * \return all the primitives in the mesh
    */
   vector<Primitive*> get_primitives() const;
@@ -33,13 +67,25 @@ class Mesh : public SceneObject {
    */
   BSDF* get_bsdf() const;
 
+  /**
+   * Get the triangles of the mesh.
+   * \return vertex indices, three per triangle
+   */
+  vector<uint64_t> get_indices() const;
+
   Vector3D* positions;  ///< position array
   Vector3D* normals;    ///< normal array
+  Vector2D* texcoords;  ///< texture coordinate array, NULL if none
+  size_t num_vertices;  ///< size of the vertex arrays
 
  private:
+  Mesh(const Mesh&);             // not supported
+  Mesh& operator=(const Mesh&);  // not supported
+
   BSDF* bsdf;  ///< BSDF of surface material
 
-  vector<size_t> indices;  ///< triangles defined by indices
+  vector<Triangle> triangles;  ///< the triangles, pointing back to the mesh
+  bool owns_arrays;  ///< if the vertex arrays were made by the mesh
 };
 
 /**
@@ -14,6 +14,8 @@ namespace StaticScene {
  */
 class SceneObject {
  public:
+  virtual ~SceneObject() {}
+
   /**
    * Get all the primitives in the scene object.
    * \return a vector of all the primitives in the scene object
@@ -32,8 +34,33 @@ class SceneObject {
  */
 class SceneLight {
  public:
+  virtual ~SceneLight() {}
+
   virtual Spectrum sample_L(const Vector3D& p, Vector3D* wi, float* distToLight,
                             float* pdf) const = 0;
+
+  /**
+   * Evaluate the pdf of sample_L.
+   * Returns the probability density (with respect to solid angle at p) with
+   * which sample_L would have returned the direction wi. Delta lights always
+   * return zero since no other strategy can sample them.
+   * \param p point receiving light
+   * \param wi world space direction from p towards the light
+   */
+  virtual float pdf(const Vector3D& p, const Vector3D& wi) const = 0;
+
+  /**
+   * Evaluate the radiance arriving at p along direction wi, as seen by a ray
+   * leaving p in that direction (e.g. one produced by BSDF sampling). Returns
+   * zero if the ray does not reach the light, and otherwise stores the
+   * distance to the light in distToLight.
+   * \param p point receiving light
+   * \param wi world space direction from p towards the light
+   * \param distToLight address to store the distance to the light
+   */
+  virtual Spectrum eval_L(const Vector3D& p, const Vector3D& wi,
+                          float* distToLight) const = 0;
+
   virtual bool is_delta_light() const = 0;
 };
 
@@ -46,6 +73,15 @@ struct Scene {
         const std::vector<SceneLight*>& lights)
       : objects(objects), lights(lights) {}
 
+  /**
+   * Deletes the objects and lights of the scene. Lights that outlive the
+   * scene, such as the environment light, must be taken out of it first.
+   */
+  ~Scene() {
+    for (SceneObject* object : objects) delete object;
+    for (SceneLight* light : lights) delete light;
+  }
+
   // kept to make sure they don't get deleted, in case the
   //  primitives depend on them (e.g. Mesh Triangles).
   std::vector<SceneObject*> objects;
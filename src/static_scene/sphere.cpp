@@ -9,30 +9,49 @@ namespace CMU462 {
 namespace StaticScene {
 
 bool Sphere::test(const Ray& r, double& t1, double& t2) const {
-  // TODO (PathTracer):
-  // Implement ray - sphere intersection test.
-  // Return true if there are intersections and writing the
-  // smaller of the two intersection times in t1 and the larger in t2.
-  
-  return false;
+  // |o + t d - center|^2 = r^2 is a quadratic in t
+  Vector3D oc = r.o - o;
+  double a = dot(r.d, r.d);
+  double b = 2 * dot(oc, r.d);
+  double c = dot(oc, oc) - r2;
+  double disc = b * b - 4 * a * c;
+  if (disc < 0) return false;
+
+  double root = sqrt(disc);
+  t1 = (-b - root) / (2 * a);
+  t2 = (-b + root) / (2 * a);
+  return true;
 }
 
-bool Sphere::intersect(const Ray& r) const {
-  // TODO (PathTracer):
-  // Implement ray - sphere intersection.
-  // Note that you might want to use the the Sphere::test helper here.
+/**
+ * The closest of the two intersection times within the extent of the ray.
+ */
+static bool closest_hit(const Ray& r, double t1, double t2, double* t) {
+  if (t1 >= r.min_t && t1 <= r.max_t) {
+    *t = t1;
+  } else if (t2 >= r.min_t && t2 <= r.max_t) {
+    *t = t2;
+  } else {
+    return false;
+  }
+  return true;
+}
 
-  return false;
+bool Sphere::intersect(const Ray& r) const {
+  double t1, t2, t;
+  return test(r, t1, t2) && closest_hit(r, t1, t2, &t);
 }
 
 bool Sphere::intersect(const Ray& r, Intersection* isect) const {
-  // TODO (PathTracer):
-  // Implement ray - sphere intersection.
-  // Note again that you might want to use the the Sphere::test helper here.
-  // When an intersection takes place, the Intersection data should be updated
-  // correspondingly.
+  double t1, t2, t;
+  if (!test(r, t1, t2) || !closest_hit(r, t1, t2, &t)) return false;
 
-  return false;
+  r.max_t = t;
+  isect->t = t;
+  isect->primitive = this;
+  isect->bsdf = get_bsdf();
+  isect->n = isect->ng = normal(r.at_time(t));
+  return true;
 }
 
 void Sphere::draw(const Color& c) const { Misc::draw_sphere_opengl(o, r, c); }
@@ -1,4 +1,5 @@
 #include "triangle.h"
+#include "object.h"
 
 #include "CMU462/CMU462.h"
 #include "GL/glew.h"
@@ -6,29 +7,78 @@
 namespace CMU462 {
 namespace StaticScene {
 
-Triangle::Triangle(const Mesh* mesh, vector<size_t>& v) : mesh(mesh), v(v) {}
 Triangle::Triangle(const Mesh* mesh, size_t v1, size_t v2, size_t v3)
     : mesh(mesh), v1(v1), v2(v2), v3(v3) {}
 
-BBox Triangle::get_bbox() const {
-  // TODO (PathTracer):
-  // compute the bounding box of the triangle
+BSDF* Triangle::get_bsdf() const { return mesh->get_bsdf(); }
 
-  return BBox();
+BBox Triangle::get_bbox() const {
+  BBox bbox(mesh->positions[v1]);
+  bbox.expand(mesh->positions[v2]);
+  bbox.expand(mesh->positions[v3]);
+  return bbox;
 }
 
 bool Triangle::intersect(const Ray& r) const {
-  // TODO (PathTracer): implement ray-triangle intersection
-
-  return false;
+  Intersection isect;
+  return intersect(r, &isect);
 }
 
 bool Triangle::intersect(const Ray& r, Intersection* isect) const {
-  // TODO (PathTracer):
-  // implement ray-triangle intersection. When an intersection takes
-  // place, the Intersection data should be updated accordingly
+  // Moller-Trumbore: solve o + t d = p1 + u e1 + v e2 for (t, u, v) with
+  // Cramer's rule, the point being in the triangle when u, v >= 0 and
+  // u + v <= 1. A ray in the plane of the triangle misses it.
+  const Vector3D& p1 = mesh->positions[v1];
+  Vector3D e1 = mesh->positions[v2] - p1;
+  Vector3D e2 = mesh->positions[v3] - p1;
+  Vector3D s = r.o - p1;
+
+  Vector3D s1 = cross(r.d, e2);
+  double det = dot(e1, s1);
+  if (det == 0) return false;
+  double inv_det = 1 / det;
+
+  double u = dot(s, s1) * inv_det;
+  if (u < 0 || u > 1) return false;
+  Vector3D s2 = cross(s, e1);
+  double v = dot(r.d, s2) * inv_det;
+  if (v < 0 || u + v > 1) return false;
+  double t = dot(e2, s2) * inv_det;
+  if (t < r.min_t || t > r.max_t) return false;
+
+  // the geometric normal faces the ray, so that it tells which side of the
+  // surface the ray arrived from
+  Vector3D ng = cross(e1, e2).unit();
+  if (dot(ng, r.d) > 0) ng = -ng;
+
+  r.max_t = t;
+  isect->t = t;
+  isect->primitive = this;
+  isect->bsdf = get_bsdf();
+  isect->ng = ng;
+  isect->bary = Vector2D(u, v);
+  interpolate(isect);
+  return true;
+}
+
+void Triangle::interpolate(Intersection* isect) const {
+  double u = isect->bary.x, v = isect->bary.y;
+  Vector3D n = (1 - u - v) * mesh->normals[v1] + u * mesh->normals[v2] +
+               v * mesh->normals[v3];
+
+  // vertex normals that cancel out leave the flat normal
+  double length = n.norm();
+  if (length > 0) {
+    n /= length;
+    isect->n = dot(n, isect->ng) < 0 ? -n : n;
+  } else {
+    isect->n = isect->ng;
+  }
 
-  return false;
+  if (mesh->texcoords) {
+    isect->uv = (1 - u - v) * mesh->texcoords[v1] +
+                u * mesh->texcoords[v2] + v * mesh->texcoords[v3];
+  }
 }
 
 void Triangle::draw(const Color& c) const {
@@ -1,18 +1,22 @@
 #ifndef CMU462_STATICSCENE_TRIANGLE_H
 #define CMU462_STATICSCENE_TRIANGLE_H
 
-#include "object.h"
+#include <stdint.h>
+
 #include "primitive.h"
 
 namespace CMU462 {
 namespace StaticScene {
 
+class Mesh;
+
 /**
  * A single triangle from a mesh.
  * To save space, it holds a pointer back to the data in the original mesh
  * rather than holding the data itself. This means that its lifetime is tied
- * to that of the original mesh. The primitive may refer back to the mesh
- * object for other information such as normal, texcoord, material.
+ * to that of the original mesh, which keeps its triangles in an array. The
+ * primitive may refer back to the mesh object for other information such as
+ * normal, texcoord, material.
  */
 class Triangle : public Primitive {
  public:
@@ -24,7 +28,6 @@ class Triangle : public Primitive {
    * \param v2 index of triangle vertex in the mesh's attribute arrays
    * \param v3 index of triangle vertex in the mesh's attribute arrays
    */
-  Triangle(const Mesh* mesh, vector<size_t>& v);
   Triangle(const Mesh* mesh, size_t v1, size_t v2, size_t v3);
 
   /**
@@ -55,12 +58,21 @@ class Triangle : public Primitive {
    */
   bool intersect(const Ray& r, Intersection* i) const;
 
+  /**
+   * Fill in the shading data of an intersection from the barycentric
+   * coordinates of the hit: the shading normal, interpolated from the vertex
+   * normals and turned to the side of the geometric normal, and the texture
+   * coordinates when the mesh has them.
+   * \param i intersection whose bary and ng are set
+   */
+  void interpolate(Intersection* i) const;
+
   /**
    * Get BSDF.
    * In the case of a triangle, the surface material BSDF is stored in
    * the mesh it belongs to.
    */
-  BSDF* get_bsdf() const { return mesh->get_bsdf(); }
+  BSDF* get_bsdf() const;
 
   /**
    * Draw with OpenGL (for visualizer)
@@ -73,13 +85,13 @@ class Triangle : public Primitive {
   void drawOutline(const Color& c) const;
 
  private:
-  const Mesh* mesh;  ///< pointer to the mesh the triangle is a part of
+  friend class Mesh;
 
-  size_t v1;  ///< index into the mesh attribute arrays
-  size_t v2;  ///< index into the mesh attribute arrays
-  size_t v3;  ///< index into the mesh attribute arrays
+  const Mesh* mesh;  ///< pointer to the mesh the triangle is a part of
 
-  vector<size_t> v;
+  uint32_t v1;  ///< index into the mesh attribute arrays
+  uint32_t v2;  ///< index into the mesh attribute arrays
+  uint32_t v3;  ///< index into the mesh attribute arrays
 
 };  // class Triangle
 
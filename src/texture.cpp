@@ -0,0 +1,268 @@
+#include "texture.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <strings.h>
+
+#include <algorithm>
+#include <iostream>
+#include <map>
+
+#include "CMU462/lodepng.h"
+#include "CMU462/tinyexr.h"
+
+using namespace std;
+
+namespace CMU462 {
+
+// Texture //
+
+static mutex textures_lock;
+static map<string, const Texture*> textures;  ///< textures loaded, by path
+static uint32_t next_texture_id = 0;
+
+/**
+ * Linear value of each 8 bit sRGB value.
+ */
+static const float* srgb_to_linear() {
+  static const vector<float> table = [] {
+    vector<float> t(256);
+    for (int i = 0; i < 256; i++) {
+      float c = i / 255.f;
+      t[i] = c <= 0.04045f ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+    }
+    return t;
+  }();
+  return table.data();
+}
+
+static bool is_exr(const string& path) {
+  return path.size() >= 4 &&
+         strcasecmp(path.c_str() + path.size() - 4, ".exr") == 0;
+}
+
+const Texture* Texture::load(const string& path) {
+  lock_guard<mutex> guard(textures_lock);
+  map<string, const Texture*>::iterator it = textures.find(path);
+  if (it != textures.end()) return it->second;
+
+  // a file that fails to load is remembered too, so that it is only
+  // reported once
+  Texture* texture = new Texture();
+  if (is_exr(path)) {
+    float* rgba;
+    int w, h;
+    const char* err;
+    if (LoadEXR(&rgba, &w, &h, path.c_str(), &err) != 0) {
+      cerr << "[Scotty3D] Error loading texture " << path << ": " << err
+           << endl;
+      delete texture;
+      return textures[path] = NULL;
+    }
+    texture->image_linear.resize((size_t)w * h * 3);
+    for (size_t i = 0; i < (size_t)w * h; i++) {
+      for (int c = 0; c < 3; c++) {
+        texture->image_linear[i * 3 + c] = rgba[i * 4 + c];
+      }
+    }
+    free(rgba);
+    texture->init(path, w, h);
+  } else {
+    unsigned w, h;
+    unsigned error = lodepng::decode(texture->image_srgb, w, h, path, LCT_RGB);
+    if (error) {
+      cerr << "[Scotty3D] Error loading texture " << path << ": "
+           << lodepng_error_text(error) << endl;
+      delete texture;
+      return textures[path] = NULL;
+    }
+    texture->init(path, w, h);
+  }
+  return textures[path] = texture;
+}
+
+void Texture::init(const string& path, size_t w, size_t h) {
+  file_path = path;
+  id = next_texture_id++;
+
+  // Each level is half the size of the one before, rounded up, so that
+  // every texel of a level covers two by two texels of the level before.
+  const size_t t = TextureCache::tile_size;
+  size_t num_tiles = 0;
+  for (;;) {
+    Level level;
+    level.w = w;
+    level.h = h;
+    level.tiles_w = (w + t - 1) / t;
+    level.first_tile = num_tiles;
+    levels.push_back(level);
+    num_tiles += level.tiles_w * ((h + t - 1) / t);
+    if (w == 1 && h == 1) break;
+    w = (w + 1) / 2;
+    h = (h + 1) / 2;
+  }
+
+  tile_slots.reset(new atomic<int32_t>[num_tiles]);
+  for (size_t i = 0; i < num_tiles; i++) tile_slots[i].store(-1);
+}
+
+void Texture::make_tile(size_t level, size_t tile_x, size_t tile_y,
+                        float* out) const {
+  const size_t t = TextureCache::tile_size;
+  const Level& l = levels[level];
+  size_t x0 = tile_x * t, y0 = tile_y * t;
+  size_t w = min(t, l.w - x0), h = min(t, l.h - y0);
+  fill(out, out + t * t * 3, 0.f);
+
+  if (level == 0) {
+    const float* srgb = srgb_to_linear();
+    for (size_t y = 0; y < h; y++) {
+      size_t in = ((y0 + y) * l.w + x0) * 3;
+      float* row = out + y * t * 3;
+      if (image_srgb.empty()) {
+        copy(&image_linear[in], &image_linear[in] + w * 3, row);
+      } else {
+        for (size_t i = 0; i < w * 3; i++) row[i] = srgb[image_srgb[in + i]];
+      }
+    }
+    return;
+  }
+
+  // average the two by two texels of the level before, repeating the last
+  // row or column of a level of odd size
+  TextureCache& cache = TextureCache::shared();
+  const Level& fine = levels[level - 1];
+  for (size_t y = 0; y < h; y++) {
+    size_t fy0 = 2 * (y0 + y), fy1 = min(fy0 + 1, fine.h - 1);
+    for (size_t x = 0; x < w; x++) {
+      size_t fx0 = 2 * (x0 + x), fx1 = min(fx0 + 1, fine.w - 1);
+      Spectrum c = cache.texel(this, level - 1, fx0, fy0) +
+                   cache.texel(this, level - 1, fx1, fy0) +
+                   cache.texel(this, level - 1, fx0, fy1) +
+                   cache.texel(this, level - 1, fx1, fy1);
+      float* texel = out + (y * t + x) * 3;
+      texel[0] = c.r * 0.25f;
+      texel[1] = c.g * 0.25f;
+      texel[2] = c.b * 0.25f;
+    }
+  }
+}
+
+Spectrum Texture::lookup_level(const Vector2D& uv, size_t level) const {
+  const Level& l = levels[level];
+  double s = (uv.x - floor(uv.x)) * l.w - 0.5;
+  double t = (1 - (uv.y - floor(uv.y))) * l.h - 0.5;
+  double fs = floor(s), ft = floor(t);
+  float a = s - fs, b = t - ft;
+
+  long w = l.w, h = l.h;
+  long x0 = ((long)fs % w + w) % w, x1 = (x0 + 1) % w;
+  long y0 = ((long)ft % h + h) % h, y1 = (y0 + 1) % h;
+
+  TextureCache& cache = TextureCache::shared();
+  return (cache.texel(this, level, x0, y0) * (1 - a) +
+          cache.texel(this, level, x1, y0) * a) * (1 - b) +
+         (cache.texel(this, level, x0, y1) * (1 - a) +
+          cache.texel(this, level, x1, y1) * a) * b;
+}
+
+Spectrum Texture::lookup(const Vector2D& uv, double level) const {
+  level = min(max(level, 0.0), (double)levels.size() - 1);
+  size_t l = (size_t)level;
+  float f = level - l;
+  Spectrum c = lookup_level(uv, l);
+  if (f == 0) return c;
+  return c * (1 - f) + lookup_level(uv, l + 1) * f;
+}
+
+// Texture cache //
+
+TextureCache& TextureCache::shared() {
+  static TextureCache cache(default_budget);
+  return cache;
+}
+
+TextureCache::TextureCache(size_t budget) : num_slots(0), hand(0) {
+  // The slots are made as they are needed, but the table of them is never
+  // resized, so that lookups can read it while slots are added.
+  slots.resize(max<size_t>(budget / sizeof(Slot), 64));
+}
+
+Spectrum TextureCache::texel(const Texture* texture, size_t level, size_t x,
+                             size_t y) {
+  const Texture::Level& l = texture->levels[level];
+  size_t tile_x = x / tile_size, tile_y = y / tile_size;
+  size_t tile = l.first_tile + tile_x + tile_y * l.tiles_w;
+  uint64_t key = (uint64_t)texture->id << 32 | tile;
+  size_t i = (x % tile_size + (y % tile_size) * tile_size) * 3;
+
+  for (;;) {
+    int32_t s = texture->tile_slots[tile].load(memory_order_acquire);
+    if (s >= 0) {
+      Slot& slot = *slots[s];
+      uint32_t version = slot.version.load(memory_order_acquire);
+      if (!(version & 1) && slot.key.load(memory_order_relaxed) == key) {
+        Spectrum c(slot.texels[i].load(memory_order_relaxed),
+                   slot.texels[i + 1].load(memory_order_relaxed),
+                   slot.texels[i + 2].load(memory_order_relaxed));
+        atomic_thread_fence(memory_order_acquire);
+        if (slot.version.load(memory_order_relaxed) == version) {
+          // only written when it changes, so that hits on the same tile
+          // from different threads do not contend for its cache line
+          if (!slot.referenced.load(memory_order_relaxed)) {
+            slot.referenced.store(true, memory_order_relaxed);
+          }
+          return c;
+        }
+      }
+    }
+    load_tile(texture, level, tile_x, tile_y);
+  }
+}
+
+void TextureCache::load_tile(const Texture* texture, size_t level,
+                             size_t tile_x, size_t tile_y) {
+  const Texture::Level& l = texture->levels[level];
+  size_t tile = l.first_tile + tile_x + tile_y * l.tiles_w;
+  uint64_t key = (uint64_t)texture->id << 32 | tile;
+
+  // Tiles of the levels after the first are made from tiles of the level
+  // before, which may have to be loaded too, so tiles are made before taking
+  // the lock. Two threads missing the same tile may both make it.
+  float texels[tile_size * tile_size * 3];
+  texture->make_tile(level, tile_x, tile_y, texels);
+
+  lock_guard<mutex> guard(lock);
+  int32_t s = texture->tile_slots[tile].load(memory_order_relaxed);
+  if (s >= 0 && slots[s]->key.load(memory_order_relaxed) == key) return;
+
+  if (num_slots < slots.size()) {
+    s = num_slots++;
+    slots[s].reset(new Slot());
+  } else {
+    while (slots[hand]->referenced.load(memory_order_relaxed)) {
+      slots[hand]->referenced.store(false, memory_order_relaxed);
+      hand = (hand + 1) % slots.size();
+    }
+    s = hand;
+    hand = (hand + 1) % slots.size();
+  }
+
+  Slot& slot = *slots[s];
+  if (slot.owner) slot.owner->tile_slots[slot.tile].store(-1);
+  uint32_t version = slot.version.load(memory_order_relaxed);
+  slot.version.store(version + 1, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+  slot.key.store(key, memory_order_relaxed);
+  for (size_t i = 0; i < tile_size * tile_size * 3; i++) {
+    slot.texels[i].store(texels[i], memory_order_relaxed);
+  }
+  slot.version.store(version + 2, memory_order_release);
+  slot.referenced.store(true, memory_order_relaxed);
+  slot.owner = texture;
+  slot.tile = tile;
+
+  texture->tile_slots[tile].store(s, memory_order_release);
+}
+
+}  // namespace CMU462
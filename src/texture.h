@@ -0,0 +1,167 @@
+#ifndef CMU462_TEXTURE_H
+#define CMU462_TEXTURE_H
+
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "CMU462/spectrum.h"
+#include "CMU462/vector2D.h"
+
+namespace CMU462 {
+
+/**
+ * An image mapped onto surfaces by their texture coordinates, (0, 0) being
+ * the bottom left corner of the image and (1, 1) the top right one, and
+ * repeating outside. The image is kept as the file holds it, 8 bit sRGB for
+ * PNG files and floats for OpenEXR files, and is read through the texture
+ * cache, which holds tiles of it and of its mip levels in linear floats.
+ */
+class Texture {
+ public:
+  /**
+   * Load a PNG or OpenEXR file, by its extension. Textures are shared, a
+   * file that was loaded before is not loaded again.
+   * \param path path of the file
+   * \return the texture, NULL if the file could not be loaded
+   */
+  static const Texture* load(const std::string& path);
+
+  /**
+   * Bilinear lookup, blending two levels when the level is fractional.
+   * \param uv texture coordinates, repeating outside [0, 1]
+   * \param level mip level, 0 for the image itself, clamped to the levels
+   */
+  Spectrum lookup(const Vector2D& uv, double level = 0) const;
+
+  /**
+   * Path of the file the texture was loaded from.
+   */
+  const std::string& path() const { return file_path; }
+
+  /**
+   * Number of mip levels, each half the size of the one before, the last
+   * one being a single texel.
+   */
+  size_t num_levels() const { return levels.size(); }
+
+ private:
+  friend class TextureCache;
+
+  Texture() {}
+  Texture(const Texture&);             // not supported
+  Texture& operator=(const Texture&);  // not supported
+
+  /**
+   * Set up the levels and their tiles for an image of the given size.
+   */
+  void init(const std::string& path, size_t w, size_t h);
+
+  /**
+   * Bilinear lookup in a single level.
+   */
+  Spectrum lookup_level(const Vector2D& uv, size_t level) const;
+
+  /**
+   * Make a tile of a level, from the image for the first level and from the
+   * level before for the others.
+   * \param out the texels of the tile, three floats each, row by row
+   */
+  void make_tile(size_t level, size_t tile_x, size_t tile_y, float* out) const;
+
+  struct Level {
+    size_t w, h;            ///< size in texels
+    size_t tiles_w;         ///< number of tiles in a row
+    size_t first_tile;      ///< number of the first tile of the level
+  };
+
+  std::string file_path;
+  uint32_t id;                 ///< number of the texture in tile keys
+  std::vector<Level> levels;
+  std::vector<unsigned char> image_srgb;  ///< texels of a PNG file
+  std::vector<float> image_linear;        ///< texels of an OpenEXR file
+
+  /**
+   * Slot of the cache each tile was last put in, -1 if none. The slot may
+   * since have been given to another tile, so its key is checked.
+   */
+  std::unique_ptr<std::atomic<int32_t>[]> tile_slots;
+};
+
+/**
+ * The tiles of all textures, 32 by 32 texels of linear floats, in as many
+ * slots as fit a fixed memory budget. A tile is made when a lookup first
+ * needs it, and when all slots are taken the tile least recently used is
+ * dropped, approximated by the CLOCK algorithm: a sweep over the slots gives
+ * each tile used since the last sweep a second chance.
+ * Lookups of tiles in the cache take no lock, and share the cache between
+ * rendering threads: each slot has a version, odd while the slot is being
+ * filled, which is read before and after the texels and must not change,
+ * as in a seqlock. Tiles that miss are made without a lock too, and only
+ * claiming a slot takes one.
+ */
+class TextureCache {
+ public:
+  static const size_t tile_size = 32;  ///< texels along a side of a tile
+
+  /**
+   * Memory budget of the shared cache, in bytes.
+   */
+  static const size_t default_budget = 256 << 20;
+
+  /**
+   * The cache all textures are read through.
+   */
+  static TextureCache& shared();
+
+  /**
+   * Constructor.
+   * \param budget memory for the tiles, in bytes; a few slots are always
+   *        allowed, however small the budget
+   */
+  explicit TextureCache(size_t budget);
+
+  /**
+   * A texel of a level of a texture, making its tile if it is not cached.
+   * \param x column, from the left
+   * \param y row, from the top
+   */
+  Spectrum texel(const Texture* texture, size_t level, size_t x, size_t y);
+
+ private:
+  TextureCache(const TextureCache&);             // not supported
+  TextureCache& operator=(const TextureCache&);  // not supported
+
+  static const uint64_t no_key = ~(uint64_t)0;
+
+  struct Slot {
+    Slot() : version(0), key(no_key), referenced(false), owner(NULL) {}
+
+    std::atomic<uint32_t> version;  ///< odd while the slot is being filled
+    std::atomic<uint64_t> key;      ///< texture id and tile number
+    std::atomic<bool> referenced;   ///< if used since the last sweep
+    std::atomic<float> texels[tile_size * tile_size * 3];
+
+    const Texture* owner;  ///< texture of the tile, only used under lock
+    size_t tile;           ///< number of the tile, only used under lock
+  };
+
+  /**
+   * Make a tile and put it in a slot, dropping the tile in that slot.
+   */
+  void load_tile(const Texture* texture, size_t level, size_t tile_x,
+                 size_t tile_y);
+
+  std::mutex lock;  ///< taken to claim slots
+  std::vector<std::unique_ptr<Slot> > slots;  ///< made as they are needed
+  size_t num_slots;  ///< number of slots made
+  size_t hand;       ///< slot the next sweep starts from
+};
+
+}  // namespace CMU462
+
+#endif  // CMU462_TEXTURE_H
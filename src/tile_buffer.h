@@ -0,0 +1,115 @@
+#ifndef CMU462_TILE_BUFFER_H
+#define CMU462_TILE_BUFFER_H
+
+#include <mutex>
+#include <vector>
+
+#include "CMU462/spectrum.h"
+
+#include "image.h"
+
+namespace CMU462 {
+
+/**
+ * Sum of the samples of a pixel: radiance in r, g and b and the number of
+ * samples in a. The padding to 16 bytes keeps every pixel inside a single
+ * cache line and lets rows be added with aligned vector loads.
+ */
+struct alignas(16) Float4 {
+  Float4() : r(0.f), g(0.f), b(0.f), a(0.f) {}
+  Float4(const Spectrum& sum, float n) : r(sum.r), g(sum.g), b(sum.b), a(n) {}
+
+  Float4& operator+=(const Float4& v) {
+    r += v.r, g += v.g, b += v.b, a += v.a;
+    return *this;
+  }
+
+  float r, g, b, a;
+};
+
+/**
+ * Samples accumulated in one tile of the image.
+ * A worker renders a pass over the tile into a buffer of its own and merges
+ * it with add_pass. Only the merge holds the lock of the tile, so passes of
+ * the same tile can run on several workers at once, and the shared image is
+ * only written with the means of whole passes.
+ */
+struct TileBuffer {
+  TileBuffer() : x0(0), y0(0), w(0), h(0), num_passes(0) {}
+
+  /**
+   * Clear the tile and place it in the image.
+   * \param x0 left column of the tile
+   * \param y0 bottom row of the tile
+   * \param w width of the tile
+   * \param h height of the tile
+   */
+  void reset(size_t x0, size_t y0, size_t w, size_t h) {
+    std::lock_guard<std::mutex> guard(lock);
+    this->x0 = x0, this->y0 = y0, this->w = w, this->h = h;
+    sum.assign(w * h, Float4());
+    num_passes = 0;
+  }
+
+  /**
+   * Merge a pass into the tile and write the mean of all the samples so far
+   * to the tile's pixels of an image.
+   * \param pass sums of the pass for each pixel, row by row
+   * \param image image to write the means to
+   * \return number of passes merged
+   */
+  size_t add_pass(const std::vector<Float4>& pass, HDRImageBuffer& image) {
+    std::lock_guard<std::mutex> guard(lock);
+    for (size_t y = 0; y < h; ++y) {
+      Float4* row = &sum[y * w];
+      const Float4* src = &pass[y * w];
+      Spectrum* dst = &image.data[x0 + (y0 + y) * image.w];
+      for (size_t x = 0; x < w; ++x) {
+        row[x] += src[x];
+        float scale = row[x].a > 0.f ? 1.f / row[x].a : 0.f;
+        dst[x] = Spectrum(row[x].r * scale, row[x].g * scale,
+                          row[x].b * scale);
+      }
+    }
+    return ++num_passes;
+  }
+
+  /**
+   * Set the sums of the tile, e.g. from a checkpoint, and write their means
+   * to the tile's pixels of an image.
+   * \param sum sums of the passes for each pixel, row by row
+   * \param num_passes number of passes the sums hold
+   * \param image image to write the means to
+   */
+  void restore(const std::vector<Float4>& sum, size_t num_passes,
+               HDRImageBuffer& image) {
+    reset(x0, y0, w, h);
+    add_pass(sum, image);
+    std::lock_guard<std::mutex> guard(lock);
+    this->num_passes = num_passes;
+  }
+
+  /**
+   * Copy the sums of the tile.
+   * \param out address to store the sums
+   * \return number of passes the sums hold
+   */
+  size_t snapshot(std::vector<Float4>* out) {
+    std::lock_guard<std::mutex> guard(lock);
+    *out = sum;
+    return num_passes;
+  }
+
+  size_t x0;  ///< left column
+  size_t y0;  ///< bottom row
+  size_t w;   ///< width
+  size_t h;   ///< height
+
+  std::vector<Float4> sum;  ///< sums of all passes, row by row
+  size_t num_passes;        ///< number of passes merged
+  std::mutex lock;          ///< held while a pass is merged
+};
+
+}  // namespace CMU462
+
+#endif  // CMU462_TILE_BUFFER_H
@@ -0,0 +1,551 @@
+#include "tile_farm.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sstream>
+
+#include "CMU462/lodepng.h"
+#include "CMU462/timer.h"
+
+#include "exr_writer.h"
+
+#ifndef _WIN32
+#include <netdb.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#endif
+
+namespace CMU462 {
+
+// Version of the protocol, sent by the workers.
+static const int protocol_version = 1;
+
+// The tiles handed out are the squares the path tracer renders in.
+static const size_t tile_size = 32;
+
+TileCoordinator::TileCoordinator(const AppConfig& config,
+                                 const std::string& scene_path)
+    : config(config), scene_path(scene_path), num_tiles_w(0), num_tiles(0),
+      num_done(0) {}
+
+TileCoordinator::~TileCoordinator() {
+#ifndef _WIN32
+  for (Worker& worker : workers) close(worker.fd);
+#endif
+}
+
+bool TileCoordinator::save_image() {
+  const std::string& path = config.pathtracer_result_path;
+
+  // high dynamic range output, of the linear radiance before tonemapping
+  if (path.size() >= 4 && path.compare(path.size() - 4, 4, ".exr") == 0) {
+    EXRWriter writer(image.w, image.h, config.pathtracer_exr_half
+                                           ? EXRWriter::HALF
+                                           : EXRWriter::FLOAT);
+    writer.add_rgb("", image);
+    return writer.write(path);
+  }
+
+  // same tone curve settings as the path tracer
+  ImageBuffer frame(image.w, image.h);
+  if (config.pathtracer_tone_operator == TONEMAP_NONE) {
+    image.toColor(frame, 0, 0, image.w, image.h);
+  } else {
+    image.tonemap(frame, 2.2f, 1.0f, 0.18f, 5.0f,
+                  config.pathtracer_tone_operator,
+                  config.pathtracer_num_threads);
+  }
+
+  std::vector<uint32_t> flipped(image.w * image.h);
+  for (size_t i = 0; i < image.h; ++i) {
+    memcpy(&flipped[i * image.w], &frame.data[(image.h - i - 1) * image.w],
+           4 * image.w);
+  }
+  unsigned error = lodepng::encode(path, (unsigned char*)&flipped[0], image.w,
+                                   image.h);
+  if (error) {
+    fprintf(stderr, "Error writing PNG file %s: %s\n", path.c_str(),
+            lodepng_error_text(error));
+  }
+  return error == 0;
+}
+
+#ifdef _WIN32
+
+bool TileCoordinator::run(int port) {
+  fprintf(stderr, "[Scotty3D] Distributed rendering is not supported here\n");
+  return false;
+}
+
+bool TileCoordinator::handle_input(Worker& worker) { return false; }
+
+bool TileCoordinator::assign_tiles(Worker& worker) { return false; }
+
+void TileCoordinator::drop(Worker& worker, const std::string& why) {}
+
+bool run_tile_worker(const std::string& address, AppConfig config) {
+  fprintf(stderr, "[Scotty3D] Distributed rendering is not supported here\n");
+  return false;
+}
+
+#else
+
+/**
+ * Write all of a buffer to a socket.
+ */
+static bool send_all(int fd, const void* data, size_t size) {
+  const char* p = (const char*)data;
+  while (size > 0) {
+    ssize_t n = write(fd, p, size);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return false;
+    p += n;
+    size -= n;
+  }
+  return true;
+}
+
+static bool send_line(int fd, const std::string& line) {
+  return send_all(fd, line.c_str(), line.size());
+}
+
+/**
+ * Read a line from a socket, without its line break.
+ * \param fd socket to read
+ * \param buffer data read past the previous line
+ * \param line address to store the line
+ * \return false if the connection closed first
+ */
+static bool read_line(int fd, std::string& buffer, std::string* line) {
+  size_t end;
+  while ((end = buffer.find('\n')) == std::string::npos) {
+    char data[4096];
+    ssize_t n = read(fd, data, sizeof(data));
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return false;
+    buffer.append(data, n);
+  }
+  *line = buffer.substr(0, end);
+  buffer.erase(0, end + 1);
+  if (!line->empty() && line->back() == '\r') line->pop_back();
+  return true;
+}
+
+bool TileCoordinator::run(int port) {
+  Timer timer;
+  timer.start();
+
+  // workers on other hosts resolve the scene path on their own file system
+  char resolved[PATH_MAX];
+  if (realpath(scene_path.c_str(), resolved)) scene_path = resolved;
+
+  size_t w = config.pathtracer_result_width;
+  size_t h = config.pathtracer_result_height;
+  image.resize(w, h);
+  image.clear();
+  num_tiles_w = (w + tile_size - 1) / tile_size;
+  num_tiles = num_tiles_w * ((h + tile_size - 1) / tile_size);
+  tile_done.assign(num_tiles, false);
+  num_done = 0;
+  for (size_t y = 0; y < h; y += tile_size) {
+    for (size_t x = 0; x < w; x += tile_size) {
+      pending.put_work(WorkItem(x, y, std::min(tile_size, w - x),
+                                std::min(tile_size, h - y)));
+    }
+  }
+
+  int server = socket(AF_INET, SOCK_STREAM, 0);
+  int on = 1;
+  sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  addr.sin_port = htons(port);
+  if (server < 0 ||
+      setsockopt(server, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) < 0 ||
+      bind(server, (sockaddr*)&addr, sizeof(addr)) < 0 ||
+      listen(server, 16) < 0) {
+    fprintf(stderr, "[Scotty3D] Error listening on port %d: %s\n", port,
+            strerror(errno));
+    if (server >= 0) close(server);
+    return false;
+  }
+
+  // a worker that dies must not kill the coordinator
+  signal(SIGPIPE, SIG_IGN);
+  fprintf(stdout, "[Scotty3D] Waiting for workers on port %d, %zu tiles\n",
+          port, num_tiles);
+
+  while (num_done < num_tiles) {
+    std::vector<pollfd> fds(workers.size() + 1);
+    fds[0].fd = server;
+    fds[0].events = POLLIN;
+    for (size_t i = 0; i < workers.size(); ++i) {
+      fds[i + 1].fd = workers[i].fd;
+      fds[i + 1].events = POLLIN;
+    }
+    if (poll(&fds[0], fds.size(), -1) < 0) {
+      if (errno == EINTR) continue;
+      fprintf(stderr, "[Scotty3D] Error waiting for workers: %s\n",
+              strerror(errno));
+      break;
+    }
+
+    // handle the workers first, as accepting adds to the list
+    for (size_t i = 0; i < workers.size(); ++i) {
+      Worker& worker = workers[i];
+      if (!fds[i + 1].revents) continue;
+
+      char data[65536];
+      ssize_t n = read(worker.fd, data, sizeof(data));
+      if (n < 0 && errno == EINTR) continue;
+      if (n <= 0) {
+        drop(worker, n == 0 ? "connection closed" : strerror(errno));
+        continue;
+      }
+      worker.input.append(data, n);
+      if (!handle_input(worker)) continue;
+      if (!assign_tiles(worker)) drop(worker, "could not send tiles");
+    }
+
+    if (fds[0].revents & POLLIN) {
+      sockaddr_in peer;
+      socklen_t peer_size = sizeof(peer);
+      int fd = accept(server, (sockaddr*)&peer, &peer_size);
+      if (fd >= 0) {
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+        char name[64];
+        snprintf(name, sizeof(name), "%s:%d", inet_ntoa(peer.sin_addr),
+                 ntohs(peer.sin_port));
+        workers.push_back(Worker(fd, name));
+      }
+    }
+
+    // forget the dropped workers, and give the tiles they left behind to
+    // the idle ones
+    for (size_t i = 0; i < workers.size();) {
+      if (workers[i].fd < 0) {
+        workers.erase(workers.begin() + i);
+      } else {
+        i++;
+      }
+    }
+    for (Worker& worker : workers) {
+      if (!assign_tiles(worker)) drop(worker, "could not send tiles");
+    }
+  }
+
+  for (Worker& worker : workers) {
+    if (worker.fd < 0) continue;
+    send_line(worker.fd, "done\n");
+    close(worker.fd);
+  }
+  workers.clear();
+  close(server);
+
+  if (num_done < num_tiles) return false;
+  timer.stop();
+  fprintf(stdout, "[Scotty3D] All %zu tiles rendered (%.4f sec)\n", num_tiles,
+          timer.duration());
+
+  timer.start();
+  if (!save_image()) return false;
+  timer.stop();
+  fprintf(stdout, "[Scotty3D] Saved %s (%.4f sec)\n",
+          config.pathtracer_result_path.c_str(), timer.duration());
+  return true;
+}
+
+bool TileCoordinator::handle_input(Worker& worker) {
+  while (worker.fd >= 0) {
+    if (worker.payload) {
+      const WorkItem& tile = worker.payload_tile;
+      size_t size = tile.tile_w * tile.tile_h * 3 * sizeof(float);
+      if (worker.input.size() < size) return true;
+
+      // only the first copy of a tile counts
+      size_t idx = tile.tile_x / tile_size + tile.tile_y / tile_size *
+                                                 num_tiles_w;
+      if (!tile_done[idx]) {
+        const char* p = worker.input.data();
+        for (int y = 0; y < tile.tile_h; ++y) {
+          Spectrum* row = &image.data[tile.tile_x + (tile.tile_y + y) * image.w];
+          for (int x = 0; x < tile.tile_w; ++x) {
+            float rgb[3];
+            memcpy(rgb, p, sizeof(rgb));
+            p += sizeof(rgb);
+            row[x] = Spectrum(rgb[0], rgb[1], rgb[2]);
+          }
+        }
+        tile_done[idx] = true;
+        num_done++;
+      }
+      worker.input.erase(0, size);
+      worker.payload = false;
+      continue;
+    }
+
+    size_t end = worker.input.find('\n');
+    if (end == std::string::npos) return true;
+    std::string line = worker.input.substr(0, end);
+    worker.input.erase(0, end + 1);
+
+    std::stringstream ss(line);
+    std::string command;
+    ss >> command;
+    if (command == "hello") {
+      int version = 0;
+      ss >> version >> worker.num_threads;
+      if (version != protocol_version) {
+        drop(worker, "speaks another protocol version");
+        return false;
+      }
+      char job[64];
+      snprintf(job, sizeof(job), "job %zu %zu %zu %zu %zu ", image.w, image.h,
+               config.pathtracer_ns_aa, config.pathtracer_max_ray_depth,
+               config.pathtracer_ns_area_light);
+      if (!send_line(worker.fd, job + scene_path + "\n")) {
+        drop(worker, "could not send the job");
+        return false;
+      }
+    } else if (command == "ready") {
+      worker.ready = true;
+      fprintf(stdout, "[Scotty3D] Worker %s joined with %zu threads\n",
+              worker.name.c_str(), worker.num_threads);
+    } else if (command == "error") {
+      drop(worker, line.substr(std::min(line.size(), command.size() + 1)));
+      return false;
+    } else if (command == "tile") {
+      WorkItem tile;
+      ss >> tile.tile_x >> tile.tile_y >> tile.tile_w >> tile.tile_h;
+      std::vector<WorkItem>& assigned = worker.assigned;
+      size_t i = 0;
+      while (i < assigned.size() && (assigned[i].tile_x != tile.tile_x ||
+                                     assigned[i].tile_y != tile.tile_y)) {
+        i++;
+      }
+      if (!ss || i == assigned.size() || assigned[i].tile_w != tile.tile_w ||
+          assigned[i].tile_h != tile.tile_h) {
+        drop(worker, "sent a tile it was not given");
+        return false;
+      }
+      assigned.erase(assigned.begin() + i);
+      worker.payload = true;
+      worker.payload_tile = tile;
+    } else {
+      drop(worker, "sent " + line);
+      return false;
+    }
+  }
+  return false;
+}
+
+bool TileCoordinator::assign_tiles(Worker& worker) {
+  if (worker.fd < 0 || !worker.ready || !worker.assigned.empty()) return true;
+
+  // two tiles per thread keep a worker busy while the first tiles of the
+  // batch are sent back
+  std::stringstream tiles;
+  WorkItem tile;
+  size_t batch = std::max<size_t>(worker.num_threads, 1) * 2;
+  while (worker.assigned.size() < batch && pending.try_get_work(&tile)) {
+    size_t idx = tile.tile_x / tile_size + tile.tile_y / tile_size *
+                                               num_tiles_w;
+    if (tile_done[idx]) continue;
+    worker.assigned.push_back(tile);
+    tiles << " " << tile.tile_x << " " << tile.tile_y << " " << tile.tile_w
+          << " " << tile.tile_h;
+  }
+  if (worker.assigned.empty()) return true;
+
+  std::stringstream line;
+  line << "tiles " << worker.assigned.size() << tiles.str() << "\n";
+  return send_line(worker.fd, line.str());
+}
+
+void TileCoordinator::drop(Worker& worker, const std::string& why) {
+  if (worker.fd < 0) return;
+  close(worker.fd);
+  worker.fd = -1;
+
+  for (const WorkItem& tile : worker.assigned) pending.put_work(tile);
+  fprintf(stdout, "[Scotty3D] Dropped worker %s (%s), %zu tiles reassigned\n",
+          worker.name.c_str(), why.c_str(), worker.assigned.size());
+  worker.assigned.clear();
+}
+
+bool run_tile_worker(const std::string& address, AppConfig config) {
+  size_t colon = address.find_last_of(':');
+  if (colon == std::string::npos) {
+    fprintf(stderr, "[Scotty3D] Expected host:port, got %s\n",
+            address.c_str());
+    return false;
+  }
+  std::string host = address.substr(0, colon);
+  std::string port = address.substr(colon + 1);
+
+  addrinfo hints, *found;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  int status = getaddrinfo(host.c_str(), port.c_str(), &hints, &found);
+  if (status != 0) {
+    fprintf(stderr, "[Scotty3D] Error resolving %s: %s\n", address.c_str(),
+            gai_strerror(status));
+    return false;
+  }
+  int fd = -1;
+  for (addrinfo* a = found; a && fd < 0; a = a->ai_next) {
+    fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+    if (fd >= 0 && connect(fd, a->ai_addr, a->ai_addrlen) < 0) {
+      close(fd);
+      fd = -1;
+    }
+  }
+  freeaddrinfo(found);
+  if (fd < 0) {
+    fprintf(stderr, "[Scotty3D] Error connecting to %s\n", address.c_str());
+    return false;
+  }
+  int on = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+  signal(SIGPIPE, SIG_IGN);
+
+  std::stringstream hello;
+  hello << "hello " << protocol_version << " "
+        << config.pathtracer_num_threads << "\n";
+  std::string buffer, line;
+  if (!send_line(fd, hello.str()) || !read_line(fd, buffer, &line) ||
+      line.compare(0, 4, "job ") != 0) {
+    fprintf(stderr, "[Scotty3D] No job from %s\n", address.c_str());
+    close(fd);
+    return false;
+  }
+
+  // the coordinator sets the image and its sampling
+  std::stringstream job(line.substr(4));
+  size_t w = 0, h = 0;
+  job >> w >> h >> config.pathtracer_ns_aa >>
+      config.pathtracer_max_ray_depth >> config.pathtracer_ns_area_light;
+  std::string scene_path;
+  std::getline(job >> std::ws, scene_path);
+  config.pathtracer_result_width = w;
+  config.pathtracer_result_height = h;
+  config.pathtracer_denoise = false;
+  config.pathtracer_aovs = AOV_NONE;
+  config.pathtracer_tone_operator = TONEMAP_NONE;
+
+  // binary scene files are only rendered, so they skip halfedge meshes
+  Collada::SceneInfo* sceneInfo = NULL;
+  SceneFile* sceneFile = NULL;
+  bool loaded = false;
+  if (job && w != 0 && h != 0) {
+    if (SceneFile::is_scene_file(scene_path)) {
+      sceneFile = new SceneFile();
+      loaded = sceneFile->load(scene_path);
+    } else {
+      sceneInfo = new Collada::SceneInfo();
+      loaded = Collada::ColladaParser::load(scene_path.c_str(), sceneInfo) >= 0;
+    }
+  }
+  if (!loaded) {
+    send_line(fd, "error could not load " + scene_path + "\n");
+    fprintf(stderr, "[Scotty3D] Could not load %s\n", scene_path.c_str());
+    delete sceneInfo;
+    delete sceneFile;
+    close(fd);
+    return false;
+  }
+  Application app(config);
+  app.init_headless = true;
+  app.init();
+  if (sceneFile) {
+    app.load(sceneFile, false);
+  } else {
+    app.load(sceneInfo);
+    delete sceneInfo;
+  }
+  app.set_render_size(w, h);
+
+  if (!send_line(fd, "ready\n")) {
+    close(fd);
+    return false;
+  }
+
+  size_t num_tiles = 0;
+  Timer timer;
+  timer.start();
+  while (read_line(fd, buffer, &line)) {
+    if (line == "done") {
+      timer.stop();
+      fprintf(stdout, "[Scotty3D] Rendered %zu tiles for %s (%.4f sec)\n",
+              num_tiles, address.c_str(), timer.duration());
+      close(fd);
+      return true;
+    }
+
+    std::stringstream ss(line);
+    std::string command;
+    size_t n = 0;
+    ss >> command >> n;
+    std::vector<WorkItem> tiles(n);
+    bool valid = command == "tiles";
+    for (WorkItem& tile : tiles) {
+      ss >> tile.tile_x >> tile.tile_y >> tile.tile_w >> tile.tile_h;
+      valid = valid && tile.tile_x >= 0 && tile.tile_y >= 0 &&
+              tile.tile_x % tile_size == 0 && tile.tile_y % tile_size == 0 &&
+              tile.tile_x < (int)w && tile.tile_y < (int)h &&
+              tile.tile_w == (int)std::min(tile_size, w - tile.tile_x) &&
+              tile.tile_h == (int)std::min(tile_size, h - tile.tile_y);
+    }
+    if (!ss || !valid) {
+      fprintf(stderr, "[Scotty3D] Bad tiles from %s: %s\n", address.c_str(),
+              line.c_str());
+      send_line(fd, "error bad tiles\n");
+      close(fd);
+      return false;
+    }
+
+    const HDRImageBuffer& radiance = app.render_tiles(tiles);
+
+    std::vector<float> rgb;
+    bool sent = true;
+    for (size_t i = 0; i < tiles.size() && sent; ++i) {
+      const WorkItem& tile = tiles[i];
+      rgb.clear();
+      for (int y = 0; y < tile.tile_h; ++y) {
+        const Spectrum* row =
+            &radiance.data[tile.tile_x + (tile.tile_y + y) * w];
+        for (int x = 0; x < tile.tile_w; ++x) {
+          rgb.push_back(row[x].r);
+          rgb.push_back(row[x].g);
+          rgb.push_back(row[x].b);
+        }
+      }
+      std::stringstream header;
+      header << "tile " << tile.tile_x << " " << tile.tile_y << " "
+             << tile.tile_w << " " << tile.tile_h << "\n";
+      sent = send_line(fd, header.str()) &&
+             send_all(fd, &rgb[0], rgb.size() * sizeof(float));
+    }
+    if (!sent) break;
+    num_tiles += tiles.size();
+  }
+
+  fprintf(stderr, "[Scotty3D] Lost the coordinator %s\n", address.c_str());
+  close(fd);
+  return false;
+}
+
+#endif
+
+}  // namespace CMU462
@@ -0,0 +1,132 @@
+#ifndef CMU462_TILE_FARM_H
+#define CMU462_TILE_FARM_H
+
+#include <string>
+#include <vector>
+
+#include "application.h"
+#include "image.h"
+#include "pathtracer.h"
+#include "work_queue.h"
+
+namespace CMU462 {
+
+/**
+ * Splits the render of one still between worker processes on this or other
+ * hosts, which connect to it over TCP. The coordinator does not render
+ * itself: it hands out tiles of the image, collects the radiance the
+ * workers send back and saves the assembled image once every tile is in.
+ *
+ * Workers load the scene from the path the coordinator sends, so all of
+ * them must see the scene file at the same absolute path. A worker whose
+ * connection closes, because its process died or its host went away, has
+ * its unfinished tiles handed to the other workers. Workers can join at
+ * any time, also to replace ones that died.
+ *
+ * The protocol is lines of text, with the radiance of each tile following
+ * its line as raw floats. A session goes
+ *
+ *   worker: hello <version> <threads>
+ *   coordinator: job <width> <height> <ns_aa> <max_ray_depth>
+ *                <ns_area_light> <scene path>
+ *   worker: ready                        (or error <message>)
+ *   coordinator: tiles <n> <x> <y> <w> <h> ...
+ *   worker: tile <x> <y> <w> <h>, then w * h RGB floats, for each tile
+ *   ...
+ *   coordinator: done
+ *
+ * The floats are sent in the byte order of the worker, so all the hosts
+ * of a farm must share one.
+ */
+class TileCoordinator {
+ public:
+  /**
+   * Constructor.
+   * \param config settings of the render: size, sampling, output path and
+   *        tone curve
+   * \param scene_path COLLADA file of the scene
+   */
+  TileCoordinator(const AppConfig& config, const std::string& scene_path);
+
+  /**
+   * Destructor.
+   * Closes the connections that are still open.
+   */
+  ~TileCoordinator();
+
+  /**
+   * Listen for workers on a TCP port and coordinate the render until all
+   * tiles are in, then save the image to the output path of the config.
+   * \param port port to listen on, on all interfaces
+   * \return false if the port could not be set up
+   */
+  bool run(int port);
+
+ private:
+  /**
+   * A connected worker.
+   */
+  struct Worker {
+    Worker(int fd, const std::string& name)
+        : fd(fd), name(name), num_threads(1), ready(false), payload(false) {}
+
+    int fd;                         ///< connection to the worker
+    std::string name;               ///< address of the worker, for the log
+    std::string input;              ///< received data not yet handled
+    size_t num_threads;             ///< render threads of the worker
+    bool ready;                     ///< the worker has loaded the scene
+    std::vector<WorkItem> assigned;  ///< tiles sent and not yet returned
+
+    bool payload;           ///< the radiance of a tile is being received
+    WorkItem payload_tile;  ///< tile whose radiance is being received
+  };
+
+  /**
+   * Handle what a worker sent.
+   * \return false if the worker broke the protocol
+   */
+  bool handle_input(Worker& worker);
+
+  /**
+   * Send a ready worker without tiles its next batch, if any are left.
+   * \return false if sending failed
+   */
+  bool assign_tiles(Worker& worker);
+
+  /**
+   * Close the connection of a worker and queue its unfinished tiles again.
+   * \param why reason, for the log
+   */
+  void drop(Worker& worker, const std::string& why);
+
+  /**
+   * Save the assembled image.
+   */
+  bool save_image();
+
+  AppConfig config;        ///< settings of the render
+  std::string scene_path;  ///< COLLADA file of the scene
+
+  HDRImageBuffer image;          ///< radiance assembled from the tiles
+  WorkQueue<WorkItem> pending;   ///< tiles not given to any worker
+  std::vector<bool> tile_done;   ///< the radiance of each tile is in
+  size_t num_tiles_w;            ///< number of tiles along width of the image
+  size_t num_tiles;              ///< number of tiles of the image
+  size_t num_done;               ///< number of tiles that are in
+
+  std::vector<Worker> workers;  ///< connected workers
+};
+
+/**
+ * Render tiles for a coordinator until it is done.
+ * \param address host:port of the coordinator
+ * \param config settings of the worker; the coordinator sets the size and
+ *        sampling of the render, the rest comes from here
+ * \return false if the coordinator could not be reached or went away
+ *         before the render was done
+ */
+bool run_tile_worker(const std::string& address, AppConfig config);
+
+}  // namespace CMU462
+
+#endif  // CMU462_TILE_FARM_H